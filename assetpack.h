@@ -0,0 +1,50 @@
+// Asset pack format, written by tools/assetpack.c and mapped by the game.
+//
+// One file holds every asset under its rsrc/ path. The index is an
+// open-addressing hash table (linear probing, power-of-two size) keyed by
+// the FNV-1a hash of the path, so a lookup touches one or two slots and
+// never scans. Entry data is aligned to ASSETPACK_ALIGN so the game can
+// hand it straight to SDL from the mapping without copying it.
+//
+// File layout (host byte order):
+//   AssetPackHeader
+//   AssetPackEntry[tableSize]     empty slots have name == 0
+//   char names[namesSize]         NUL-terminated paths; offset 0 is ""
+//   entry data, each entry starting on an ASSETPACK_ALIGN boundary
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <stdint.h>
+
+#define ASSETPACK_MAGIC "FAPK"
+#define ASSETPACK_VERSION 1
+#define ASSETPACK_ALIGN 64
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t entryCount;
+    uint32_t tableSize;  // slots in the index, a power of two at least twice entryCount
+    uint32_t namesSize;
+    uint32_t reserved2;
+    uint64_t fileSize;   // lets the game reject a truncated pack before touching entries
+} AssetPackHeader;
+
+typedef struct {
+    uint32_t hash;       // assetpack_hash of the path
+    uint32_t name;       // offset of the path in the name table
+    uint64_t offset;     // from the start of the file
+    uint64_t size;
+} AssetPackEntry;
+
+// FNV-1a over the path bytes
+static inline uint32_t assetpack_hash(const char *path) {
+    uint32_t hash = 2166136261u;
+    for (; *path; path++) {
+        hash = (hash ^ (uint8_t)*path) * 16777619u;
+    }
+    return hash;
+}
+
+#endif
@@ -7,6 +7,36 @@
 #include <stdlib.h>
 #include <time.h>
 #include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CPU_RENDER_AVX2 // AVX2 kernels built per function, picked at runtime
+#endif
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "framedata.h"
+#include "assetpack.h"
+#include "spectator.h"
+#include "telemetry.h"
+#include "sharedstate.h"
+#include "replay.h"
+#include "replaydb.h"
 
 #define width 1200
 #define height 640
@@ -19,39 +49,71 @@
 #define MAX_JUMP_HEIGHT 350
 #define GROUND_LEVEL (height-100) //X-axis
 #define MAX_HEALTH 250
-#define ATTACK_DURATION 35 // Number of frames an attack lasts
 #define PROJECTILE_SPEED 10
 #define PROJECTILE_WIDTH 50
 #define PROJECTILE_HEIGHT 40
-#define FRAME_DELAY 120
 #define WALKING 0
 #define JUMPING 1
 #define PUNCHNG 2
 #define KICKING 3
 #define STANCE 4
 #define SPECIAL 5
+#define ANIMATION_COUNT 6
+#define MAX_ANIM_FRAMES 64
+#define ANIM_EVENT_HIT 0x1
+#define ANIM_EVENT_SOUND_PUNCH 0x2
+#define ANIM_EVENT_SOUND_KICK 0x4
 
 typedef struct {
     SDL_Rect rect;
     int velocityY;
     int onGround;
     int originalY;
-    int isPunching;
-    int isKicking;
-    int attackTimer; // Timer to persist attacks
+    int move;        // Frame data move being performed (idle when not attacking)
+    int attackTimer; // Ticks left in the move
+    bool hitLanded;  // The move already connected, so it cannot hit again
 } Player;
 
+// Hitbox/hurtbox tables loaded from rsrc/framedata/moves.bin (see framedata.h)
+typedef struct {
+    int moveCount;
+    FrameDataMove moves[FRAMEDATA_MAX_MOVES];
+    int boxCount;
+    Sint16 *boxes;                       // One allocation holding every column
+    Sint16 *columns[FRAMEDATA_COLUMNS];  // x1, x2, mx1, mx2, y1, y2
+} FrameData;
+
+// One baked animation frame: everything drawSprite needs, precomputed at load
+typedef struct {
+    SDL_Rect src;         // Source rect on the sprite sheet
+    SDL_Rect dst;         // Destination offset from the sprite position and draw size
+    SDL_Rect dstFlipped;  // Same, when drawn facing left
+    Uint16 duration;      // Milliseconds the frame stays on screen
+    Uint16 events;        // ANIM_EVENT_* fired when the frame is entered
+} AnimFrame;
+
+typedef struct {
+    Uint16 first;  // Index of the first frame in AnimSet.frames
+    Uint16 count;  // Number of frames
+    bool loop;     // Wrap around, or hold the last frame
+} AnimClip;
+
+// All clips of one character, loaded from a .anim descriptor
+typedef struct {
+    char sheet[256];                    // Sprite sheet path
+    AnimClip clips[ANIMATION_COUNT];    // Indexed by WALKING..SPECIAL
+    AnimFrame frames[MAX_ANIM_FRAMES];  // Flat frame table shared by all clips
+    int frameCount;
+} AnimSet;
+
 // Sprite structure
 typedef struct {
-    SDL_Texture *spriteSheet;  // Texture for the sprite
-    int frameCounts[6];        // Number of frames for each animation
-    int animationHeights[6];   // Heights for each animation
-    int animationOffsets[6];   // Y offsets for each animation
-    int frameWidths[6];        // Widths for each frame
-    int spriteWidth;           // Total width of the sprite sheet
-    int currentAnimation;      // Current animation (walking, jumping, punching,kicking,special,stance)
-    int currentFrame;          // Current frame index
-    Uint32 lastFrameTime;      // Time of the last frame update
+    SDL_Texture **spriteSheet; // Game field of the sprite's texture, which residency may swap
+    const AnimSet *anims;      // Baked clips for this character
+    int currentAnimation;      // Requested animation (walking, jumping, punching,kicking,stance,special)
+    int playingAnimation;      // Animation the current frame belongs to
+    int currentFrame;          // Index into anims->frames
+    int frameTime;             // Milliseconds spent on the current frame
     int x, y;                  // Position on the screen
 } Sprite;
 
@@ -74,11 +136,18 @@ const char *Button="rsrc/images/Button.jpeg";
 const char *optionimage="rsrc/images/Optionpage.JPG";
 const char *helpbg="rsrc/images/helppage.JPG";
 const char *health= "rsrc/images/healthbar.png";
-const char *loader="rsrc/images/LoadingVS.JPEG";
+const char *loader="rsrc/images/LoadingVS.jpeg";
 const char *p1wins="rsrc/animation/P1WIN.PNG";
-const char *p2wins="rsrc/animation/P2WIN.PNG";
+const char *p2wins="rsrc/animation/P2WIN.png";
 const char *creditmenu="rsrc/animation/Credits/78.jpg";
 
+//hitbox/hurtbox tables, built by tools/framedata.c from rsrc/framedata/moves.txt
+const char *framedatafile="rsrc/framedata/moves.bin";
+
+//animation descriptors
+const char *ryuanims="rsrc/animation/ryu.anim";
+const char *kenanims="rsrc/animation/ken.anim";
+
 
 //music in fight
 // const char *Powertrap = "rsrc/audio/Powertrap.mp3";
@@ -100,1192 +169,6889 @@ const char *navigation="rsrc/sounds/Navigate.wav";
 const char *punching="rsrc/sounds/punch.wav";
 const char *kicking="rsrc/sounds/Kicking.wav";
 
+//asset pack, built by tools/assetpack.c from rsrc/assets.txt
+const char *assetpackfile="fight.pak";
 
-// Function to handle movement with collision detection
-void handle_movement(Player *player, const Uint8 *keystate, int leftKey, int rightKey, SDL_Rect *otherRect) {
-    SDL_Rect newPosition = player->rect; // Temporary position to test movement
+//decoded texture cache, rebuilt automatically when a source image changes
+const char *texturecachedir="texcache";
 
-    if (keystate[rightKey]) {
-        newPosition.x += RECT_SPEED;
-    }
-    if (keystate[leftKey]) {
-        newPosition.x -= RECT_SPEED;
-    }
+void errors(const char *errorMessage) {
+    printf("%s\n", errorMessage);
+    SDL_Quit();
+    Mix_Quit();
+    IMG_Quit();
+    TTF_Quit();
+    exit(1);  // Exit the program after logging the error
+}
 
-    // Check boundaries
-    bool withinBounds = (newPosition.x >= 0) && (newPosition.x + RECT_WIDTH <= width);
 
-    // Check collision with the other player
-    bool colliding = SDL_HasIntersection(&newPosition, otherRect);
+// ---- Memory accounting ----
+
+// Every SDL_malloc in the process (SDL itself, SDL_image, SDL_ttf,
+// SDL_mixer and the game's own buffers) goes through the hooks below. Each
+// block is prefixed with its size and the category its thread was tagged
+// with when it was allocated. Textures live in video memory, so they are
+// sized from format and dimensions when created through texture_track and
+// released through texture_destroy. F3 shows both live; the totals and
+// peaks are printed at exit.
+enum {
+    MEMORY_OTHER,    // SDL internals and anything untagged
+    MEMORY_IMAGES,   // decoding, the texture cache, loaded art
+    MEMORY_TEXT,
+    MEMORY_VIDEO,    // credits frames
+    MEMORY_AUDIO,
+    MEMORY_RENDER,   // CPU renderer, render targets, HUD
+    MEMORY_CAPTURE,
+    MEMORY_FRAME,    // the per-frame arena
+    MEMORY_CATEGORIES
+};
+const char *memoryNames[MEMORY_CATEGORIES] = { "other", "images", "text", "video", "audio", "render", "capture", "frame" };
+
+#define MAX_TRACKED_TEXTURES 1024 // a power of two
+#define TEXTURE_TOMBSTONE ((SDL_Texture *)1)
+
+// Prefix of every hooked block; 16 bytes keeps malloc's alignment
+typedef struct {
+    Uint64 size;
+    Uint32 category;
+    Uint32 reserved;
+} MemoryBlock;
 
-    if (withinBounds && !colliding) {
-        player->rect = newPosition;
+typedef struct {
+    Sint64 bytes, peak;       // heap, any thread, through the __atomic builtins
+    SDL_atomic_t blocks;
+    Sint64 textureBytes, texturePeak; // main thread only
+    int textures;
+} MemoryUsage;
+
+typedef struct {
+    bool hooked;
+    SDL_malloc_func realMalloc;
+    SDL_calloc_func realCalloc;
+    SDL_realloc_func realRealloc;
+    SDL_free_func realFree;
+    MemoryUsage usage[MEMORY_CATEGORIES];
+    Sint64 heapBytes, heapPeak; // 64-bit: a long run or one big block must not wrap them
+    SDL_atomic_t allocations;  // wraps; memory_frame folds it into the totals below
+    Uint32 lastAllocations;
+    Uint32 frameAllocations;   // in the last frame
+    Uint64 totalAllocations;
+    Sint64 textureBytes, texturePeak;
+    struct { SDL_Texture *texture; Sint64 bytes; int category; } textures[MAX_TRACKED_TEXTURES];
+    Uint32 untracked;   // table full
+} MemoryStats;
+
+MemoryStats memory;
+_Thread_local int memoryCategory; // what this thread is allocating for
+
+// Tag this thread's allocations; returns the previous tag for restoring
+int memory_tag(int category) {
+    int previous = memoryCategory;
+    memoryCategory = category;
+    return previous;
+}
+
+// A byte counter written by any thread
+Sint64 memory_get(Sint64 *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+void memory_raise(Sint64 *peak, Sint64 value) {
+    Sint64 old = memory_get(peak);
+    while (value > old && !__atomic_compare_exchange_n(peak, &old, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
     }
 }
 
-// Function to handle projectile movement and collision
-void update_projectile(Projectile *proj, Player *opponent) {
-    if (!proj->active) return;
+void memory_count(int category, Sint64 bytes, int blocks) {
+    MemoryUsage *usage = &memory.usage[category];
+    memory_raise(&usage->peak, __atomic_add_fetch(&usage->bytes, bytes, __ATOMIC_RELAXED));
+    memory_raise(&memory.heapPeak, __atomic_add_fetch(&memory.heapBytes, bytes, __ATOMIC_RELAXED));
+    SDL_AtomicAdd(&usage->blocks, blocks);
+}
 
-    proj->rect.x += proj->velocityX;
+void *memory_finish(MemoryBlock *block, size_t size) {
+    if (!block) {
+        return NULL;
+    }
+    block->size = size;
+    block->category = memoryCategory;
+    memory_count(block->category, (Sint64)size, 1);
+    SDL_AtomicIncRef(&memory.allocations);
+    return block + 1;
+}
 
-    if (proj->rect.x < 0 || proj->rect.x > width) {
-        proj->active = false;
-        return;
+void *memory_malloc(size_t size) {
+    return memory_finish(memory.realMalloc(sizeof(MemoryBlock) + size), size);
+}
+
+void *memory_calloc(size_t count, size_t size) {
+    if (size != 0 && count > (SIZE_MAX - sizeof(MemoryBlock)) / size) {
+        return NULL;
     }
+    return memory_finish(memory.realCalloc(1, sizeof(MemoryBlock) + count * size), count * size);
 }
 
-void renderProjectile(SDL_Renderer *renderer, SDL_Texture *texture, Projectile *proj, bool flipHorizontal) {
-    if (proj->active) {
-        SDL_RendererFlip flip = flipHorizontal ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
-        SDL_RenderCopyEx(renderer, texture, NULL, &proj->rect, 0, NULL, flip);
+void *memory_realloc(void *pointer, size_t size) {
+    if (!pointer) {
+        return memory_malloc(size);
     }
+    MemoryBlock *block = (MemoryBlock *)pointer - 1;
+    Uint64 oldSize = block->size;
+    block = memory.realRealloc(block, sizeof(MemoryBlock) + size);
+    if (!block) {
+        return NULL; // the old block is untouched
+    }
+    block->size = size;
+    memory_count(block->category, (Sint64)size - (Sint64)oldSize, 0);
+    SDL_AtomicIncRef(&memory.allocations);
+    return block + 1;
 }
 
+void memory_free(void *pointer) {
+    if (!pointer) {
+        return;
+    }
+    MemoryBlock *block = (MemoryBlock *)pointer - 1;
+    memory_count(block->category, -(Sint64)block->size, -1);
+    memory.realFree(block);
+}
 
+// Install the hooks; must run before anything allocates through SDL
+void memory_hook(void) {
+    SDL_GetMemoryFunctions(&memory.realMalloc, &memory.realCalloc, &memory.realRealloc, &memory.realFree);
+    if (SDL_GetNumAllocations() > 0) {
+        SDL_Log("SDL allocated before the memory hooks; heap accounting is off");
+        return;
+    }
+    memory.hooked = SDL_SetMemoryFunctions(memory_malloc, memory_calloc, memory_realloc, memory_free) == 0;
+}
 
+int texture_slot(SDL_Texture *texture) {
+    return (int)(((uintptr_t)texture >> 4) * 2654435761u) & (MAX_TRACKED_TEXTURES - 1);
+}
 
-// Function to compute attack rectangle based on attack type and direction
-SDL_Rect compute_attack_rect(Player *attacker, Player *opponent) {
-    SDL_Rect attackRect = attacker->rect;
+// A texture's estimated video memory, 0 if it cannot be queried
+Sint64 texture_bytes(SDL_Texture *texture) {
+    Uint32 format;
+    int w, h;
+    if (!texture || SDL_QueryTexture(texture, &format, NULL, &w, &h) != 0) {
+        return 0;
+    }
+    // Planar YUV averages 1.5 bytes a pixel; count it as 2
+    return (Sint64)w * h * (SDL_ISPIXELFORMAT_FOURCC(format) ? 2 : SDL_BYTESPERPIXEL(format));
+}
 
-    // Expand horizontally towards the opponent
-    if (attacker->rect.x < opponent->rect.x) {
-        // Expand to the right
-        attackRect.w += 20;
-    } else {
-        // Expand to the left
-        attackRect.x -= 20;
-        attackRect.w += 20;
+// Record a new texture's estimated video memory; returns texture (main thread only)
+SDL_Texture *texture_track(SDL_Texture *texture, int category) {
+    Sint64 bytes = texture_bytes(texture);
+    if (bytes == 0) {
+        return texture;
+    }
+    for (int i = 0, slot = texture_slot(texture); i < MAX_TRACKED_TEXTURES; i++, slot = (slot + 1) & (MAX_TRACKED_TEXTURES - 1)) {
+        if (!memory.textures[slot].texture || memory.textures[slot].texture == TEXTURE_TOMBSTONE) {
+            memory.textures[slot].texture = texture;
+            memory.textures[slot].bytes = bytes;
+            memory.textures[slot].category = category;
+            MemoryUsage *usage = &memory.usage[category];
+            usage->textureBytes += bytes;
+            usage->texturePeak = SDL_max(usage->texturePeak, usage->textureBytes);
+            usage->textures++;
+            memory.textureBytes += bytes;
+            memory.texturePeak = SDL_max(memory.texturePeak, memory.textureBytes);
+            return texture;
+        }
     }
+    memory.untracked++;
+    return texture;
+}
 
-    return attackRect;
+// SDL_DestroyTexture that also forgets the texture's accounting
+void texture_destroy(SDL_Texture *texture) {
+    if (!texture) {
+        return;
+    }
+    for (int i = 0, slot = texture_slot(texture); i < MAX_TRACKED_TEXTURES && memory.textures[slot].texture;
+         i++, slot = (slot + 1) & (MAX_TRACKED_TEXTURES - 1)) {
+        if (memory.textures[slot].texture == texture) {
+            MemoryUsage *usage = &memory.usage[memory.textures[slot].category];
+            usage->textureBytes -= memory.textures[slot].bytes;
+            usage->textures--;
+            memory.textureBytes -= memory.textures[slot].bytes;
+            memory.textures[slot].texture = TEXTURE_TOMBSTONE;
+            break;
+        }
+    }
+    SDL_DestroyTexture(texture);
 }
 
+// Main thread, once per rendered frame
+void memory_frame(void) {
+    Uint32 allocations = (Uint32)SDL_AtomicGet(&memory.allocations);
+    memory.frameAllocations = allocations - memory.lastAllocations;
+    memory.lastAllocations = allocations;
+    memory.totalAllocations += memory.frameAllocations;
+}
 
+void memory_report(void) {
+    if (!memory.hooked) {
+        return;
+    }
+    Uint32 lastFrame = memory.frameAllocations;
+    memory_frame();
+    printf("Memory at exit: heap peak %.1f MB, %llu allocations (%u in the last frame); textures peak %.1f MB%s\n",
+           memory_get(&memory.heapPeak) / 1048576.0, (unsigned long long)memory.totalAllocations, lastFrame,
+           memory.texturePeak / 1048576.0, memory.untracked ? " (some untracked)" : "");
+    for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+        MemoryUsage *usage = &memory.usage[i];
+        if (memory_get(&usage->peak) == 0 && usage->texturePeak == 0) {
+            continue;
+        }
+        printf("  %-8s heap %8.1f KB live in %5d block(s), peak %8.1f KB; textures %8.1f KB live, peak %8.1f KB\n",
+               memoryNames[i], memory_get(&usage->bytes) / 1024.0, SDL_AtomicGet(&usage->blocks),
+               memory_get(&usage->peak) / 1024.0, usage->textureBytes / 1024.0, usage->texturePeak / 1024.0);
+    }
+}
 
+// ---- Frame arena ----
 
-// Function to handle jump mechanism
-void handle_jump(Player *player) {
-    if (!player->onGround) {
-        player->velocityY += GRAVITY; // Apply gravity
+// Bump allocator for data that lives for one frame: draw command lists,
+// overlay strings, scratch rects. The main thread resets it at the top of
+// every loop iteration. A request that does not fit spills to the heap until the
+// reset, which then grows the arena to hold the largest frame seen.
+#define FRAME_ARENA_SIZE (64 * 1024)
+#define FRAME_ARENA_ALIGN 16
+
+typedef struct ArenaSpill {
+    struct ArenaSpill *next;
+    Uint8 padding[FRAME_ARENA_ALIGN - sizeof(void *)];
+} ArenaSpill;
+
+typedef struct {
+    Uint8 *base;
+    size_t size;
+    size_t used;
+    size_t frameBytes;   // this frame's, spills included
+    size_t peak;         // most any frame used
+    ArenaSpill *spills;
+    Uint32 spillCount;   // over the whole run
+    Uint32 grows;
+} FrameArena;
+
+FrameArena frameArena;
+
+void *arena_alloc(FrameArena *arena, size_t size) {
+    size = (size + FRAME_ARENA_ALIGN - 1) & ~(size_t)(FRAME_ARENA_ALIGN - 1);
+    arena->frameBytes += size;
+    if (arena->base && arena->size - arena->used >= size) {
+        void *block = arena->base + arena->used;
+        arena->used += size;
+        return block;
     }
-    player->rect.y += player->velocityY;
+    int previous = memory_tag(MEMORY_FRAME);
+    ArenaSpill *spill = SDL_malloc(sizeof(ArenaSpill) + size);
+    memory_tag(previous);
+    if (!spill) {
+        return NULL;
+    }
+    spill->next = arena->spills;
+    arena->spills = spill;
+    arena->spillCount++;
+    return spill + 1;
+}
 
-    // Limit the jump height
-    if (player->rect.y <= player->originalY - MAX_JUMP_HEIGHT) {
-        player->rect.y = player->originalY - MAX_JUMP_HEIGHT;
-        player->velocityY = 0;
+// printf into the arena; never NULL, so it can feed renderText directly
+const char *arena_printf(FrameArena *arena, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = SDL_vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    char *text = length >= 0 ? arena_alloc(arena, (size_t)length + 1) : NULL;
+    if (!text) {
+        return "";
     }
+    va_start(args, format);
+    SDL_vsnprintf(text, (size_t)length + 1, format, args);
+    va_end(args);
+    return text;
+}
 
-    // Reset to ground
-    if (player->rect.y >= player->originalY) {
-        player->rect.y = player->originalY;
-        player->velocityY = 0;
-        player->onGround = true;
+void arena_free_spills(FrameArena *arena) {
+    while (arena->spills) {
+        ArenaSpill *next = arena->spills->next;
+        SDL_free(arena->spills);
+        arena->spills = next;
+    }
+}
+
+// Start a frame: everything handed out since the last reset is gone
+void arena_reset(FrameArena *arena) {
+    arena->peak = SDL_max(arena->peak, arena->frameBytes);
+    if (arena->spills || !arena->base) {
+        arena_free_spills(arena);
+        size_t size = arena->size ? arena->size : FRAME_ARENA_SIZE;
+        while (size < arena->peak) {
+            size *= 2;
+        }
+        if (size != arena->size || !arena->base) {
+            int previous = memory_tag(MEMORY_FRAME);
+            SDL_free(arena->base);
+            arena->base = SDL_malloc(size);
+            memory_tag(previous);
+            arena->grows += arena->base && arena->size != 0 && size != arena->size;
+            arena->size = arena->base ? size : 0;
+        }
     }
+    arena->used = 0;
+    arena->frameBytes = 0;
+}
+
+void arena_free(FrameArena *arena) {
+    arena->peak = SDL_max(arena->peak, arena->frameBytes);
+    arena_free_spills(arena);
+    SDL_free(arena->base);
+    arena->base = NULL;
+    printf("Frame arena: %.0f KB, peak %.1f KB in one frame, %u spill(s), grown %u time(s)\n",
+           arena->size / 1024.0, arena->peak / 1024.0, arena->spillCount, arena->grows);
+    arena->size = 0;
 }
 
-// Function to handle punch and kick
-void handle_attack(Player *attacker, Player *opponent, int isPunch) {
-    if (attacker->attackTimer > 0) {
-        SDL_Rect attackRect = attacker->rect;
 
-        // Expand attack rectangle for punch/kick
-        if (isPunch) {
-            attackRect.w += 30; // Punch extends width
+// ---- Asset pack ----
+
+// The mapped pack. Entries are handed to SDL straight from the mapping, so it
+// stays mapped until every asset loaded from it has been freed.
+typedef struct {
+    const Uint8 *base;   // NULL when loading loose files
+    size_t size;
+    const AssetPackHeader *header;
+    const AssetPackEntry *table;
+    const char *names;
+} AssetPack;
+
+AssetPack assetPack;
+
+// Map the pack at path. Returns false if there is no pack; a damaged one is fatal.
+bool assets_mount(const char *path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = GetFileSizeEx(file, &fileSize) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+    const Uint8 *base = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    size_t size = (size_t)fileSize.QuadPart;
+    if (mapping) {
+        CloseHandle(mapping); // The view keeps the mapping alive
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    const Uint8 *base = NULL;
+    size_t size = 0;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        size = info.st_size;
+        base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+            base = NULL;
         } else {
-            attackRect.h += 10; // Kick extends height
-            attackRect.y -= 10; // Adjust position upwards for kick
+            madvise((void *)base, size, MADV_WILLNEED); // start reading ahead while the window opens
         }
+    }
+    close(fd);
+#endif
+    if (!base) {
+        errors("Asset pack Error: Unable to map the asset pack.");
+    }
 
-        // Decrease attack timer
-        attacker->attackTimer--;
-    } else {
-        // Reset attack states
-        attacker->isPunching = 0;
-        attacker->isKicking = 0;
+    const AssetPackHeader *header = (const AssetPackHeader *)base;
+    bool ok = size >= sizeof(AssetPackHeader) &&
+              memcmp(header->magic, ASSETPACK_MAGIC, sizeof(header->magic)) == 0 &&
+              header->version == ASSETPACK_VERSION &&
+              header->fileSize == size &&
+              header->tableSize != 0 && (header->tableSize & (header->tableSize - 1)) == 0 &&
+              header->entryCount < header->tableSize &&
+              sizeof(AssetPackHeader) + (Uint64)header->tableSize * sizeof(AssetPackEntry) + header->namesSize <= size;
+    if (ok) {
+        assetPack.base = base;
+        assetPack.size = size;
+        assetPack.header = header;
+        assetPack.table = (const AssetPackEntry *)(header + 1);
+        assetPack.names = (const char *)(assetPack.table + header->tableSize);
+        ok = header->namesSize > 0 && assetPack.names[header->namesSize - 1] == '\0';
+    }
+    // Bounds-check every entry once so lookups can trust the index
+    for (Uint32 i = 0; ok && i < header->tableSize; i++) {
+        const AssetPackEntry *entry = &assetPack.table[i];
+        ok = entry->name < header->namesSize && entry->offset <= size && entry->size <= size - entry->offset;
     }
+    if (!ok) {
+        errors("Asset pack Error: The asset pack is damaged or out of date.");
+    }
+    return true;
 }
 
-// Function to load a texture from a file
-SDL_Texture *characterTexture(const char *path, SDL_Renderer *renderer) {
-    SDL_Surface *surface = SDL_LoadBMP(path);
-    if (!surface) {
-        SDL_Log("Unable to load image %s! SDL_Error: %s", path, SDL_GetError());
-        return NULL;
+void assets_unmount(void) {
+    if (!assetPack.base) {
+        return;
     }
-
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-    SDL_FreeSurface(surface);
-
-    return texture;
+#ifdef _WIN32
+    UnmapViewOfFile(assetPack.base);
+#else
+    munmap((void *)assetPack.base, assetPack.size);
+#endif
+    memset(&assetPack, 0, sizeof(assetPack));
 }
 
-// Function to update a sprite's animation
-void updateSprite(Sprite *sprite, Uint32 currentTime) {
-    if (currentTime > sprite->lastFrameTime + FRAME_DELAY) {
-        sprite->lastFrameTime = currentTime;
-        sprite->currentFrame = (sprite->currentFrame + 1) % sprite->frameCounts[sprite->currentAnimation];
+// Open an asset by its rsrc/ path: a read-only view into the pack, or the
+// loose file when no pack is mounted. Returns NULL (with SDL_GetError set)
+// if it is missing; every SDL loader taking an SDL_RWops reports that as a
+// load failure.
+SDL_RWops *asset_open(const char *path) {
+    if (!assetPack.base) {
+        return SDL_RWFromFile(path, "rb");
+    }
+    Uint32 hash = assetpack_hash(path);
+    Uint32 mask = assetPack.header->tableSize - 1;
+    for (Uint32 slot = hash & mask; assetPack.table[slot].name != 0; slot = (slot + 1) & mask) {
+        const AssetPackEntry *entry = &assetPack.table[slot];
+        if (entry->hash == hash && strcmp(assetPack.names + entry->name, path) == 0) {
+            return SDL_RWFromConstMem(assetPack.base + entry->offset, (int)entry->size);
+        }
     }
+    SDL_SetError("%s is not in the asset pack", path);
+    return NULL;
 }
 
-// Function to render a sprite
-void renderSprite(Sprite *sprite, SDL_Renderer *renderer, bool flipHorizontal) {
-    int FRAME_WIDTH = sprite->spriteWidth / sprite->frameCounts[sprite->currentAnimation];
-    int FRAME_HEIGHT = sprite->animationHeights[sprite->currentAnimation];
-    int Y_OFFSET = sprite->animationOffsets[sprite->currentAnimation];
+// Read one line (up to size - 1 bytes) from an asset; false at the end
+bool readLine(SDL_RWops *rw, char *line, int size) {
+    int n = 0;
+    char c;
+    while (n < size - 1 && SDL_RWread(rw, &c, 1, 1) == 1) {
+        line[n++] = c;
+        if (c == '\n') {
+            break;
+        }
+    }
+    line[n] = '\0';
+    return n > 0;
+}
 
-    SDL_Rect srcRect = {
-        sprite->currentFrame * FRAME_WIDTH, // X-coordinate for the frame
-        Y_OFFSET,                           // Y-offset for the animation row
-        FRAME_WIDTH,                        // Width of the frame
-        FRAME_HEIGHT                        // Height of the frame
-    };
 
+// ---- Resource counts ----
 
-    // Dynamic offset adjustment based on flipHorizontal
-    SDL_Rect dstRect = {
-        sprite->x - FRAME_WIDTH / 2 + (flipHorizontal ? -50 :0), // Offset based on orientation
-        sprite->y - FRAME_HEIGHT / 2 - 20,                        // Center vertically
-        FRAME_WIDTH*2,                                              // Width to draw
-        FRAME_HEIGHT*2                                              // Height to draw
-    };
+// Sounds, music, fonts and surfaces are loaded and freed through these so
+// the soak test can tell a leak from a steady state; textures are counted
+// by texture_track. Surfaces are also decoded on worker threads.
+typedef struct {
+    int chunks;
+    int music;
+    int fonts;
+    SDL_atomic_t surfaces;
+} Resources;
 
-    // Flip the sprite horizontally if needed
-    SDL_RendererFlip flip = flipHorizontal ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
+Resources resources;
 
-    SDL_RenderCopyEx(renderer, sprite->spriteSheet, &srcRect, &dstRect, 0, NULL, flip);
+SDL_Surface *surface_track(SDL_Surface *surface) {
+    if (surface) {
+        SDL_AtomicIncRef(&resources.surfaces);
+    }
+    return surface;
 }
 
+void surface_free(SDL_Surface *surface) {
+    if (surface) {
+        SDL_AtomicAdd(&resources.surfaces, -1);
+        SDL_FreeSurface(surface);
+    }
+}
 
+Mix_Chunk *chunk_load(const char *path) {
+    int previous = memory_tag(MEMORY_AUDIO);
+    Mix_Chunk *chunk = Mix_LoadWAV_RW(asset_open(path), 1);
+    memory_tag(previous);
+    resources.chunks += chunk != NULL;
+    return chunk;
+}
 
+void chunk_free(Mix_Chunk *chunk) {
+    if (chunk) {
+        resources.chunks--;
+        Mix_FreeChunk(chunk);
+    }
+}
 
-void errors(const char *errorMessage) {
-    printf("%s\n", errorMessage);
-    SDL_Quit();
-    Mix_Quit();
-    IMG_Quit();
-    TTF_Quit();
-    exit(1);  // Exit the program after logging the error
+Mix_Music *music_load(const char *path) {
+    int previous = memory_tag(MEMORY_AUDIO);
+    Mix_Music *music = Mix_LoadMUS_RW(asset_open(path), 1);
+    memory_tag(previous);
+    resources.music += music != NULL;
+    return music;
 }
 
-int main(int argc, char *argv[]) {
-    // Initialize SDL
-    if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
-        errors("SDL_Init Error: Unable to initialize SDL.");
+void music_free(Mix_Music *music) {
+    if (music) {
+        resources.music--;
+        Mix_FreeMusic(music);
     }
+}
 
-    // Create Window
-    SDL_Window *window = SDL_CreateWindow("Fight Arena", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_SHOWN);
-    if (!window) {
-        errors("SDL_CreateWindow Error: Unable to create window.");
-    }
+TTF_Font *font_open(const char *path, int size) {
+    int previous = memory_tag(MEMORY_TEXT);
+    TTF_Font *font = TTF_OpenFontRW(asset_open(path), 1, size);
+    memory_tag(previous);
+    resources.fonts += font != NULL;
+    return font;
+}
 
-    // Create Renderer
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) {
-        errors("SDL_CreateRenderer Error: Unable to create renderer.");
+void font_close(TTF_Font *font) {
+    if (font) {
+        resources.fonts--;
+        TTF_CloseFont(font);
     }
+}
 
-    // Initialize SDL_mixer (for audio)
-    if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0) {
-        errors("SDL_mixer Error: Unable to initialize audio.");
+int texture_count(void) {
+    int count = 0;
+    for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+        count += memory.usage[i].textures;
     }
+    return count;
+}
 
-    // Initialize SDL_image (for textures)
-    if (IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG != IMG_INIT_PNG) {
-        errors("SDL_image Error: Unable to initialize PNG support.");
+// Resident set size in bytes, 0 where the platform does not say
+Uint64 process_rss(void) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#else
+    FILE *file = fopen("/proc/self/statm", "r");
+    unsigned long long pages = 0, resident = 0;
+    if (file) {
+        if (fscanf(file, "%llu %llu", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(file);
     }
+    return (Uint64)resident * (Uint64)sysconf(_SC_PAGESIZE);
+#endif
+}
 
-        if (!(IMG_Init(IMG_INIT_JPG) & IMG_INIT_JPG)) {
-        printf("IMG_Init Error: %s\n", IMG_GetError());
-        SDL_Quit();
-        return 1;
-    }
-    
-    // Initialize SDL_ttf (for text)
-    if (TTF_Init() == -1) {
-        errors("SDL_ttf Error: Unable to initialize SDL_ttf.");
-    }
 
+// ---- CPU renderer images ----
 
-    // Game state flags
-    bool run = true, menu = true, play = false, pause = false, select = false, option = false,voice=true,help=false,credit=false,creditsvid=true,loading;
-    int borderpos = height / 2 + 90;
-    int borderposY = height / 2;
-    int opacity,voicecount=0,helpcount=0,creditcount=0,musiccount=1,prevmusic=1;
-    int menuSelect = 0;
-    int player1_health,player2_health;
-    
-    // Variables for file path and event handling
-    char frame_path[256];
+// The CPU renderer (see below) draws from its own ARGB8888 copies of the
+// textures it needs, since SDL textures cannot be read back. Copies are
+// made as textures are created and looked up by texture.
+#define MAX_CPU_IMAGES 32
+#define MAX_CPU_BANDS 8
 
-    // Load textures for menu background and options
-    SDL_Color textWhite = {255, 255, 255};
-    SDL_Texture *menuTexture = NULL;
-    SDL_Texture *ButtonTexture = NULL;
-    SDL_Texture *optionTexture = NULL;
-    SDL_Texture *helpTexture = NULL;
-    SDL_Texture *arenaTexture = NULL;
-    SDL_Texture *healthTexture=NULL;
-    SDL_Texture *loadTexture=NULL;
-    SDL_Texture *winner1=NULL;
-    SDL_Texture *winner2=NULL;
-    SDL_Texture *creditsmenu=NULL;
-    SDL_Texture *Haduoken=NULL;
+typedef struct {
+    SDL_Texture *texture;  // the SDL texture this copy stands in for
+    Uint32 *pixels;        // ARGB8888, pitch == w
+    int w, h;
+    bool blend;            // blend mode is BLEND and some pixel is not fully opaque
+} CpuImage;
+
+struct DrawCommand;
+
+typedef struct {
+    bool enabled;          // --renderer cpu
+    int bandCount;         // horizontal bands rasterized in parallel (--cpu-threads)
+    CpuImage images[MAX_CPU_IMAGES];
+    int imageCount;
+
+    // Frame being rasterized
+    SDL_Texture *frame;    // streaming texture the bands draw into
+    Uint32 *pixels;
+    int pitch;             // in pixels
+    const struct DrawCommand *commands;
+    int commandCount;
+    bool clear;            // nothing opaque covers the whole frame
+
+    SDL_Thread *threads[MAX_CPU_BANDS];
+    SDL_sem *start[MAX_CPU_BANDS];
+    SDL_sem *done;
+    SDL_atomic_t quit;
+    char description[64];
+} CpuRenderer;
+
+CpuRenderer cpuRenderer;
+
+// Take ownership of an ARGB8888 copy of texture's pixels
+void cpu_add_image(SDL_Texture *texture, Uint32 *pixels, int w, int h) {
+    if (cpuRenderer.imageCount == MAX_CPU_IMAGES) {
+        SDL_Log("CPU renderer image table full");
+        SDL_free(pixels);
+        return;
+    }
+    CpuImage *image = &cpuRenderer.images[cpuRenderer.imageCount++];
+    image->texture = texture;
+    image->pixels = pixels;
+    image->w = w;
+    image->h = h;
+
+    // Opaque images take the straight copy kernels
+    SDL_BlendMode blendMode = SDL_BLENDMODE_NONE;
+    SDL_GetTextureBlendMode(texture, &blendMode);
+    image->blend = false;
+    for (int i = 0; blendMode == SDL_BLENDMODE_BLEND && i < w * h && !image->blend; i++) {
+        image->blend = (pixels[i] >> 24) != 255;
+    }
+}
 
+void cpu_register_surface(SDL_Texture *texture, SDL_Surface *surface) {
+    if (!cpuRenderer.enabled || !texture) {
+        return;
+    }
+    SDL_Surface *argb = surface_track(SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0));
+    Uint32 *pixels = argb ? SDL_malloc((size_t)argb->w * argb->h * 4) : NULL;
+    if (pixels) {
+        for (int y = 0; y < argb->h; y++) {
+            memcpy(pixels + y * argb->w, (Uint8 *)argb->pixels + y * argb->pitch, argb->w * 4);
+        }
+        cpu_add_image(texture, pixels, argb->w, argb->h);
+    }
+    surface_free(argb);
+}
 
+void cpu_register_pixels(SDL_Texture *texture, Uint32 format, const void *source, int pitch, int w, int h) {
+    if (!cpuRenderer.enabled || !texture) {
+        return;
+    }
+    Uint32 *pixels = SDL_malloc((size_t)w * h * 4);
+    if (pixels && SDL_ConvertPixels(w, h, format, source, pitch, SDL_PIXELFORMAT_ARGB8888, pixels, w * 4) == 0) {
+        cpu_add_image(texture, pixels, w, h);
+    } else {
+        SDL_free(pixels);
+    }
+}
 
+// Drop the copy of a texture that is about to be destroyed
+void cpu_forget(SDL_Texture *texture) {
+    for (int i = 0; i < cpuRenderer.imageCount; i++) {
+        if (cpuRenderer.images[i].texture == texture) {
+            SDL_free(cpuRenderer.images[i].pixels);
+            cpuRenderer.images[i] = cpuRenderer.images[--cpuRenderer.imageCount];
+            return;
+        }
+    }
+}
 
+const CpuImage *cpu_image(SDL_Texture *texture) {
+    for (int i = 0; i < cpuRenderer.imageCount; i++) {
+        if (cpuRenderer.images[i].texture == texture) {
+            return &cpuRenderer.images[i];
+        }
+    }
+    return NULL;
+}
 
 
+// ---- Texture cache ----
 
-    // Initialize players
-    Player player1 = {
-        .rect = {100, GROUND_LEVEL - RECT_HEIGHT, RECT_WIDTH, RECT_HEIGHT},
-        .velocityY = 0,
-        .onGround = true,
-        .originalY = GROUND_LEVEL - RECT_HEIGHT,
-        .isPunching = false,
-        .isKicking = false,
-        .attackTimer = 0
-    };
+// Decoded images are kept on disk in the pixel format the renderer chose for
+// them, keyed by a hash of the source file's contents. A changed source
+// hashes to a new key, so stale entries are simply never read again.
+#define TEXCACHE_MAGIC "FATC"
+#define TEXCACHE_VERSION 1
 
-    Player player2 = {
-        .rect = {width - 150, GROUND_LEVEL - RECT_HEIGHT, RECT_WIDTH, RECT_HEIGHT},
-        .velocityY = 0,
-        .onGround = true,
-        .originalY = GROUND_LEVEL - RECT_HEIGHT,
-        .isPunching = false,
-        .isKicking = false,
-        .attackTimer = 0
-    };
+typedef struct {
+    char magic[4];
+    Uint32 version;
+    Uint64 sourceHash;   // guards against a name clash in the cache directory
+    Uint32 format;       // SDL_PixelFormatEnum of the texture
+    Uint32 blendMode;    // as SDL_CreateTextureFromSurface picked it
+    int w, h;
+    int pitch;           // bytes per row in the file: w * bytes per pixel
+} TexCacheHeader;
 
-    Projectile player1Projectile = { .rect = {0, 0, PROJECTILE_WIDTH, PROJECTILE_HEIGHT}, .velocityX = 0, .active = false };
-    Projectile player2Projectile = { .rect = {0, 0, PROJECTILE_WIDTH, PROJECTILE_HEIGHT}, .velocityX = 0, .active = false };
+typedef struct {
+    bool enabled;        // cleared by --no-texture-cache, or if the directory cannot be created
+    int hits, misses;
+    Uint64 loadTicks;    // performance counter ticks spent loading images
+} TextureCache;
 
+TextureCache textureCache = { true, 0, 0, 0 };
 
-    // Load the main menu background texture
-    menuTexture = IMG_LoadTexture(renderer, menuimage);
-    if (!menuTexture) {
-        errors("SDL_image Error: Unable to load menu image.");
+void texcache_init(void) {
+    if (!textureCache.enabled) {
+        return;
     }
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);  // Enable transparency blend mode
-
-    healthTexture =IMG_LoadTexture(renderer,health);
-    if(!healthTexture){
-        errors("SDL_image Error: Unable to load menu image.");
+#ifdef _WIN32
+    bool ok = CreateDirectoryA(texturecachedir, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    bool ok = mkdir(texturecachedir, 0755) == 0 || errno == EEXIST;
+#endif
+    if (!ok) {
+        SDL_Log("Unable to create texture cache %s, decoding every image", texturecachedir);
+        textureCache.enabled = false;
     }
+}
 
-    winner1 =IMG_LoadTexture(renderer,p1wins);
-    if(!winner1){
-        errors("SDL_image Error: Unable to load menu image.");
+// FNV-1a (64-bit) over the whole asset, leaving it rewound
+Uint64 hashAsset(SDL_RWops *rw) {
+    Uint8 buffer[16384];
+    Uint64 hash = 14695981039346656037ull;
+    size_t n;
+    while ((n = SDL_RWread(rw, buffer, 1, sizeof(buffer))) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            hash = (hash ^ buffer[i]) * 1099511628211ull;
+        }
     }
-    winner2 =IMG_LoadTexture(renderer,p2wins);
-    if(!winner2){
-        errors("SDL_image Error: Unable to load menu image.");
+    SDL_RWseek(rw, 0, RW_SEEK_SET);
+    return hash;
+}
+
+// Read a cache file's pixels; NULL if there is no usable entry. Safe on any thread.
+void *texcache_read(const char *file, Uint64 hash, TexCacheHeader *header) {
+    SDL_RWops *rw = SDL_RWFromFile(file, "rb");
+    if (!rw) {
+        return NULL;
     }
-    creditsmenu =IMG_LoadTexture(renderer,creditmenu);
-    if(!creditsmenu){
-        errors("SDL_image Error: Unable to load menu image.");
+    void *pixels = NULL;
+    if (SDL_RWread(rw, header, sizeof(*header), 1) == 1 &&
+        memcmp(header->magic, TEXCACHE_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == TEXCACHE_VERSION && header->sourceHash == hash &&
+        header->w > 0 && header->h > 0 && header->pitch == header->w * (int)SDL_BYTESPERPIXEL(header->format)) {
+        size_t size = (size_t)header->pitch * header->h;
+        pixels = SDL_malloc(size);
+        if (pixels && SDL_RWread(rw, pixels, size, 1) != 1) {
+            SDL_free(pixels);
+            pixels = NULL;
+        }
     }
-    // Load the button texture
-    ButtonTexture = IMG_LoadTexture(renderer, Button);  
-    if (!ButtonTexture) {
-        errors("SDL_image Error: Unable to load button image.");
+    SDL_RWclose(rw);
+    return pixels;
+}
+
+// Create the texture for cached pixels (render thread only)
+SDL_Texture *texcache_upload(SDL_Renderer *renderer, const TexCacheHeader *header, const void *pixels) {
+    SDL_Texture *texture = SDL_CreateTexture(renderer, header->format, SDL_TEXTUREACCESS_STATIC, header->w, header->h);
+    if (texture) {
+        SDL_UpdateTexture(texture, NULL, pixels, header->pitch);
+        SDL_SetTextureBlendMode(texture, (SDL_BlendMode)header->blendMode);
     }
+    return texture;
+}
 
-    // Load the option texture
-    optionTexture = IMG_LoadTexture(renderer, optionimage);
-    if (!optionTexture) {
-        errors("SDL_image Error: Unable to load option image.");
+// Write the decoded surface out in the texture's format. The entry is written
+// under a temporary name first so a crash never leaves a torn file behind.
+void texcache_store(const char *file, Uint64 hash, SDL_Surface *surface, SDL_Texture *texture) {
+    TexCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    SDL_BlendMode blendMode;
+    SDL_QueryTexture(texture, &header.format, NULL, &header.w, &header.h);
+    SDL_GetTextureBlendMode(texture, &blendMode);
+    if (SDL_BYTESPERPIXEL(header.format) == 0) {
+        return; // Planar or compressed: not worth caching
     }
-    
-    
-    arenaTexture = IMG_LoadTexture(renderer, arenabackground);
-    if (!arenaTexture) {
-        errors("SDL_image Error: Unable to load option image.");
+    SDL_Surface *converted = surface_track(SDL_ConvertSurfaceFormat(surface, header.format, 0));
+    if (!converted) {
+        return;
     }
-
-    // Load the help texture
-    helpTexture = IMG_LoadTexture(renderer, helpbg);
-    if (!helpTexture) {
-        errors("SDL_image Error: Unable to load help image.");
+    memcpy(header.magic, TEXCACHE_MAGIC, sizeof(header.magic));
+    header.version = TEXCACHE_VERSION;
+    header.sourceHash = hash;
+    header.blendMode = blendMode;
+    header.pitch = header.w * SDL_BYTESPERPIXEL(header.format);
+
+    char temp[280];
+    snprintf(temp, sizeof(temp), "%s.tmp", file);
+    SDL_RWops *out = SDL_RWFromFile(temp, "wb");
+    bool ok = out && SDL_RWwrite(out, &header, sizeof(header), 1) == 1;
+    for (int y = 0; ok && y < header.h; y++) {
+        ok = SDL_RWwrite(out, (Uint8 *)converted->pixels + y * converted->pitch, header.pitch, 1) == 1;
     }
-
-    //oldengl font   
-    TTF_Font *menuFont = TTF_OpenFont(buttonfont, 64);
-    if (!menuFont) {
-        errors("TTF_OpenFont Error: Unable to open font.");
+    if (out) {
+        SDL_RWclose(out);
     }
-
-    //MTCORSVA font
-    TTF_Font *normalfont = TTF_OpenFont(textfont, 20);
-    if (!normalfont) {
-        errors("TTF_OpenFont Error: Unable to open font.");
+    remove(file);
+    if (!ok || rename(temp, file) != 0) {
+        remove(temp);
     }
+    surface_free(converted);
+}
 
-    // Load Haduoken texture
-    Haduoken = IMG_LoadTexture(renderer,"rsrc/animation/haduoken.bmp");
-    if (!Haduoken) {
-        errors("SDL_image Error: Unable to load Haduoken image.");
+// One image on its way to becoming a texture. Decoding (file read, hash,
+// cache lookup or JPEG/PNG decode) is safe on any thread; the upload has
+// to happen on the render thread.
+typedef struct {
+    const char *path;
+    SDL_Texture **texture;       // where the upload lands
+    const char *errorMessage;    // fatal if the image cannot be loaded
+
+    // Filled in by decodeImage
+    Uint64 hash;
+    void *pixels;                // cache hit: pixels in the texture's format
+    TexCacheHeader header;
+    SDL_Surface *surface;        // cache miss: the decoded image
+    Uint64 decodeTicks;
+
+    SDL_atomic_t done;           // decodeImage finished
+    bool uploaded;
+} ImageJob;
+
+void decodeImage(ImageJob *job) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_RWops *rw = asset_open(job->path);
+    if (rw && textureCache.enabled) {
+        job->hash = hashAsset(rw);
+        char file[256];
+        snprintf(file, sizeof(file), "%s/%016llx.tex", texturecachedir, (unsigned long long)job->hash);
+        job->pixels = texcache_read(file, job->hash, &job->header);
     }
-
-
-
-        // Load sprite sheets
-    SDL_Texture *ryu1 = characterTexture("rsrc/animation/ryubasic.bmp", renderer);
-    SDL_Texture *ken1 = characterTexture("rsrc/animation/kenbasic.bmp", renderer);
-    if (!ryu1 || !ken1) {
-        SDL_Log("Could not load sprite sheets.");
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-        return 1;
+    if (job->pixels) {
+        SDL_RWclose(rw);
+    } else if (rw) {
+        job->surface = surface_track(IMG_Load_RW(rw, 1));
     }
-        // Initialize sprites with unique properties
-    Sprite sprite1 = {
-        ryu1,
-        {1,1,1,1,1,1},  // Frame counts for walking, jumping, punching, kicking, special, stance (number of frames)
-        {60, 60, 60,60, 60,60},  // Heights for each animation
-        {1, 160, 50, 110, 208,265},  // Y offsets for each animation
-        {55,55,55,55,55,55},  //width for each frame
-        86,  // Sprite width
-        STANCE,
-        0,
-        0,
-        width / 2,
-        height / 2
-    };
-        Sprite sprite2 = {
-        ken1,
-        {1,1,1,1,1,1},  // Frame counts for walking, jumping, punching, kicking, special, stance (number of frames)
-        {65, 60, 65,65, 65,65},  // Heights for each animation
-        {1, 175, 60, 120, 240,300},  // Y offsets for each animation
-        {55,55,55,55,55,55},  //width for each frame
-        85,  // Sprite width
-        STANCE,
-        0,
-        0.1,
-        width / 2,
-        height / 2
-    };
-    Uint32 currentTime;
-
+    job->decodeTicks = SDL_GetPerformanceCounter() - start;
+}
 
+// Turn a decoded image into a texture (render thread only); NULL on failure
+SDL_Texture *uploadImage(SDL_Renderer *renderer, ImageJob *job) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_Texture *texture = NULL;
+    int previous = memory_tag(MEMORY_IMAGES);
+    if (job->pixels) {
+        texture = texcache_upload(renderer, &job->header, job->pixels);
+        cpu_register_pixels(texture, job->header.format, job->pixels, job->header.pitch, job->header.w, job->header.h);
+        SDL_free(job->pixels);
+        job->pixels = NULL;
+        textureCache.hits++;
+    } else if (job->surface) {
+        texture = SDL_CreateTextureFromSurface(renderer, job->surface);
+        cpu_register_surface(texture, job->surface);
+        if (texture && textureCache.enabled) {
+            char file[256];
+            snprintf(file, sizeof(file), "%s/%016llx.tex", texturecachedir, (unsigned long long)job->hash);
+            texcache_store(file, job->hash, job->surface, texture);
+            textureCache.misses++;
+        }
+        surface_free(job->surface);
+        job->surface = NULL;
+    }
+    textureCache.loadTicks += job->decodeTicks + SDL_GetPerformanceCounter() - start;
+    memory_tag(previous);
+    return texture_track(texture, MEMORY_IMAGES);
+}
 
+// Load an image asset as a texture right away, from the texture cache when it has one
+SDL_Texture *cachedTexture(SDL_Renderer *renderer, const char *path) {
+    ImageJob job = { .path = path };
+    int previous = memory_tag(MEMORY_IMAGES);
+    decodeImage(&job);
+    memory_tag(previous);
+    return uploadImage(renderer, &job);
+}
 
-    // **Audio Setup**
-    // Load background music (wav file)
-    Mix_Music *bgMusic = Mix_LoadMUS(music(&musiccount)); // Use your audio file path here
-    if (!bgMusic) {
-        errors("Mix_LoadMUS Error: Unable to load music.");
-    }
-    // Load sound effects
-    Mix_Chunk *sfxselect = Mix_LoadWAV(selection);
-    Mix_Chunk *sfxnavigate = Mix_LoadWAV(navigation);
-    Mix_Chunk *punch = Mix_LoadWAV(punching);
-    Mix_Chunk *kick = Mix_LoadWAV(kicking);
-    
-    // Play the background music in a loop (-1 means infinite loop)
-    if(voice){
-    Mix_PlayMusic(bgMusic, -1);  // Start the music immediately and loop indefinitely
-    }
-    // Main Game Loop
-    while (run) {
-        if(creditsvid){
-            // Loop through frames
-            for (int i = 1; i <= FRAME_COUNT && run && creditsvid; i++) {
-                // Generate the file path dynamically
-                snprintf(frame_path, sizeof(frame_path), "rsrc/animation/Credits/%d.jpg", i);
-
-                // Load the image
-                SDL_Surface *image = IMG_Load(frame_path);
-                if (!image) {
-                    printf("IMG_Load Error: %s\n", IMG_GetError());
-                    continue; // Skip to the next frame if there's an error
-                }
 
-                // Create a texture from the surface
-                SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, image);
-                SDL_FreeSurface(image); // Free the surface after creating the texture
-                if (!texture) {
-                    printf("SDL_CreateTextureFromSurface Error: %s\n", SDL_GetError());
-                    continue; // Skip to the next frame if there's an error
-                }
+// ---- Texture residency ----
+
+// The menu, page, arena, HUD and character images are streamed textures:
+// with --texture-budget MB their video memory is capped. Each scene names
+// the streamed textures it draws, plus prefetch hints for what the scenes it
+// leads to will draw. Over budget, the least recently used textures the top
+// scene does not draw are evicted, hinted ones last. An evicted texture's
+// Game field points at a small placeholder until a loader thread has decoded
+// it again (through the texture cache) and the main thread has uploaded it,
+// so no scene ever waits on a reload. Anything that keeps a streamed texture
+// around holds the address of its Game field, not the texture.
+//
+// Startup still uploads every image once; the budget holds from the first
+// frame on. Without a budget everything stays resident.
+enum {
+    STREAM_MENU,
+    STREAM_BUTTON,
+    STREAM_OPTION,
+    STREAM_HELP,
+    STREAM_CREDITS,
+    STREAM_ARENA,
+    STREAM_HEALTH,
+    STREAM_FIREBALL,
+    STREAM_WINNER1,
+    STREAM_WINNER2,
+    STREAM_RYU,
+    STREAM_KEN,
+    STREAM_TEXTURES
+};
+
+#define STREAM_BIT(id) (1u << (id))
+#define STREAM_MENUS (STREAM_BIT(STREAM_MENU) | STREAM_BIT(STREAM_BUTTON))
+#define STREAM_MATCH (STREAM_BIT(STREAM_ARENA) | STREAM_BIT(STREAM_HEALTH) | STREAM_BIT(STREAM_FIREBALL) | \
+                      STREAM_BIT(STREAM_RYU) | STREAM_BIT(STREAM_KEN))
+#define STREAM_WINNERS (STREAM_BIT(STREAM_WINNER1) | STREAM_BIT(STREAM_WINNER2))
+#define STREAM_PLACEHOLDER_COLOR 0xFF303038 // ARGB, drawn where an evicted texture would be
+
+enum { TEXTURE_RESIDENT, TEXTURE_EVICTED, TEXTURE_QUEUED, TEXTURE_DECODING, TEXTURE_DECODED };
 
-                // Render the texture (example rendering)
-                SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, texture, NULL, NULL);
-                SDL_RenderPresent(renderer);
+typedef struct {
+    const char *path;
+    SDL_Texture **slot;      // the Game field draws read
+    SDL_Texture *texture;    // NULL while evicted
+    Sint64 bytes;            // video memory when resident; 0 until startup uploaded it
+    Uint32 lastUsed;         // residency frame the top scene last drew it
+    SDL_atomic_t state;      // TEXTURE_*; the loader owns job from QUEUED to DECODED
+    ImageJob job;
+    Uint64 queuedAt;
+    bool failed;             // a reload failed, so it keeps the placeholder
+} StreamedTexture;
 
-                // Free the texture after rendering
-                SDL_DestroyTexture(texture);
-                // Add a delay for smooth animation (adjust as needed)
-                SDL_Delay(25); // ~30 FPS
+typedef struct {
+    StreamedTexture textures[STREAM_TEXTURES];
+    Sint64 budget;           // bytes, 0 for no limit
+    Sint64 resident, peak;   // bytes of streamed textures in video memory
+    Uint32 current;          // STREAM_BITs the top scene draws
+    Uint32 prefetch;         // and its hints
+    Uint32 frame;
+    SDL_Texture *placeholder;
+    SDL_sem *wake;
+    SDL_Thread *loader;
+    SDL_atomic_t quit;
+    Uint32 evictions, reloads;
+    Uint32 placeholderFrames; // frames the top scene drew a placeholder
+    Uint64 reloadTicks, worstReloadTicks; // queued to uploaded
+} Residency;
+
+Residency residency;
+
+// Decode whatever the main thread queued, one image at a time
+int residency_loader(void *data) {
+    (void)data;
+    Residency *r = &residency;
+    memory_tag(MEMORY_IMAGES);
+    for (;;) {
+        SDL_SemWait(r->wake);
+        if (SDL_AtomicGet(&r->quit)) {
+            return 0;
+        }
+        for (int i = 0; i < STREAM_TEXTURES; i++) {
+            StreamedTexture *t = &r->textures[i];
+            if (SDL_AtomicCAS(&t->state, TEXTURE_QUEUED, TEXTURE_DECODING)) {
+                decodeImage(&t->job);
+                SDL_AtomicSet(&t->state, TEXTURE_DECODED);
             }
         }
-        creditsvid=false;
+    }
+}
 
+// Set the budget up; with budgetMb <= 0 residency does nothing
+bool residency_open(SDL_Renderer *renderer, int budgetMb) {
+    Residency *r = &residency;
+    if (budgetMb <= 0) {
+        return true;
+    }
+    Uint32 color = STREAM_PLACEHOLDER_COLOR;
+    r->placeholder = texture_track(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, 1, 1),
+                                   MEMORY_IMAGES);
+    if (!r->placeholder) {
+        SDL_Log("Unable to create the texture placeholder: %s", SDL_GetError());
+        return false;
+    }
+    SDL_UpdateTexture(r->placeholder, NULL, &color, sizeof(color));
+    cpu_register_pixels(r->placeholder, SDL_PIXELFORMAT_ARGB8888, &color, sizeof(color), 1, 1);
+    r->wake = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&r->quit, 0);
+    r->loader = r->wake ? SDL_CreateThread(residency_loader, "stream", NULL) : NULL;
+    if (!r->loader) {
+        SDL_Log("Unable to start the texture loader: %s", SDL_GetError());
+        return false;
+    }
+    r->budget = (Sint64)budgetMb << 20;
+    return true;
+}
 
+// Register a streamed texture's source and Game field
+void residency_add(int id, const char *path, SDL_Texture **slot) {
+    StreamedTexture *t = &residency.textures[id];
+    t->path = path;
+    t->slot = slot;
+}
 
-        if(play){
-            SDL_Event mech;
-            const Uint8 *keystate =SDL_GetKeyboardState(NULL);
-            while (SDL_PollEvent(&mech)) {
-                if (mech.type == SDL_QUIT) {
-                    run = 0;
-                } else if(mech.type == SDL_KEYDOWN) {
-                    if (keystate[SDL_SCANCODE_SPACE]) {
-                        menu=true;
-                        play=false;
-                        pause=false;
-                    }
-                } else if (mech.type == SDL_KEYUP) { 
-                    sprite1.currentAnimation = STANCE; 
-                    sprite2.currentAnimation = STANCE;
-                
-                }
-            // Handle jumping
-            if (keystate[SDL_SCANCODE_W] && player1.onGround) {
-                player1.velocityY = JUMP_FORCE;
-                player1.onGround = false;
-                sprite1.currentAnimation = JUMPING;
-            }
+// A texture was loaded into a registered Game field the normal way (startup)
+void residency_adopt(SDL_Texture **slot) {
+    Residency *r = &residency;
+    for (int i = 0; i < STREAM_TEXTURES; i++) {
+        StreamedTexture *t = &r->textures[i];
+        if (t->slot == slot && *slot) {
+            t->texture = *slot;
+            t->bytes = texture_bytes(t->texture);
+            t->lastUsed = r->frame;
+            SDL_AtomicSet(&t->state, TEXTURE_RESIDENT);
+            r->resident += t->bytes;
+            r->peak = SDL_max(r->peak, r->resident);
+        }
+    }
+}
 
-            if (keystate[SDL_SCANCODE_I] && player2.onGround) {
-                player2.velocityY = JUMP_FORCE;
-                player2.onGround = false;
-                sprite2.currentAnimation = JUMPING;
-            }
+// The top scene changed
+void residency_scene(Uint32 current, Uint32 prefetch) {
+    residency.current = current;
+    residency.prefetch = prefetch;
+}
+
+// Every registered texture in mask is resident
+bool residency_ready(Uint32 mask) {
+    for (int i = 0; i < STREAM_TEXTURES; i++) {
+        StreamedTexture *t = &residency.textures[i];
+        if ((mask & STREAM_BIT(i)) && t->bytes && SDL_AtomicGet(&t->state) != TEXTURE_RESIDENT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void residency_evict(StreamedTexture *t) {
+    Residency *r = &residency;
+    cpu_forget(t->texture);
+    texture_destroy(t->texture);
+    t->texture = NULL;
+    *t->slot = r->placeholder;
+    SDL_AtomicSet(&t->state, TEXTURE_EVICTED);
+    r->resident -= t->bytes;
+    r->evictions++;
+}
 
-            // Handle attack inputs for Player 1
-            if (keystate[SDL_SCANCODE_E] && player1.attackTimer == 0) {
-                player1.isPunching = true;
-                player1.attackTimer = ATTACK_DURATION;
-                sprite1.currentAnimation = PUNCHNG;
+// Evict until extra more bytes fit, least recently used first, never a
+// texture in keep and hinted ones last. False if that is not enough.
+bool residency_trim(Sint64 extra, Uint32 keep) {
+    Residency *r = &residency;
+    while (r->resident + extra > r->budget) {
+        StreamedTexture *victim = NULL;
+        bool victimHinted = true;
+        for (int i = 0; i < STREAM_TEXTURES; i++) {
+            StreamedTexture *t = &r->textures[i];
+            if ((keep & STREAM_BIT(i)) || !t->texture) {
+                continue;
+            }
+            bool hinted = r->prefetch & STREAM_BIT(i);
+            if (!victim || (victimHinted && !hinted) || (hinted == victimHinted && t->lastUsed < victim->lastUsed)) {
+                victim = t;
+                victimHinted = hinted;
             }
-            if (keystate[SDL_SCANCODE_Q] && player1.attackTimer == 0) {
-                player1.isKicking = true;
-                player1.attackTimer = ATTACK_DURATION;
-                sprite1.currentAnimation = KICKING;
+        }
+        if (!victim) {
+            return false;
+        }
+        residency_evict(victim);
+    }
+    return true;
+}
+
+// A hint is only worth loading if it fits next to what the top scene draws
+// and the other hints already in or on their way
+bool residency_room(const StreamedTexture *t) {
+    Residency *r = &residency;
+    Sint64 wanted = t->bytes;
+    for (int i = 0; i < STREAM_TEXTURES; i++) {
+        StreamedTexture *other = &r->textures[i];
+        bool inFlight = SDL_AtomicGet(&other->state) != TEXTURE_EVICTED;
+        if ((r->current & STREAM_BIT(i)) || ((r->prefetch & STREAM_BIT(i)) && inFlight)) {
+            wanted += other->bytes;
+        }
+    }
+    return wanted <= r->budget;
+}
+
+void residency_queue(StreamedTexture *t) {
+    memset(&t->job, 0, sizeof(t->job));
+    t->job.path = t->path;
+    t->queuedAt = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&t->state, TEXTURE_QUEUED);
+    SDL_SemPost(residency.wake);
+}
+
+// Upload a reloaded texture into its Game field, making room for it first
+void residency_upload(SDL_Renderer *renderer, StreamedTexture *t) {
+    Residency *r = &residency;
+    residency_trim(t->bytes, r->current | r->prefetch | STREAM_BIT(t - r->textures));
+    SDL_Texture *texture = uploadImage(renderer, &t->job);
+    if (!texture) {
+        SDL_Log("Unable to reload %s, keeping its placeholder", t->path);
+        t->failed = true;
+        SDL_AtomicSet(&t->state, TEXTURE_EVICTED);
+        return;
+    }
+    t->texture = *t->slot = texture;
+    t->bytes = texture_bytes(texture);
+    SDL_AtomicSet(&t->state, TEXTURE_RESIDENT);
+    r->resident += t->bytes;
+    r->peak = SDL_max(r->peak, r->resident);
+    r->reloads++;
+    Uint64 ticks = SDL_GetPerformanceCounter() - t->queuedAt;
+    r->reloadTicks += ticks;
+    r->worstReloadTicks = SDL_max(r->worstReloadTicks, ticks);
+}
+
+// Once per frame on the main thread: queue what the top scene and its hints
+// need, upload what the loader finished and evict down to the budget.
+// Returns true when a Game field changed, so static scenes and the HUD redraw.
+bool residency_frame(SDL_Renderer *renderer) {
+    Residency *r = &residency;
+    if (r->budget == 0) {
+        return false;
+    }
+    r->frame++;
+    Uint32 evictions = r->evictions, reloads = r->reloads;
+    bool placeholders = false;
+    for (int i = 0; i < STREAM_TEXTURES; i++) {
+        StreamedTexture *t = &r->textures[i];
+        bool current = r->current & STREAM_BIT(i);
+        if (!t->bytes) {
+            continue; // still coming from startup loading
+        }
+        if (current) {
+            t->lastUsed = r->frame;
+        }
+        int state = SDL_AtomicGet(&t->state);
+        if (state == TEXTURE_EVICTED && !t->failed && (current || ((r->prefetch & STREAM_BIT(i)) && residency_room(t)))) {
+            residency_queue(t);
+        } else if (state == TEXTURE_DECODED) {
+            residency_upload(renderer, t);
+        }
+        placeholders |= current && !t->texture;
+    }
+    // Hints go only when the top scene's own textures would not fit otherwise
+    if (!residency_trim(0, r->current | r->prefetch)) {
+        residency_trim(0, r->current);
+    }
+    r->placeholderFrames += placeholders;
+    return r->evictions != evictions || r->reloads != reloads;
+}
+
+// Stop the loader and hand every Game field back its texture, or NULL
+void residency_close(void) {
+    Residency *r = &residency;
+    if (r->budget == 0) {
+        return;
+    }
+    SDL_AtomicSet(&r->quit, 1);
+    SDL_SemPost(r->wake);
+    SDL_WaitThread(r->loader, NULL);
+    SDL_DestroySemaphore(r->wake);
+    for (int i = 0; i < STREAM_TEXTURES; i++) {
+        StreamedTexture *t = &r->textures[i];
+        if (SDL_AtomicGet(&t->state) == TEXTURE_DECODED) {
+            SDL_free(t->job.pixels);
+            surface_free(t->job.surface);
+        }
+        if (t->slot && !t->texture) {
+            *t->slot = NULL;
+        }
+    }
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    printf("Textures: %.1f MB streamed at exit, peak %.1f of %.1f MB budget; %u eviction(s), %u reload(s) "
+           "(%.1f ms mean, worst %.1f), placeholders on %u frame(s)\n", r->resident / 1048576.0,
+           r->peak / 1048576.0, r->budget / 1048576.0, r->evictions, r->reloads,
+           r->reloads ? r->reloadTicks * 1000.0 / frequency / r->reloads : 0.0, r->worstReloadTicks * 1000.0 / frequency,
+           r->placeholderFrames);
+    cpu_forget(r->placeholder);
+    texture_destroy(r->placeholder);
+    r->placeholder = NULL;
+}
+
+
+// ---- Startup image decoding ----
+
+#define MAX_IMAGE_JOBS 16
+#define MAX_DECODE_THREADS 4
+
+// Workers claim jobs in submission order, so the images the first screens
+// need go first. The render thread uploads each one as soon as it is decoded.
+typedef struct {
+    ImageJob jobs[MAX_IMAGE_JOBS];
+    int jobCount;
+    int uploadedCount;
+    SDL_atomic_t next;           // next job a worker claims
+    SDL_Thread *threads[MAX_DECODE_THREADS];
+    int threadCount;
+    Uint64 startTicks;
+} DecodePool;
+
+// Queue a startup image for the Game field texture, streamed as id once it is in
+void decode_add(DecodePool *pool, int id, const char *path, SDL_Texture **texture, const char *errorMessage) {
+    if (pool->jobCount == MAX_IMAGE_JOBS) {
+        errors("Decode Error: Too many startup images.");
+    }
+    residency_add(id, path, texture);
+    ImageJob *job = &pool->jobs[pool->jobCount++];
+    memset(job, 0, sizeof(*job));
+    job->path = path;
+    job->texture = texture;
+    job->errorMessage = errorMessage;
+}
+
+int decode_worker(void *data) {
+    DecodePool *pool = data;
+    int i;
+    memory_tag(MEMORY_IMAGES);
+    while ((i = SDL_AtomicAdd(&pool->next, 1)) < pool->jobCount) {
+        decodeImage(&pool->jobs[i]);
+        SDL_AtomicSet(&pool->jobs[i].done, 1);
+    }
+    return 0;
+}
+
+// Start decoding everything added so far, leaving one core for the render thread
+void decode_start(DecodePool *pool) {
+    pool->startTicks = SDL_GetPerformanceCounter();
+    SDL_AtomicSet(&pool->next, 0);
+    pool->threadCount = SDL_GetCPUCount() - 1;
+    if (pool->threadCount > MAX_DECODE_THREADS) {
+        pool->threadCount = MAX_DECODE_THREADS;
+    }
+    if (pool->threadCount > pool->jobCount) {
+        pool->threadCount = pool->jobCount;
+    }
+    for (int i = 0; i < pool->threadCount; i++) {
+        pool->threads[i] = SDL_CreateThread(decode_worker, "decode", pool);
+        if (!pool->threads[i]) {
+            pool->threadCount = i;
+            break;
+        }
+    }
+    if (pool->threadCount == 0) {
+        decode_worker(pool); // No threads to spare: decode everything here
+    }
+}
+
+// Upload whatever has finished decoding. Returns true once every image is in.
+bool decode_pump(DecodePool *pool, SDL_Renderer *renderer) {
+    if (pool->uploadedCount == pool->jobCount) {
+        return true;
+    }
+    for (int i = 0; i < pool->jobCount; i++) {
+        ImageJob *job = &pool->jobs[i];
+        if (job->uploaded || !SDL_AtomicGet(&job->done)) {
+            continue;
+        }
+        *job->texture = uploadImage(renderer, job);
+        if (!*job->texture) {
+            errors(job->errorMessage);
+        }
+        residency_adopt(job->texture);
+        job->uploaded = true;
+        pool->uploadedCount++;
+    }
+    if (pool->uploadedCount < pool->jobCount) {
+        return false;
+    }
+
+    for (int i = 0; i < pool->threadCount; i++) {
+        SDL_WaitThread(pool->threads[i], NULL);
+    }
+    pool->threadCount = 0;
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    const char *cacheState = !textureCache.enabled ? "off" :
+                             textureCache.misses == 0 ? "warm" :
+                             textureCache.hits == 0 ? "cold" : "partial";
+    printf("Images: %d in %.1f ms (%.1f ms of decode and upload work), texture cache %s (%d hits, %d misses)\n",
+           pool->jobCount, (SDL_GetPerformanceCounter() - pool->startTicks) * 1000.0 / frequency,
+           textureCache.loadTicks * 1000.0 / frequency, cacheState, textureCache.hits, textureCache.misses);
+    return true;
+}
+
+// Block until the first count images (in submission order) are uploaded
+void decode_wait(DecodePool *pool, SDL_Renderer *renderer, int count) {
+    if (count > pool->jobCount) {
+        count = pool->jobCount;
+    }
+    for (;;) {
+        decode_pump(pool, renderer);
+        int ready = 0;
+        while (ready < count && pool->jobs[ready].uploaded) {
+            ready++;
+        }
+        if (ready == count) {
+            return;
+        }
+        SDL_Delay(1);
+    }
+}
+
+
+// Function to handle movement with collision detection
+void handle_movement(Player *player, bool left, bool right, SDL_Rect *otherRect) {
+    SDL_Rect newPosition = player->rect; // Temporary position to test movement
+
+    if (right) {
+        newPosition.x += RECT_SPEED;
+    }
+    if (left) {
+        newPosition.x -= RECT_SPEED;
+    }
+
+    // Check boundaries
+    bool withinBounds = (newPosition.x >= 0) && (newPosition.x + RECT_WIDTH <= width);
+
+    // Check collision with the other player
+    bool colliding = SDL_HasIntersection(&newPosition, otherRect);
+
+    if (withinBounds && !colliding) {
+        player->rect = newPosition;
+    }
+}
+
+// Function to handle projectile movement and collision
+void update_projectile(Projectile *proj, Player *opponent) {
+    if (!proj->active) return;
+
+    proj->rect.x += proj->velocityX;
+
+    if (proj->rect.x < 0 || proj->rect.x > width) {
+        proj->active = false;
+        return;
+    }
+}
+
+
+
+
+
+// Function to handle jump mechanism
+void handle_jump(Player *player) {
+    if (!player->onGround) {
+        player->velocityY += GRAVITY; // Apply gravity
+    }
+    player->rect.y += player->velocityY;
+
+    // Limit the jump height
+    if (player->rect.y <= player->originalY - MAX_JUMP_HEIGHT) {
+        player->rect.y = player->originalY - MAX_JUMP_HEIGHT;
+        player->velocityY = 0;
+    }
+
+    // Reset to ground
+    if (player->rect.y >= player->originalY) {
+        player->rect.y = player->originalY;
+        player->velocityY = 0;
+        player->onGround = true;
+    }
+}
+
+// Function to load the compiled frame data table
+bool loadFrameData(const char *path, FrameData *data) {
+    SDL_RWops *file = asset_open(path);
+    if (!file) {
+        SDL_Log("Unable to open frame data %s: %s", path, SDL_GetError());
+        return false;
+    }
+    FrameDataHeader header;
+    bool ok = SDL_RWread(file, &header, sizeof(header), 1) == 1 &&
+              memcmp(header.magic, FRAMEDATA_MAGIC, sizeof(header.magic)) == 0 &&
+              header.version == FRAMEDATA_VERSION &&
+              header.moveCount <= FRAMEDATA_MAX_MOVES &&
+              header.boxCount % FRAMEDATA_LANES == 0;
+    if (ok) {
+        data->moveCount = header.moveCount;
+        data->boxCount = header.boxCount;
+        data->boxes = SDL_malloc(sizeof(Sint16) * FRAMEDATA_COLUMNS * header.boxCount);
+        ok = data->boxes &&
+             SDL_RWread(file, data->moves, sizeof(FrameDataMove), header.moveCount) == header.moveCount &&
+             SDL_RWread(file, data->boxes, sizeof(Sint16) * header.boxCount, FRAMEDATA_COLUMNS) == FRAMEDATA_COLUMNS;
+    }
+    SDL_RWclose(file);
+    // The sim indexes the tick tables and SIMD-loads whole lane groups from
+    // each span without checks, so every move has to stay inside both
+    for (int m = 0; ok && m < data->moveCount; m++) {
+        const FrameDataMove *move = &data->moves[m];
+        ok = move->startup + move->active + move->recovery <= FRAMEDATA_MAX_TICKS;
+        for (int t = 0; ok && t < FRAMEDATA_MAX_TICKS; t++) {
+            const FrameDataSpan spans[2] = { move->hit[t], move->hurt[t] };
+            for (int i = 0; ok && i < 2; i++) {
+                int groups = (spans[i].count + FRAMEDATA_LANES - 1) / FRAMEDATA_LANES;
+                ok = spans[i].first + groups * FRAMEDATA_LANES <= data->boxCount;
             }
-            // Handle attack inputs for Player 2
-            if (keystate[SDL_SCANCODE_O] && player2.attackTimer == 0) {
-                player2.isPunching = true;
-                player2.attackTimer = ATTACK_DURATION;
-                sprite2.currentAnimation = KICKING;
+        }
+        if (!ok) {
+            SDL_Log("Frame data move %d (%.12s) runs past its tables", m, move->name);
+        }
+    }
+    if (!ok) {
+        SDL_Log("Bad frame data file %s", path);
+        SDL_free(data->boxes);
+        data->boxes = NULL;
+        return false;
+    }
+    for (int c = 0; c < FRAMEDATA_COLUMNS; c++) {
+        data->columns[c] = data->boxes + c * data->boxCount;
+    }
+    return true;
+}
+
+int findMove(const FrameData *data, const char *name) {
+    for (int i = 0; i < data->moveCount; i++) {
+        if (strncmp(data->moves[i].name, name, sizeof(data->moves[i].name)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Tick within the player's current move
+int moveTick(const FrameData *data, const Player *player) {
+    const FrameDataMove *move = &data->moves[player->move];
+    int total = move->startup + move->active + move->recovery;
+    return player->attackTimer > 0 ? total - player->attackTimer : 0;
+}
+
+// World-space rect of box b for a fighter at (x, y)
+SDL_Rect boxRect(const FrameData *data, int b, int x, int y, bool facingRight) {
+    int x1 = data->columns[facingRight ? 0 : 2][b];
+    int x2 = data->columns[facingRight ? 1 : 3][b];
+    int y1 = data->columns[4][b], y2 = data->columns[5][b];
+    SDL_Rect rect = { x + x1, y + y1, x2 - x1, y2 - y1 };
+    return rect;
+}
+
+// Does a world-space rect overlap any hurtbox in the span of a fighter at (x, y)?
+bool hitsHurtboxes(const FrameData *data, const SDL_Rect *rect, FrameDataSpan hurt, int x, int y, bool facingRight) {
+    const Sint16 *x1 = data->columns[facingRight ? 0 : 2] + hurt.first;
+    const Sint16 *x2 = data->columns[facingRight ? 1 : 3] + hurt.first;
+    const Sint16 *y1 = data->columns[4] + hurt.first;
+    const Sint16 *y2 = data->columns[5] + hurt.first;
+    int left = rect->x - x, right = rect->x + rect->w - x;
+    int top = rect->y - y, bottom = rect->y + rect->h - y;
+#ifdef __SSE2__
+    // Test FRAMEDATA_LANES hurtboxes per compare; the table is padded so loads stay in bounds
+    __m128i vLeft = _mm_set1_epi16(left), vRight = _mm_set1_epi16(right);
+    __m128i vTop = _mm_set1_epi16(top), vBottom = _mm_set1_epi16(bottom);
+    __m128i lane = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    for (int i = 0; i < hurt.count; i += FRAMEDATA_LANES) {
+        __m128i overlap = _mm_and_si128(
+            _mm_and_si128(_mm_cmplt_epi16(vLeft, _mm_loadu_si128((const __m128i *)(x2 + i))),
+                          _mm_cmplt_epi16(_mm_loadu_si128((const __m128i *)(x1 + i)), vRight)),
+            _mm_and_si128(_mm_cmplt_epi16(vTop, _mm_loadu_si128((const __m128i *)(y2 + i))),
+                          _mm_cmplt_epi16(_mm_loadu_si128((const __m128i *)(y1 + i)), vBottom)));
+        __m128i valid = _mm_cmplt_epi16(lane, _mm_set1_epi16(hurt.count - i));
+        if (_mm_movemask_epi8(_mm_and_si128(overlap, valid))) {
+            return true;
+        }
+    }
+#else
+    for (int i = 0; i < hurt.count; i++) {
+        if (left < x2[i] && x1[i] < right && top < y2[i] && y1[i] < bottom) {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+// Land the attacker's active hitboxes on the defender's hurtboxes, once per move.
+// Returns the damage dealt.
+int resolveAttack(const FrameData *data, Player *attacker, const Player *defender) {
+    if (attacker->hitLanded || attacker->attackTimer == 0) {
+        return 0;
+    }
+    const FrameDataMove *move = &data->moves[attacker->move];
+    FrameDataSpan hit = move->hit[moveTick(data, attacker)];
+    if (hit.count == 0) {
+        return 0; // Startup or recovery
+    }
+
+    bool attackerRight = attacker->rect.x < defender->rect.x;
+    FrameDataSpan hurt = data->moves[defender->move].hurt[moveTick(data, defender)];
+    for (int i = 0; i < hit.count; i++) {
+        SDL_Rect box = boxRect(data, hit.first + i, attacker->rect.x, attacker->rect.y, attackerRight);
+        if (hitsHurtboxes(data, &box, hurt, defender->rect.x, defender->rect.y, !attackerRight)) {
+            attacker->hitLanded = true;
+            return move->damage;
+        }
+    }
+    return 0;
+}
+
+// Start a frame data move
+void startMove(const FrameData *data, Player *player, int move) {
+    const FrameDataMove *moveData = &data->moves[move];
+    player->move = move;
+    player->attackTimer = moveData->startup + moveData->active + moveData->recovery;
+    player->hitLanded = false;
+}
+
+// Function to load a texture from a file
+SDL_Texture *characterTexture(const char *path, SDL_Renderer *renderer) {
+    int previous = memory_tag(MEMORY_IMAGES);
+    SDL_Surface *surface = surface_track(SDL_LoadBMP_RW(asset_open(path), 1));
+    if (!surface) {
+        SDL_Log("Unable to load image %s! SDL_Error: %s", path, SDL_GetError());
+        memory_tag(previous);
+        return NULL;
+    }
+
+    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
+    cpu_register_surface(texture, surface);
+    surface_free(surface);
+    memory_tag(previous);
+
+    return texture_track(texture, MEMORY_IMAGES);
+}
+
+// Function to load animation clips from a descriptor file
+// Returns false (after logging) if the file is missing or malformed.
+bool loadAnimations(const char *path, AnimSet *set) {
+    static const char *clipNames[ANIMATION_COUNT] = { "walking", "jumping", "punching", "kicking", "stance", "special" };
+    SDL_RWops *file = asset_open(path);
+    if (!file) {
+        SDL_Log("Unable to open animation file %s: %s", path, SDL_GetError());
+        return false;
+    }
+
+    memset(set, 0, sizeof(*set));
+    char line[256];
+    int lineNumber = 0, scale = 1, clip = -1;
+    bool ok = true;
+    while (ok && readLine(file, line, sizeof(line))) {
+        lineNumber++;
+        char keyword[16] = "";
+        if (sscanf(line, "%15s", keyword) != 1 || keyword[0] == '#') {
+            continue;
+        }
+
+        if (strcmp(keyword, "sheet") == 0) {
+            ok = sscanf(line, "%*s %255s", set->sheet) == 1;
+        } else if (strcmp(keyword, "scale") == 0) {
+            ok = sscanf(line, "%*s %d", &scale) == 1 && scale > 0;
+        } else if (strcmp(keyword, "clip") == 0) {
+            char name[16];
+            int loop = 1;
+            ok = sscanf(line, "%*s %15s %d", name, &loop) >= 1;
+            clip = -1;
+            for (int i = 0; ok && i < ANIMATION_COUNT; i++) {
+                if (strcmp(name, clipNames[i]) == 0) {
+                    clip = i;
+                }
             }
-            if (keystate[SDL_SCANCODE_U] && player2.attackTimer == 0) {
-                player2.isKicking = true;
-                player2.attackTimer = ATTACK_DURATION;
-                sprite2.currentAnimation = PUNCHNG;
+            ok = ok && clip >= 0;
+            if (ok) {
+                set->clips[clip].first = set->frameCount;
+                set->clips[clip].count = 0;
+                set->clips[clip].loop = loop != 0;
             }
-            if(keystate[SDL_SCANCODE_J] || keystate[SDL_SCANCODE_L]){
-                sprite2.currentAnimation = WALKING;
+        } else if (strcmp(keyword, "frame") == 0) {
+            int x, y, w, h, duration, originX, originY, flipOffsetX, consumed = 0;
+            ok = clip >= 0 && set->frameCount < MAX_ANIM_FRAMES &&
+                 sscanf(line, "%*s %d %d %d %d %d %d %d %d%n", &x, &y, &w, &h, &duration,
+                        &originX, &originY, &flipOffsetX, &consumed) == 8 && duration > 0;
+            if (ok) {
+                AnimFrame *frame = &set->frames[set->frameCount++];
+                frame->src = (SDL_Rect){x, y, w, h};
+                frame->dst = (SDL_Rect){-originX, -originY, w * scale, h * scale};
+                frame->dstFlipped = frame->dst;
+                frame->dstFlipped.x += flipOffsetX;
+                frame->duration = duration;
+
+                // Remaining words are frame events
+                char event[32];
+                int used;
+                for (char *rest = line + consumed; sscanf(rest, "%31s%n", event, &used) == 1; rest += used) {
+                    if (strcmp(event, "hit") == 0) {
+                        frame->events |= ANIM_EVENT_HIT;
+                    } else if (strcmp(event, "sound:punch") == 0) {
+                        frame->events |= ANIM_EVENT_SOUND_PUNCH;
+                    } else if (strcmp(event, "sound:kick") == 0) {
+                        frame->events |= ANIM_EVENT_SOUND_KICK;
+                    } else {
+                        ok = false;
+                    }
+                }
+                set->clips[clip].count++;
             }
-            if(keystate[SDL_SCANCODE_A] || keystate[SDL_SCANCODE_D]){
-                sprite1.currentAnimation = WALKING;
+        } else {
+            ok = false;
+        }
+    }
+    SDL_RWclose(file);
+
+    for (int i = 0; ok && i < ANIMATION_COUNT; i++) {
+        ok = set->clips[i].count > 0;
+    }
+    if (!ok) {
+        SDL_Log("Bad animation file %s near line %d", path, lineNumber);
+    }
+    return ok && set->sheet[0] != '\0';
+}
+
+// Start a sprite on the first frame of its requested animation
+void resetSprite(Sprite *sprite) {
+    sprite->playingAnimation = sprite->currentAnimation;
+    sprite->currentFrame = sprite->anims->clips[sprite->currentAnimation].first;
+    sprite->frameTime = 0;
+}
+
+// Function to update a sprite's animation by elapsed milliseconds
+// Returns the events of any frame entered during this step.
+Uint16 updateSprite(Sprite *sprite, int elapsed) {
+    const AnimSet *anims = sprite->anims;
+    if (sprite->currentAnimation != sprite->playingAnimation) {
+        resetSprite(sprite);
+        return anims->frames[sprite->currentFrame].events;
+    }
+
+    const AnimClip *clip = &anims->clips[sprite->playingAnimation];
+    Uint16 events = 0;
+    sprite->frameTime += elapsed;
+    while (sprite->frameTime >= anims->frames[sprite->currentFrame].duration) {
+        sprite->frameTime -= anims->frames[sprite->currentFrame].duration;
+        int index = sprite->currentFrame - clip->first + 1;
+        if (index == clip->count) {
+            if (!clip->loop) {
+                sprite->frameTime = 0;
+                break;
             }
-            // Handle special moves
-            if (keystate[SDL_SCANCODE_S] && !player1Projectile.active) {
-                player1Projectile.rect.x = player1.rect.x + (player1.rect.w / 2);
-                player1Projectile.rect.y = player1.rect.y + (player1.rect.h / 2);
-                player1Projectile.velocityX = (player1.rect.x < player2.rect.x) ? PROJECTILE_SPEED : -PROJECTILE_SPEED;
-                player1Projectile.active = true;
-                sprite1.currentAnimation = SPECIAL;
+            index = 0;
+        }
+        sprite->currentFrame = clip->first + index;
+        events |= anims->frames[sprite->currentFrame].events;
+    }
+    return events;
+}
+
+// Render white text into a new texture; rect receives its size plus the padding.
+// With keepCpuCopy the CPU renderer also gets the pixels, for textures it draws.
+SDL_Texture *textTexture(SDL_Renderer *renderer, TTF_Font *font, const char *text, SDL_Rect *rect, int padW, int padH, bool keepCpuCopy) {
+    SDL_Color textWhite = {255, 255, 255};
+    int previous = memory_tag(MEMORY_TEXT);
+    SDL_Surface *surface = surface_track(TTF_RenderText_Solid(font, text, textWhite));
+    if (!surface) {
+        memory_tag(previous);
+        return NULL;
+    }
+    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
+    rect->w = surface->w + padW;
+    rect->h = surface->h + padH;
+    if (keepCpuCopy) {
+        cpu_register_surface(texture, surface);
+    }
+    surface_free(surface);
+    memory_tag(previous);
+    return texture_track(texture, MEMORY_TEXT);
+}
+
+// Render a line of text; padW/padH stretch the glyph surface like the old inline code did
+void renderText(SDL_Renderer *renderer, TTF_Font *font, const char *text, int x, int y, int padW, int padH) {
+    SDL_Rect rect = {x, y, 0, 0};
+    SDL_Texture *texture = textTexture(renderer, font, text, &rect, padW, padH, false);
+    if (!texture) {
+        return;
+    }
+    SDL_RenderCopy(renderer, texture, NULL, &rect);
+    texture_destroy(texture);
+}
+
+// Render a menu button, greyed out unless it is the selected one
+void renderButton(SDL_Renderer *renderer, SDL_Texture *buttonTexture, SDL_Rect *rect, bool selected) {
+    SDL_SetRenderDrawColor(renderer, 128, 128, 128, selected ? 0 : 100);
+    SDL_RenderCopy(renderer, buttonTexture, NULL, rect);
+    SDL_RenderFillRect(renderer, rect);
+}
+
+
+// ---- Draw commands ----
+
+// Match draw layers, back to front. Order inside a layer is not significant,
+// which leaves the submitter free to group draws by texture.
+enum {
+    LAYER_ARENA,
+    LAYER_DEBUG_BODIES,   // player rects (debug)
+    LAYER_FIGHTERS,
+    LAYER_DEBUG_HITBOXES, // active attack boxes (debug)
+    LAYER_PROJECTILES,
+    LAYER_PARTICLES,      // sparks, dust and trails, one geometry draw
+    LAYER_HUD,            // health fill, the only HUD part that changes
+    LAYER_HUD_FRAME,      // prerendered HUD, or its pieces when drawn directly
+    LAYER_HUD_TEXT,
+    LAYER_OVERLAY,
+    LAYER_COUNT
+};
+
+#define DRAW_COMMANDS_RESERVE 128 // first block taken from the frame arena; doubled as needed
+
+// Textured triangles for one SDL_RenderGeometry call. Every four vertices
+// are an axis-aligned quad (top left, top right, bottom right, bottom left),
+// which is all the CPU renderer draws of them.
+typedef struct {
+    const SDL_Vertex *vertices;
+    const int *indices;
+    int vertexCount;
+    int indexCount;
+} DrawGeometry;
+
+// One recorded draw: a texture copy, a filled rect when texture is NULL, or geometry
+typedef struct DrawCommand {
+    Uint8 layer;
+    Uint8 flip;           // SDL_RendererFlip
+    Uint16 sequence;      // recording order, keeps the sort stable
+    SDL_Texture *texture;
+    SDL_Rect src;         // w == 0 copies the whole texture
+    SDL_Rect dst;
+    SDL_Color color;      // fill color
+    const DrawGeometry *geometry; // drawn instead of the copy; must outlive the submit
+} DrawCommand;
+
+// Draws for one frame. The commands live in the frame arena, so recording
+// never touches the heap and the list is gone with the frame.
+typedef struct {
+    DrawCommand *commands;
+    int count;
+    int capacity;
+    int dropped;
+    int submitted;        // commands in the last submit
+    int textureSwitches;  // texture changes in the last submit
+    Uint64 layerTicks[LAYER_COUNT]; // time spent issuing each layer in the last submit
+} DrawList;
+
+void draw_begin(DrawList *list) {
+    list->commands = NULL;
+    list->count = 0;
+    list->capacity = 0;
+}
+
+DrawCommand *draw_push(DrawList *list, int layer) {
+    if (list->count == list->capacity) {
+        // The old block stays behind in the arena until the frame ends
+        int capacity = list->capacity ? list->capacity * 2 : DRAW_COMMANDS_RESERVE;
+        DrawCommand *commands = arena_alloc(&frameArena, sizeof(DrawCommand) * capacity);
+        if (!commands) {
+            if (list->dropped++ == 0) {
+                SDL_Log("Out of memory for draw commands, dropping them");
             }
+            return NULL;
+        }
+        if (list->count > 0) {
+            memcpy(commands, list->commands, sizeof(DrawCommand) * list->count);
+        }
+        list->commands = commands;
+        list->capacity = capacity;
+    }
+    DrawCommand *command = &list->commands[list->count];
+    memset(command, 0, sizeof(*command));
+    command->layer = layer;
+    command->sequence = list->count++;
+    return command;
+}
+
+void draw_copy(DrawList *list, int layer, SDL_Texture *texture, const SDL_Rect *src, const SDL_Rect *dst, bool flipHorizontal) {
+    DrawCommand *command = draw_push(list, layer);
+    if (!command) {
+        return;
+    }
+    command->texture = texture;
+    if (src && texture != residency.placeholder) {
+        command->src = *src; // the placeholder stands in for all of an evicted texture
+    }
+    if (dst) {
+        command->dst = *dst;
+    }
+    command->flip = flipHorizontal ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
+}
+
+void draw_fill(DrawList *list, int layer, const SDL_Rect *dst, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    DrawCommand *command = draw_push(list, layer);
+    if (!command) {
+        return;
+    }
+    command->dst = *dst;
+    command->color = (SDL_Color){r, g, b, a};
+}
+
+void draw_geometry(DrawList *list, int layer, SDL_Texture *texture, const DrawGeometry *geometry) {
+    DrawCommand *command = draw_push(list, layer);
+    if (!command) {
+        return;
+    }
+    command->texture = texture;
+    command->geometry = geometry;
+}
+
+int compare_draws(const void *a, const void *b) {
+    const DrawCommand *x = a, *y = b;
+    if (x->layer != y->layer) {
+        return x->layer < y->layer ? -1 : 1;
+    }
+    if (x->texture != y->texture) {
+        return (uintptr_t)x->texture < (uintptr_t)y->texture ? -1 : 1;
+    }
+    return x->sequence < y->sequence ? -1 : 1;
+}
 
-            if (keystate[SDL_SCANCODE_K] && !player2Projectile.active) {
-                player2Projectile.rect.x = player2.rect.x + (player2.rect.w / 2);
-                player2Projectile.rect.y = player2.rect.y + (player2.rect.h / 2);
-                player2Projectile.velocityX = (player2.rect.x < player1.rect.x) ? PROJECTILE_SPEED : -PROJECTILE_SPEED;
-                player2Projectile.active = true;
-                sprite2.currentAnimation = SPECIAL;
+// Sort by layer, then texture, and issue the draws with as few state changes as possible
+void draw_submit(DrawList *list, SDL_Renderer *renderer) {
+    qsort(list->commands, list->count, sizeof(DrawCommand), compare_draws);
+
+    SDL_Texture *bound = NULL;
+    SDL_Color color = {0, 0, 0, 0};
+    bool colorSet = false;
+    list->textureSwitches = 0;
+    memset(list->layerTicks, 0, sizeof(list->layerTicks));
+    for (int i = 0; i < list->count; i++) {
+        const DrawCommand *command = &list->commands[i];
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (!command->texture) {
+            const SDL_Color *c = &command->color;
+            if (!colorSet || c->r != color.r || c->g != color.g || c->b != color.b || c->a != color.a) {
+                SDL_SetRenderDrawColor(renderer, c->r, c->g, c->b, c->a);
+                color = *c;
+                colorSet = true;
             }
+            SDL_RenderFillRect(renderer, &command->dst);
+            list->layerTicks[command->layer] += SDL_GetPerformanceCounter() - start;
+            continue;
+        }
+        if (command->texture != bound) {
+            bound = command->texture;
+            list->textureSwitches++;
+        }
+        if (command->geometry) {
+            const DrawGeometry *g = command->geometry;
+            SDL_RenderGeometry(renderer, command->texture, g->vertices, g->vertexCount, g->indices, g->indexCount);
+            list->layerTicks[command->layer] += SDL_GetPerformanceCounter() - start;
+            continue;
+        }
+        const SDL_Rect *src = command->src.w ? &command->src : NULL;
+        const SDL_Rect *dst = command->dst.w ? &command->dst : NULL;
+        if (command->flip) {
+            SDL_RenderCopyEx(renderer, command->texture, src, dst, 0, NULL, command->flip);
+        } else {
+            SDL_RenderCopy(renderer, command->texture, src, dst);
+        }
+        list->layerTicks[command->layer] += SDL_GetPerformanceCounter() - start;
+    }
+    list->submitted = list->count;
+    list->count = 0;
+}
+
+
+// Record the sprite's current animation frame
+void drawSprite(DrawList *list, int layer, const Sprite *sprite, bool flipHorizontal) {
+    const AnimFrame *frame = &sprite->anims->frames[sprite->currentFrame];
+    const SDL_Rect *offset = flipHorizontal ? &frame->dstFlipped : &frame->dst;
+    SDL_Rect dstRect = { sprite->x + offset->x, sprite->y + offset->y, offset->w, offset->h };
+    draw_copy(list, layer, *sprite->spriteSheet, &frame->src, &dstRect, flipHorizontal);
+}
+
+void drawProjectile(DrawList *list, int layer, SDL_Texture *texture, const Projectile *proj, bool flipHorizontal) {
+    if (proj->active) {
+        draw_copy(list, layer, texture, NULL, &proj->rect, flipHorizontal);
+    }
+}
+
+
+// ---- CPU renderer ----
+
+// A rasterizer for machines without a GPU, where SDL's software renderer
+// spends most of the frame in the scaled, flipped sprite blits and the
+// full-screen arena copy. It executes a sorted DrawList straight into a
+// locked streaming texture with SSE2/AVX2 row kernels (nearest-neighbour
+// scaling in 16.16 fixed point, flips as a negative step, "source over"
+// blending), one horizontal band per thread.
+
+#define FIXED_SHIFT 16
+#define FIXED_ONE (1 << FIXED_SHIFT)
+
+typedef void (*RowKernel)(Uint32 *dst, const Uint32 *src, int count, Sint32 fx, Sint32 step);
+
+RowKernel rowCopy;   // opaque source
+RowKernel rowBlend;  // source with alpha
+
+// "Source over" for one ARGB pixel, dividing by 255 exactly
+static inline Uint32 blend_pixel(Uint32 d, Uint32 s) {
+    Uint32 a = s >> 24;
+    if (a == 255) {
+        return s;
+    }
+    if (a == 0) {
+        return d;
+    }
+    Uint32 rb = (s & 0xFF00FF) * a + (d & 0xFF00FF) * (255 - a);
+    Uint32 g = ((s >> 8) & 0xFF) * a + ((d >> 8) & 0xFF) * (255 - a);
+    rb = ((rb + 0x10001 + ((rb >> 8) & 0xFF00FF)) >> 8) & 0xFF00FF;
+    g = (g + 1 + (g >> 8)) >> 8;
+    return 0xFF000000 | rb | (g << 8);
+}
+
+static void row_copy_scalar(Uint32 *dst, const Uint32 *src, int count, Sint32 fx, Sint32 step) {
+    if (step == FIXED_ONE) {
+        memcpy(dst, src + (fx >> FIXED_SHIFT), count * sizeof(Uint32));
+        return;
+    }
+    for (int i = 0; i < count; i++, fx += step) {
+        dst[i] = src[fx >> FIXED_SHIFT];
+    }
+}
+
+static void row_blend_scalar(Uint32 *dst, const Uint32 *src, int count, Sint32 fx, Sint32 step) {
+    for (int i = 0; i < count; i++, fx += step) {
+        dst[i] = blend_pixel(dst[i], src[fx >> FIXED_SHIFT]);
+    }
+}
+
+#ifdef __SSE2__
+// Blend four pixels: widen to 16-bit lanes, a * s + (255 - a) * d, divide by 255
+static inline __m128i blend4_sse2(__m128i d, __m128i s) {
+    const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1), full = _mm_set1_epi16(255);
+    __m128i sl = _mm_unpacklo_epi8(s, zero), sh = _mm_unpackhi_epi8(s, zero);
+    __m128i dl = _mm_unpacklo_epi8(d, zero), dh = _mm_unpackhi_epi8(d, zero);
+    __m128i al = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sl, 0xFF), 0xFF);
+    __m128i ah = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sh, 0xFF), 0xFF);
+    __m128i xl = _mm_add_epi16(_mm_mullo_epi16(sl, al), _mm_mullo_epi16(dl, _mm_sub_epi16(full, al)));
+    __m128i xh = _mm_add_epi16(_mm_mullo_epi16(sh, ah), _mm_mullo_epi16(dh, _mm_sub_epi16(full, ah)));
+    xl = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(xl, one), _mm_srli_epi16(xl, 8)), 8);
+    xh = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(xh, one), _mm_srli_epi16(xh, 8)), 8);
+    return _mm_or_si128(_mm_packus_epi16(xl, xh), _mm_set1_epi32((int)0xFF000000));
+}
+
+static inline __m128i gather4_sse2(const Uint32 *src, Sint32 fx, Sint32 step) {
+    return _mm_setr_epi32(src[fx >> FIXED_SHIFT], src[(fx + step) >> FIXED_SHIFT],
+                          src[(fx + 2 * step) >> FIXED_SHIFT], src[(fx + 3 * step) >> FIXED_SHIFT]);
+}
+
+static void row_copy_sse2(Uint32 *dst, const Uint32 *src, int count, Sint32 fx, Sint32 step) {
+    if (step == FIXED_ONE) {
+        memcpy(dst, src + (fx >> FIXED_SHIFT), count * sizeof(Uint32));
+        return;
+    }
+    int i = 0;
+    for (; i + 4 <= count; i += 4, fx += 4 * step) {
+        _mm_storeu_si128((__m128i *)(dst + i), gather4_sse2(src, fx, step));
+    }
+    row_copy_scalar(dst + i, src, count - i, fx, step);
+}
+
+static void row_blend_sse2(Uint32 *dst, const Uint32 *src, int count, Sint32 fx, Sint32 step) {
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000), zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 4 <= count; i += 4, fx += 4 * step) {
+        __m128i s = gather4_sse2(src, fx, step);
+        __m128i a = _mm_and_si128(s, alpha);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) == 0xFFFF) {
+            continue; // All transparent, common around sprite outlines
+        }
+        __m128i *p = (__m128i *)(dst + i);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(a, alpha)) == 0xFFFF) {
+            _mm_storeu_si128(p, s);
+        } else {
+            _mm_storeu_si128(p, blend4_sse2(_mm_loadu_si128(p), s));
+        }
+    }
+    row_blend_scalar(dst + i, src, count - i, fx, step);
+}
+#endif
+
+#ifdef CPU_RENDER_AVX2
+// The same kernels eight pixels wide, with hardware gathers for the scaled reads
+__attribute__((target("avx2")))
+static inline __m256i gather8_avx2(const Uint32 *src, Sint32 fx, Sint32 step) {
+    __m256i lanes = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(step));
+    __m256i index = _mm256_srai_epi32(_mm256_add_epi32(_mm256_set1_epi32(fx), lanes), FIXED_SHIFT);
+    return _mm256_i32gather_epi32((const int *)src, index, 4);
+}
+
+__attribute__((target("avx2")))
+static void row_copy_avx2(Uint32 *dst, const Uint32 *src, int count, Sint32 fx, Sint32 step) {
+    if (step == FIXED_ONE) {
+        memcpy(dst, src + (fx >> FIXED_SHIFT), count * sizeof(Uint32));
+        return;
+    }
+    int i = 0;
+    for (; i + 8 <= count; i += 8, fx += 8 * step) {
+        _mm256_storeu_si256((__m256i *)(dst + i), gather8_avx2(src, fx, step));
+    }
+    row_copy_scalar(dst + i, src, count - i, fx, step);
+}
+
+__attribute__((target("avx2")))
+static void row_blend_avx2(Uint32 *dst, const Uint32 *src, int count, Sint32 fx, Sint32 step) {
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000), zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1), full = _mm256_set1_epi16(255);
+    int i = 0;
+    for (; i + 8 <= count; i += 8, fx += 8 * step) {
+        __m256i s = gather8_avx2(src, fx, step);
+        __m256i a = _mm256_and_si256(s, alpha);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, zero)) == -1) {
+            continue;
+        }
+        __m256i *p = (__m256i *)(dst + i);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, alpha)) == -1) {
+            _mm256_storeu_si256(p, s);
+            continue;
+        }
+        __m256i d = _mm256_loadu_si256(p);
+        __m256i sl = _mm256_unpacklo_epi8(s, zero), sh = _mm256_unpackhi_epi8(s, zero);
+        __m256i dl = _mm256_unpacklo_epi8(d, zero), dh = _mm256_unpackhi_epi8(d, zero);
+        __m256i al = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sl, 0xFF), 0xFF);
+        __m256i ah = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sh, 0xFF), 0xFF);
+        __m256i xl = _mm256_add_epi16(_mm256_mullo_epi16(sl, al), _mm256_mullo_epi16(dl, _mm256_sub_epi16(full, al)));
+        __m256i xh = _mm256_add_epi16(_mm256_mullo_epi16(sh, ah), _mm256_mullo_epi16(dh, _mm256_sub_epi16(full, ah)));
+        xl = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(xl, one), _mm256_srli_epi16(xl, 8)), 8);
+        xh = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(xh, one), _mm256_srli_epi16(xh, 8)), 8);
+        _mm256_storeu_si256(p, _mm256_or_si256(_mm256_packus_epi16(xl, xh), alpha));
+    }
+    row_blend_scalar(dst + i, src, count - i, fx, step);
+}
+#endif
+
+// Geometry as flat blended squares, at half their alpha for about the coverage of a soft dot
+void cpu_draw_quads(const DrawGeometry *geometry, Uint32 *frame, int pitch, int y0, int y1) {
+    for (int i = 0; i + 4 <= geometry->vertexCount; i += 4) {
+        const SDL_Vertex *v = &geometry->vertices[i];
+        int ya = SDL_max((int)v[0].position.y, y0), yb = SDL_min((int)v[2].position.y, y1);
+        int x0 = SDL_max((int)v[0].position.x, 0), x1 = SDL_min((int)v[2].position.x, width);
+        const SDL_Color *c = &v[0].color;
+        if (ya >= yb || x0 >= x1 || c->a < 2) {
+            continue;
+        }
+        Uint32 color = ((Uint32)(c->a / 2) << 24) | (c->r << 16) | (c->g << 8) | c->b;
+        for (int y = ya; y < yb; y++) {
+            rowBlend(frame + y * pitch + x0, &color, x1 - x0, 0, 0);
+        }
+    }
+}
+
+// Draw one command into rows [y0, y1) of the frame
+void cpu_draw(const DrawCommand *command, Uint32 *frame, int pitch, int y0, int y1) {
+    if (command->geometry) {
+        cpu_draw_quads(command->geometry, frame, pitch, y0, y1);
+        return;
+    }
+    if (!command->texture) {
+        const SDL_Color *c = &command->color;
+        Uint32 color = ((Uint32)c->a << 24) | (c->r << 16) | (c->g << 8) | c->b;
+        int x0 = SDL_max(command->dst.x, 0), x1 = SDL_min(command->dst.x + command->dst.w, width);
+        int ya = SDL_max(command->dst.y, y0), yb = SDL_min(command->dst.y + command->dst.h, y1);
+        if (c->a == 0 || x0 >= x1) {
+            return; // Alpha 0 draws nothing under the BLEND draw mode
+        }
+        for (int y = ya; y < yb; y++) {
+            // A zero step repeats the one-pixel "source" across the row
+            (c->a == 255 ? rowCopy : rowBlend)(frame + y * pitch + x0, &color, x1 - x0, 0, 0);
+        }
+        return;
+    }
+
+    const CpuImage *image = cpu_image(command->texture);
+    if (!image) {
+        return;
+    }
+    SDL_Rect src = command->src.w ? command->src : (SDL_Rect){0, 0, image->w, image->h};
+    SDL_Rect dst = command->dst.w ? command->dst : (SDL_Rect){0, 0, width, height};
+    if (src.x < 0 || src.y < 0 || src.w <= 0 || src.h <= 0 || src.x + src.w > image->w ||
+        src.y + src.h > image->h || dst.w <= 0 || dst.h <= 0) {
+        return;
+    }
+    int x0 = SDL_max(dst.x, 0), x1 = SDL_min(dst.x + dst.w, width);
+    int ya = SDL_max(dst.y, y0), yb = SDL_min(dst.y + dst.h, y1);
+    if (x0 >= x1 || ya >= yb) {
+        return;
+    }
+
+    Sint32 stepX = (Sint32)(((Sint64)src.w << FIXED_SHIFT) / dst.w);
+    Sint32 stepY = (Sint32)(((Sint64)src.h << FIXED_SHIFT) / dst.h);
+    Sint32 skipped = (x0 - dst.x) * stepX;
+    bool flip = command->flip & SDL_FLIP_HORIZONTAL;
+    // Mirrored sampling: column i reads src.w - 1 - floor(i * stepX)
+    Sint32 fx = flip ? ((src.w - 1) << FIXED_SHIFT) + (FIXED_ONE - 1) - skipped : skipped;
+    Sint32 step = flip ? -stepX : stepX;
+
+    int lastRow = -1;
+    for (int y = ya; y < yb; y++) {
+        int sy = (int)(((Sint64)(y - dst.y) * stepY) >> FIXED_SHIFT);
+        const Uint32 *row = image->pixels + (src.y + sy) * image->w + src.x;
+        Uint32 *out = frame + y * pitch + x0;
+        if (image->blend) {
+            rowBlend(out, row, x1 - x0, fx, step);
+        } else if (sy == lastRow) {
+            memcpy(out, out - pitch, (x1 - x0) * sizeof(Uint32)); // Upscaled: same source row as above
+        } else {
+            rowCopy(out, row, x1 - x0, fx, step);
+        }
+        lastRow = sy;
+    }
+}
+
+void cpu_draw_band(int band) {
+    CpuRenderer *cpu = &cpuRenderer;
+    int y0 = height * band / cpu->bandCount, y1 = height * (band + 1) / cpu->bandCount;
+    if (cpu->clear) {
+        for (int y = y0; y < y1; y++) {
+            memset(cpu->pixels + y * cpu->pitch, 0, width * sizeof(Uint32));
+        }
+    }
+    for (int i = 0; i < cpu->commandCount; i++) {
+        cpu_draw(&cpu->commands[i], cpu->pixels, cpu->pitch, y0, y1);
+    }
+}
+
+int cpu_band_worker(void *data) {
+    int band = (int)(intptr_t)data;
+    for (;;) {
+        SDL_SemWait(cpuRenderer.start[band]);
+        if (SDL_AtomicGet(&cpuRenderer.quit)) {
+            return 0;
+        }
+        cpu_draw_band(band);
+        SDL_SemPost(cpuRenderer.done);
+    }
+}
+
+// Pick the kernels and start the band threads. bands <= 0 picks one per core, up to MAX_CPU_BANDS.
+bool cpu_init(SDL_Renderer *renderer, int bands) {
+    CpuRenderer *cpu = &cpuRenderer;
+    cpu->frame = texture_track(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                                 width, height), MEMORY_RENDER);
+    if (!cpu->frame) {
+        SDL_Log("Unable to create the CPU renderer frame: %s", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(cpu->frame, SDL_BLENDMODE_NONE);
+
+    const char *kernels = "scalar";
+    rowCopy = row_copy_scalar;
+    rowBlend = row_blend_scalar;
+#ifdef __SSE2__
+    rowCopy = row_copy_sse2;
+    rowBlend = row_blend_sse2;
+    kernels = "SSE2";
+#endif
+#ifdef CPU_RENDER_AVX2
+    if (SDL_HasAVX2()) {
+        rowCopy = row_copy_avx2;
+        rowBlend = row_blend_avx2;
+        kernels = "AVX2";
+    }
+#endif
+
+    cpu->bandCount = bands > 0 ? bands : SDL_GetCPUCount();
+    cpu->bandCount = SDL_max(1, SDL_min(cpu->bandCount, MAX_CPU_BANDS));
+    cpu->done = SDL_CreateSemaphore(0);
+    SDL_AtomicSet(&cpu->quit, 0);
+    for (int band = 1; band < cpu->bandCount; band++) {
+        cpu->start[band] = SDL_CreateSemaphore(0);
+        cpu->threads[band] = SDL_CreateThread(cpu_band_worker, "raster", (void *)(intptr_t)band);
+        if (!cpu->threads[band]) {
+            SDL_DestroySemaphore(cpu->start[band]);
+            cpu->bandCount = band;
+            break;
+        }
+    }
+    snprintf(cpu->description, sizeof(cpu->description), "CPU %s kernels, %d band%s",
+             kernels, cpu->bandCount, cpu->bandCount == 1 ? "" : "s");
+    return true;
+}
+
+void cpu_shutdown(void) {
+    CpuRenderer *cpu = &cpuRenderer;
+    SDL_AtomicSet(&cpu->quit, 1);
+    for (int band = 1; band < cpu->bandCount; band++) {
+        SDL_SemPost(cpu->start[band]);
+        SDL_WaitThread(cpu->threads[band], NULL);
+        SDL_DestroySemaphore(cpu->start[band]);
+    }
+    SDL_DestroySemaphore(cpu->done);
+    texture_destroy(cpu->frame);
+    while (cpu->imageCount > 0) {
+        cpu_forget(cpu->images[0].texture);
+    }
+}
+
+// Rasterize the sorted list into the frame texture and copy it to the screen
+void cpu_submit(DrawList *list, SDL_Renderer *renderer) {
+    CpuRenderer *cpu = &cpuRenderer;
+    qsort(list->commands, list->count, sizeof(DrawCommand), compare_draws);
+
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(cpu->frame, NULL, &pixels, &pitch) == 0) {
+        cpu->pixels = pixels;
+        cpu->pitch = pitch / sizeof(Uint32);
+        cpu->commands = list->commands;
+        cpu->commandCount = list->count;
+
+        // Skip the clear when the first draw is an opaque full-screen copy (the arena)
+        const DrawCommand *first = list->count > 0 ? &list->commands[0] : NULL;
+        const CpuImage *background = first && first->texture ? cpu_image(first->texture) : NULL;
+        bool covers = first && (first->dst.w == 0 || (first->dst.x <= 0 && first->dst.y <= 0 &&
+                                first->dst.x + first->dst.w >= width && first->dst.y + first->dst.h >= height));
+        cpu->clear = !(covers && background && !background->blend);
+
+        for (int band = 1; band < cpu->bandCount; band++) {
+            SDL_SemPost(cpu->start[band]);
+        }
+        cpu_draw_band(0);
+        for (int band = 1; band < cpu->bandCount; band++) {
+            SDL_SemWait(cpu->done);
+        }
+        SDL_UnlockTexture(cpu->frame);
+        SDL_RenderCopy(renderer, cpu->frame, NULL, NULL);
+    }
+    list->submitted = list->count;
+    list->textureSwitches = 0;
+    memset(list->layerTicks, 0, sizeof(list->layerTicks));
+    list->count = 0;
+}
+
+
+// ---- Frame pacing ----
+
+#define DEFAULT_FPS 60
+#define SPIN_MARGIN_MS 2 // finish the last stretch of a frame spinning instead of sleeping
+
+// Interval statistics (Welford's running mean/variance, in ms)
+typedef struct {
+    Uint64 count;
+    double meanMs;
+    double m2;
+    double worstMs;
+    Uint32 missed;       // intervals that overran their deadline by a full period
+} IntervalStats;
+
+void stats_add(IntervalStats *stats, double ms, bool missed) {
+    double delta = ms - stats->meanMs;
+    stats->count++;
+    stats->meanMs += delta / stats->count;
+    stats->m2 += delta * (ms - stats->meanMs);
+    if (ms > stats->worstMs) {
+        stats->worstMs = ms;
+    }
+    if (missed) {
+        stats->missed++;
+    }
+}
+
+double stats_stddev(const IntervalStats *stats) {
+    return stats->count > 1 ? sqrt(stats->m2 / (stats->count - 1)) : 0.0;
+}
+
+// Sleep until the performance counter reaches deadline, spinning out the last SPIN_MARGIN_MS
+void sleep_until(Uint64 deadline, Uint64 frequency) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 margin = frequency * SPIN_MARGIN_MS / 1000;
+    if (deadline > now + margin) {
+        SDL_Delay((Uint32)((deadline - now - margin) * 1000 / frequency));
+    }
+    while (SDL_GetPerformanceCounter() < deadline) {
+        // spin out the remaining sub-millisecond part
+    }
+}
+
+// Paces presents either through VSync or a sleep/spin limiter on the
+// performance counter, and keeps frame interval statistics for the overlay.
+typedef struct {
+    bool vsync;
+    int targetFps;
+    Uint64 frequency;
+    Uint64 period;       // counter ticks per frame at targetFps
+    Uint64 deadline;     // when the next limiter frame is due
+    Uint64 lastPresent;  // 0 after an idle gap so the gap is not counted as a frame
+    double lastMs;       // latest interval, 0 when there was none
+    IntervalStats frames;
+} FramePacer;
+
+void pacer_init(FramePacer *pacer, int targetFps, bool vsync) {
+    memset(pacer, 0, sizeof(*pacer));
+    pacer->vsync = vsync;
+    pacer->targetFps = targetFps;
+    pacer->frequency = SDL_GetPerformanceFrequency();
+    pacer->period = pacer->frequency / targetFps;
+}
+
+// Block until the next frame is due. With VSync the present already blocks.
+void pacer_wait(FramePacer *pacer) {
+    if (pacer->vsync) {
+        return;
+    }
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (pacer->deadline == 0 || now > pacer->deadline + pacer->period) {
+        // First frame or we fell a whole frame behind: restart the schedule rather than bursting
+        pacer->deadline = now + pacer->period;
+        return;
+    }
+    sleep_until(pacer->deadline, pacer->frequency);
+    pacer->deadline += pacer->period;
+}
+
+// Record the interval since the previous present
+void pacer_frame(FramePacer *pacer) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (pacer->lastPresent != 0) {
+        double ms = (double)(now - pacer->lastPresent) * 1000.0 / pacer->frequency;
+        pacer->lastMs = ms;
+        stats_add(&pacer->frames, ms, now - pacer->lastPresent >= 2 * pacer->period);
+    }
+    pacer->lastPresent = now;
+}
+
+// Forget the last present, e.g. after sleeping on an idle menu
+void pacer_idle(FramePacer *pacer) {
+    pacer->lastPresent = 0;
+    pacer->deadline = 0;
+    pacer->lastMs = 0;
+}
+
+
+// ---- Dynamic resolution ----
+
+// Everything is laid out in the fixed width x height logical space. Frames
+// are drawn into an internal render target at a fraction of that size, then
+// stretched to the window through SDL_RenderSetLogicalSize, so the window can
+// be any size and the fill cost can follow the frame budget.
+#define MIN_RENDER_SCALE 0.5f
+#define RENDER_SCALE_STEP 0.05f
+#define SCALE_SETTLE_FRAMES 30 // frames between adjustments, so one slow frame does not move it
+#define SCALE_DOWN_LOAD 0.9    // lower the scale when rendering takes more of the budget than this
+#define SCALE_UP_LOAD 0.6      // and raise it again below this
+
+typedef struct {
+    SDL_Texture *target;   // width x height; frames use its top-left scale-sized part
+    float scale;           // internal resolution as a fraction of the logical one
+    bool dynamic;          // follow the frame time (off with --render-scale)
+    double loadMs;         // smoothed render time, clear to RenderFlush
+    double intervalMs;     // smoothed present interval
+    int settle;            // frames until the next adjustment
+    Uint32 changes;
+    Uint8 clear[4];        // draw color to restore after clearing the letterbox
+} Resolution;
+
+void resolution_init(Resolution *res, SDL_Renderer *renderer, float scale) {
+    SDL_RenderSetLogicalSize(renderer, width, height);
+    res->dynamic = scale <= 0;
+    res->scale = res->dynamic ? 1.0f : SDL_max(MIN_RENDER_SCALE, SDL_min(scale, 1.0f));
+    res->settle = SCALE_SETTLE_FRAMES;
+    if (!SDL_RenderTargetSupported(renderer)) {
+        SDL_Log("No render targets, drawing at the window resolution");
+        return;
+    }
+    res->target = texture_track(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+                                                  width, height), MEMORY_RENDER);
+    if (!res->target) {
+        SDL_Log("Unable to create the internal render target: %s", SDL_GetError());
+        return;
+    }
+    SDL_SetTextureBlendMode(res->target, SDL_BLENDMODE_NONE);
+    SDL_SetTextureScaleMode(res->target, SDL_ScaleModeLinear);
+}
+
+int resolution_w(const Resolution *res) {
+    return (int)(width * res->scale + 0.5f);
+}
+
+int resolution_h(const Resolution *res) {
+    return (int)(height * res->scale + 0.5f);
+}
+
+// Map the logical space onto the scaled part of the internal target. Needed
+// after every switch to it, since switching targets resets viewport and scale.
+void resolution_apply(const Resolution *res, SDL_Renderer *renderer) {
+    if (!res->target || SDL_GetRenderTarget(renderer) != res->target) {
+        return;
+    }
+    SDL_RenderSetScale(renderer, (float)resolution_w(res) / width, (float)resolution_h(res) / height);
+    SDL_Rect logical = {0, 0, width, height}; // in logical units, after the scale
+    SDL_RenderSetViewport(renderer, &logical);
+}
+
+// Start a frame in the internal target
+void resolution_begin(const Resolution *res, SDL_Renderer *renderer) {
+    if (res->target) {
+        SDL_SetRenderTarget(renderer, res->target);
+        resolution_apply(res, renderer);
+    }
+}
+
+// Stretch the frame over the window; overlays drawn after this stay sharp
+void resolution_end(Resolution *res, SDL_Renderer *renderer) {
+    if (!res->target) {
+        return;
+    }
+    SDL_SetRenderTarget(renderer, NULL);
+    SDL_GetRenderDrawColor(renderer, &res->clear[0], &res->clear[1], &res->clear[2], &res->clear[3]);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer); // letterbox bars
+    SDL_SetRenderDrawColor(renderer, res->clear[0], res->clear[1], res->clear[2], res->clear[3]);
+    SDL_Rect used = {0, 0, resolution_w(res), resolution_h(res)};
+    SDL_RenderCopy(renderer, res->target, &used, NULL);
+}
+
+// Feed one frame's timings to the controller. renderMs is the CPU side of the
+// frame; the present interval catches a GPU that cannot keep up, because the
+// present then blocks past the deadline.
+void resolution_update(Resolution *res, double renderMs, const FramePacer *pacer) {
+    double budgetMs = 1000.0 / pacer->targetFps;
+    if (pacer->vsync && pacer->frames.count > 0) {
+        budgetMs = SDL_min(budgetMs, pacer->frames.meanMs); // the display's rate, not the --fps default
+    }
+    res->loadMs = res->loadMs > 0 ? res->loadMs * 0.9 + renderMs * 0.1 : renderMs;
+    if (pacer->lastMs > 0) {
+        res->intervalMs = res->intervalMs > 0 ? res->intervalMs * 0.9 + pacer->lastMs * 0.1 : pacer->lastMs;
+    }
+    if (!res->target || !res->dynamic || --res->settle > 0) {
+        return;
+    }
+    res->settle = SCALE_SETTLE_FRAMES;
+
+    float scale = res->scale;
+    if (res->loadMs > budgetMs * SCALE_DOWN_LOAD || res->intervalMs > budgetMs * 1.1) {
+        scale = SDL_max(MIN_RENDER_SCALE, scale - RENDER_SCALE_STEP);
+    } else if (res->loadMs < budgetMs * SCALE_UP_LOAD && res->intervalMs < budgetMs * 1.05) {
+        scale = SDL_min(1.0f, scale + RENDER_SCALE_STEP);
+    }
+    if (scale != res->scale) {
+        res->scale = scale;
+        res->changes++;
+    }
+}
+
+
+// ---- Audio ----
+
+// SDL_mixer plays the music. Sound effects go either through its channels
+// or, with --audio-mixer custom, through our own voices, mixed with SIMD in
+// the post-mix callback. That path preconverts every chunk at load, so the
+// audio thread only adds samples: it never allocates, converts or locks.
+// Triggers reach it through per-sound counters, from any thread.
+#define DEFAULT_AUDIO_BUFFER 512 // sample frames, ~11.6 ms at 44.1 kHz (was 2048, ~46 ms)
+#define MAX_SOUNDS 8
+#define MAX_VOICES 16
+#define MIX_BLOCK 8              // samples per SIMD step; sounds are padded to whole blocks
+#define LATENCY_CLICKS 20
+#define LATENCY_THRESHOLD 8000   // |sample| that marks the onset of the test click
+
+typedef struct {
+    const Mix_Chunk *chunk;  // the handle the game plays it by
+    Sint16 *samples;         // device format (S16 stereo, interleaved), SIMD-aligned, padded with silence
+    int count;               // samples, a multiple of MIX_BLOCK
+    Sint16 gain;             // Q15, from the chunk volume
+    SDL_atomic_t pending;    // triggers the audio thread has not started yet
+} Sound;
+
+typedef struct {
+    const Sound *sound;
+    int position;            // next sample
+} Voice;
+
+typedef struct {
+    bool custom;             // --audio-mixer custom
+    int bufferFrames;        // --audio-buffer
+    int frequency;
+    Sound sounds[MAX_SOUNDS];
+    int soundCount;
+    Voice voices[MAX_VOICES]; // owned by the audio thread
+    int voiceCount;
+    SDL_atomic_t stolen;     // triggers dropped because every voice was busy
+
+    // Latency test: the callback watches its own output for the click
+    SDL_atomic_t armed;
+    Uint64 triggerTicks;     // written by the main thread before arming
+    double latencyMs[LATENCY_CLICKS];
+    double mixDelayMs[LATENCY_CLICKS];
+    SDL_atomic_t measured;
+} AudioMixer;
+
+AudioMixer audio;
+
+// Add `count` samples of in * gain into out, saturating
+static void mix_scalar(Sint16 *out, const Sint16 *in, int count, Sint16 gain) {
+    for (int i = 0; i < count; i++) {
+        int sample = out[i] + ((((int)in[i] * gain) >> 16) << 1);
+        out[i] = (Sint16)SDL_max(-32768, SDL_min(sample, 32767));
+    }
+}
+
+#ifdef __SSE2__
+static void mix_sse2(Sint16 *out, const Sint16 *in, int count, Sint16 gain) {
+    __m128i g = _mm_set1_epi16(gain);
+    int i = 0;
+    for (; i + MIX_BLOCK <= count; i += MIX_BLOCK) {
+        __m128i s = _mm_slli_epi16(_mm_mulhi_epi16(_mm_loadu_si128((const __m128i *)(in + i)), g), 1);
+        __m128i *p = (__m128i *)(out + i);
+        _mm_storeu_si128(p, _mm_adds_epi16(_mm_loadu_si128(p), s));
+    }
+    mix_scalar(out + i, in + i, count - i, gain);
+}
+#define mix_samples mix_sse2
+#else
+#define mix_samples mix_scalar
+#endif
+
+// Runs on the audio thread after SDL_mixer has mixed the music (and, without
+// the custom mixer, its channels)
+void audio_postmix(void *data, Uint8 *stream, int len) {
+    Uint64 callbackTicks = SDL_GetPerformanceCounter();
+    AudioMixer *mixer = data;
+    Sint16 *out = (Sint16 *)stream;
+    int count = len / sizeof(Sint16);
+
+    if (mixer->custom) {
+        for (int s = 0; s < mixer->soundCount; s++) {
+            Sound *sound = &mixer->sounds[s];
+            for (int n = SDL_AtomicSet(&sound->pending, 0); n > 0; n--) {
+                if (mixer->voiceCount == MAX_VOICES) {
+                    SDL_AtomicAdd(&mixer->stolen, 1);
+                    break;
+                }
+                mixer->voices[mixer->voiceCount++] = (Voice){ sound, 0 };
+            }
+        }
+        for (int v = 0; v < mixer->voiceCount;) {
+            Voice *voice = &mixer->voices[v];
+            int n = SDL_min(count, voice->sound->count - voice->position);
+            mix_samples(out, voice->sound->samples + voice->position, n, voice->sound->gain);
+            voice->position += n;
+            if (voice->position >= voice->sound->count) {
+                *voice = mixer->voices[--mixer->voiceCount]; // finished; the last voice takes its slot
+            } else {
+                v++;
+            }
+        }
+    }
+
+    // Loopback: find the click in what is about to be queued. It reaches the
+    // speaker roughly one device buffer after this callback.
+    if (SDL_AtomicGet(&mixer->armed)) {
+        for (int i = 0; i < count; i++) {
+            if (out[i] > LATENCY_THRESHOLD || out[i] < -LATENCY_THRESHOLD) {
+                int done = SDL_AtomicGet(&mixer->measured);
+                double tick = 1000.0 / SDL_GetPerformanceFrequency();
+                double mixMs = (callbackTicks - mixer->triggerTicks) * tick;
+                mixer->mixDelayMs[done] = mixMs;
+                mixer->latencyMs[done] = mixMs + (i / 2 + mixer->bufferFrames) * 1000.0 / mixer->frequency;
+                SDL_AtomicSet(&mixer->armed, 0);
+                SDL_AtomicSet(&mixer->measured, done + 1);
+                break;
+            }
+        }
+    }
+}
+
+// Open the device. The custom mixer needs S16 stereo, which is what we ask SDL_mixer for.
+bool audio_open(int bufferFrames, bool custom) {
+    audio.bufferFrames = SDL_max(64, SDL_min(bufferFrames, 8192));
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0 || Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, audio.bufferFrames) < 0) {
+        return false;
+    }
+    Uint16 format;
+    int channels;
+    Mix_QuerySpec(&audio.frequency, &format, &channels);
+    audio.custom = custom && format == AUDIO_S16SYS && channels == 2;
+    if (custom && !audio.custom) {
+        SDL_Log("Custom mixer needs S16 stereo output, using SDL_mixer channels");
+    }
+    printf("Audio: %d Hz, %d-frame buffer (%.1f ms), %s\n", audio.frequency, audio.bufferFrames,
+           audio.bufferFrames * 1000.0 / audio.frequency, audio.custom ? "custom SIMD mixer" : "SDL_mixer channels");
+    if (audio.custom) {
+        Mix_SetPostMix(audio_postmix, &audio);
+    }
+    return true;
+}
+
+// Make the custom mixer's copy of a loaded chunk. SDL_mixer has already
+// converted it to the device format; this aligns and pads it for the kernels.
+void audio_add_sound(const Mix_Chunk *chunk) {
+    if (!audio.custom || !chunk) {
+        return;
+    }
+    if (audio.soundCount == MAX_SOUNDS) {
+        SDL_Log("Too many sounds for the custom mixer");
+        return;
+    }
+    int count = chunk->alen / sizeof(Sint16);
+    int padded = (count + MIX_BLOCK - 1) / MIX_BLOCK * MIX_BLOCK;
+    Sint16 *samples = SDL_SIMDAlloc(padded * sizeof(Sint16));
+    if (!samples) {
+        SDL_Log("Out of memory for a sound");
+        return;
+    }
+    memcpy(samples, chunk->abuf, count * sizeof(Sint16));
+    memset(samples + count, 0, (padded - count) * sizeof(Sint16));
+
+    // Registration happens before any trigger, so the audio thread can read soundCount without a lock
+    Sound *sound = &audio.sounds[audio.soundCount];
+    sound->chunk = chunk;
+    sound->samples = samples;
+    sound->count = padded;
+    sound->gain = (Sint16)(chunk->volume * 32767 / MIX_MAX_VOLUME);
+    SDL_AtomicSet(&sound->pending, 0);
+    SDL_MemoryBarrierRelease();
+    audio.soundCount++;
+}
+
+// Play a sound effect; `channel` is SDL_mixer's, as in Mix_PlayChannel
+void play_sound(int channel, Mix_Chunk *chunk) {
+    if (!audio.custom) {
+        Mix_PlayChannel(channel, chunk, 0);
+        return;
+    }
+    for (int i = 0; i < audio.soundCount; i++) {
+        if (audio.sounds[i].chunk == chunk) {
+            SDL_AtomicAdd(&audio.sounds[i].pending, 1);
+            return;
+        }
+    }
+}
+
+// --audio-latency-test: play a click LATENCY_CLICKS times with nothing else
+// playing and time each from the trigger to the estimated moment its
+// callback buffer reaches the device
+int audio_latency_test(void) {
+    int count = audio.frequency / 100 * 2; // 10 ms of stereo square wave
+    Sint16 *click = SDL_malloc(count * sizeof(Sint16));
+    if (!click) {
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        click[i] = (i / 2 / 20) % 2 ? 20000 : -20000;
+    }
+    Mix_Chunk *chunk = Mix_QuickLoad_RAW((Uint8 *)click, count * sizeof(Sint16));
+    if (!chunk) {
+        SDL_free(click);
+        return 1;
+    }
+    audio_add_sound(chunk);
+    if (!audio.custom) {
+        Mix_SetPostMix(audio_postmix, &audio); // the detector alone
+    }
+
+    int timeouts = 0;
+    for (int n = 0; n < LATENCY_CLICKS; n++) {
+        SDL_Delay(150); // the previous click has finished playing
+        audio.triggerTicks = SDL_GetPerformanceCounter();
+        SDL_MemoryBarrierRelease();
+        SDL_AtomicSet(&audio.armed, 1);
+        play_sound(-1, chunk);
+        Uint32 start = SDL_GetTicks();
+        while (SDL_AtomicGet(&audio.measured) == n && SDL_GetTicks() - start < 1000) {
+            SDL_Delay(1);
+        }
+        if (SDL_AtomicGet(&audio.measured) == n) {
+            SDL_AtomicSet(&audio.armed, 0);
+            timeouts++;
+            break;
+        }
+    }
+    Mix_SetPostMix(NULL, NULL);
+
+    IntervalStats latency = {0}, mixDelay = {0};
+    for (int n = 0; n < SDL_AtomicGet(&audio.measured); n++) {
+        stats_add(&latency, audio.latencyMs[n], false);
+        stats_add(&mixDelay, audio.mixDelayMs[n], false);
+    }
+    printf("Audio latency: %.1f ms (sd %.1f, worst %.1f) over %llu clicks; trigger to mix %.1f ms, worst %.1f\n",
+           latency.meanMs, stats_stddev(&latency), latency.worstMs, (unsigned long long)latency.count,
+           mixDelay.meanMs, mixDelay.worstMs);
+    Mix_FreeChunk(chunk);
+    SDL_free(click);
+    return timeouts ? 1 : 0;
+}
+
+void audio_close(void) {
+    if (audio.custom) {
+        Mix_SetPostMix(NULL, NULL); // waits out a running callback
+    }
+    for (int i = 0; i < audio.soundCount; i++) {
+        SDL_SIMDFree(audio.sounds[i].samples);
+    }
+    audio.soundCount = 0;
+}
+
+
+// ---- Frame capture ----
+
+// Reads rendered frames back into a small pool of buffers and hands them to
+// an encoder thread, which writes a PNG sequence or a raw BGRA stream and
+// can diff each frame against a golden image. The game only pays for the
+// readback: when every buffer is still queued the frame is dropped, unless
+// the run needs every frame (headless or golden), where it waits instead.
+#define CAPTURE_BUFFERS 4
+#define CAPTURE_TOLERANCE 2 // per channel, absorbs rounding differences between renderers
+
+typedef struct {
+    Uint32 *pixels;          // ARGB8888, width x height
+    int frame;
+} CaptureBuffer;
+
+typedef struct {
+    const char *directory;   // --capture: PNG sequence
+    const char *rawPath;     // --capture-raw: BGRA frames back to back
+    const char *goldenDir;   // --golden: compare against <dir>/frame_NNNNN.png
+    int frameLimit;          // --capture-frames: stop the game after this many
+    bool waitForEncoder;     // never drop a frame
+
+    CaptureBuffer buffers[CAPTURE_BUFFERS];
+    int head;                // next buffer to fill, main thread
+    int tail;                // next buffer to encode, encoder thread
+    SDL_sem *free;
+    SDL_sem *filled;
+    SDL_atomic_t quit;
+    SDL_Thread *thread;
+    FILE *raw;
+
+    int frames;              // read back
+    Uint32 dropped;
+    IntervalStats readStats; // main thread
+    IntervalStats encodeStats;
+    int mismatched;          // frames that differ from (or lack) a golden image
+} Capture;
+
+Capture capture;
+
+bool capture_enabled(void) {
+    return capture.directory || capture.rawPath || capture.goldenDir;
+}
+
+// Pixels off by more than CAPTURE_TOLERANCE in any color channel, or -1 without a golden image
+int capture_compare(const Uint32 *pixels, int frame) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/frame_%05d.png", capture.goldenDir, frame);
+    SDL_Surface *loaded = surface_track(IMG_Load(path));
+    SDL_Surface *golden = loaded ? surface_track(SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0)) : NULL;
+    surface_free(loaded);
+    if (!golden || golden->w != width || golden->h != height) {
+        surface_free(golden);
+        return -1;
+    }
+    int differing = 0;
+    for (int y = 0; y < height; y++) {
+        const Uint32 *row = (const Uint32 *)((const Uint8 *)golden->pixels + y * golden->pitch);
+        for (int x = 0; x < width; x++) {
+            Uint32 a = pixels[y * width + x], b = row[x];
+            for (int shift = 0; shift < 24; shift += 8) {
+                if (abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF)) > CAPTURE_TOLERANCE) {
+                    differing++;
+                    break;
+                }
+            }
+        }
+    }
+    surface_free(golden);
+    return differing;
+}
+
+void capture_encode(CaptureBuffer *buffer) {
+    if (capture.directory) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/frame_%05d.png", capture.directory, buffer->frame);
+        SDL_Surface *surface = surface_track(SDL_CreateRGBSurfaceWithFormatFrom(buffer->pixels, width, height, 32,
+                                                                                width * 4, SDL_PIXELFORMAT_ARGB8888));
+        if (!surface || IMG_SavePNG(surface, path) != 0) {
+            SDL_Log("Unable to write %s: %s", path, SDL_GetError());
+        }
+        surface_free(surface);
+    }
+    if (capture.raw) {
+        fwrite(buffer->pixels, sizeof(Uint32), (size_t)width * height, capture.raw);
+    }
+    if (capture.goldenDir) {
+        int differing = capture_compare(buffer->pixels, buffer->frame);
+        if (differing != 0) {
+            capture.mismatched++;
+            if (differing < 0) {
+                printf("Golden: no image for frame %d\n", buffer->frame);
+            } else {
+                printf("Golden: frame %d differs in %d pixels\n", buffer->frame, differing);
+            }
+        }
+    }
+}
+
+int capture_encoder(void *data) {
+    (void)data;
+    memory_tag(MEMORY_CAPTURE);
+    for (;;) {
+        SDL_SemWait(capture.filled);
+        if (SDL_AtomicGet(&capture.quit) && capture.tail == capture.head) {
+            return 0; // everything queued before the stop has been written
+        }
+        CaptureBuffer *buffer = &capture.buffers[capture.tail % CAPTURE_BUFFERS];
+        Uint64 start = SDL_GetPerformanceCounter();
+        capture_encode(buffer);
+        stats_add(&capture.encodeStats, (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency(), false);
+        capture.tail++;
+        SDL_SemPost(capture.free);
+    }
+}
+
+bool capture_start(void) {
+    if (capture.directory) {
+#ifdef _WIN32
+        bool ok = CreateDirectoryA(capture.directory, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+        bool ok = mkdir(capture.directory, 0755) == 0 || errno == EEXIST;
+#endif
+        if (!ok) {
+            SDL_Log("Unable to create capture directory %s", capture.directory);
+            return false;
+        }
+    }
+    if (capture.rawPath && !(capture.raw = fopen(capture.rawPath, "wb"))) {
+        SDL_Log("Unable to write %s", capture.rawPath);
+        return false;
+    }
+    int previous = memory_tag(MEMORY_CAPTURE);
+    for (int i = 0; i < CAPTURE_BUFFERS; i++) {
+        capture.buffers[i].pixels = SDL_malloc((size_t)width * height * sizeof(Uint32));
+        if (!capture.buffers[i].pixels) {
+            SDL_Log("Out of memory for capture buffers");
+            memory_tag(previous);
+            return false;
+        }
+    }
+    memory_tag(previous);
+    capture.free = SDL_CreateSemaphore(CAPTURE_BUFFERS);
+    capture.filled = SDL_CreateSemaphore(0);
+    capture.thread = SDL_CreateThread(capture_encoder, "capture", NULL);
+    return capture.thread != NULL;
+}
+
+// Read back the frame just rendered, before overlays are drawn over it.
+// Returns false once --capture-frames frames have been taken.
+bool capture_frame(SDL_Renderer *renderer) {
+    if (!capture.thread) {
+        return true;
+    }
+    if (capture.waitForEncoder) {
+        SDL_SemWait(capture.free);
+    } else if (SDL_SemTryWait(capture.free) != 0) {
+        capture.dropped++; // encoder behind; the game does not wait for it
+        return true;
+    }
+    CaptureBuffer *buffer = &capture.buffers[capture.head % CAPTURE_BUFFERS];
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_Rect frame = {0, 0, width, height};
+    if (SDL_RenderReadPixels(renderer, &frame, SDL_PIXELFORMAT_ARGB8888, buffer->pixels, width * 4) != 0) {
+        SDL_Log("SDL_RenderReadPixels failed: %s", SDL_GetError());
+        SDL_SemPost(capture.free);
+        return true;
+    }
+    stats_add(&capture.readStats, (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency(), false);
+    buffer->frame = capture.frames++;
+    capture.head++;
+    SDL_SemPost(capture.filled);
+    return capture.frameLimit <= 0 || capture.frames < capture.frameLimit;
+}
+
+// Drain the queue, stop the encoder and report. Returns the golden mismatch count.
+int capture_stop(void) {
+    if (!capture.thread) {
+        return 0;
+    }
+    SDL_AtomicSet(&capture.quit, 1);
+    SDL_SemPost(capture.filled);
+    SDL_WaitThread(capture.thread, NULL);
+    capture.thread = NULL;
+    if (capture.raw) {
+        fclose(capture.raw);
+        printf("Raw capture: ffmpeg -f rawvideo -pixel_format bgra -video_size %dx%d -framerate %d -i %s\n",
+               width, height, DEFAULT_FPS, capture.rawPath);
+    }
+    for (int i = 0; i < CAPTURE_BUFFERS; i++) {
+        SDL_free(capture.buffers[i].pixels);
+    }
+    SDL_DestroySemaphore(capture.free);
+    SDL_DestroySemaphore(capture.filled);
+
+    printf("Capture: %d frames, readback %.3f ms per frame (worst %.2f), encode %.2f ms (worst %.1f), dropped %u\n",
+           capture.frames, capture.readStats.meanMs, capture.readStats.worstMs,
+           capture.encodeStats.meanMs, capture.encodeStats.worstMs, capture.dropped);
+    if (capture.goldenDir) {
+        printf("Golden: %d of %d frames differ from %s\n", capture.mismatched, capture.frames, capture.goldenDir);
+    }
+    return capture.mismatched;
+}
+
+
+// ---- Simulation thread plumbing ----
+
+// Buttons held by both players, packed for the input queue and the simulation
+#define INPUT_P1_JUMP      0x0001
+#define INPUT_P1_LEFT      0x0002
+#define INPUT_P1_RIGHT     0x0004
+#define INPUT_P1_PUNCH     0x0008
+#define INPUT_P1_KICK      0x0010
+#define INPUT_P1_SPECIAL   0x0020
+#define INPUT_P2_JUMP      0x0040
+#define INPUT_P2_LEFT      0x0080
+#define INPUT_P2_RIGHT     0x0100
+#define INPUT_P2_PUNCH     0x0200
+#define INPUT_P2_KICK      0x0400
+#define INPUT_P2_SPECIAL   0x0800
+#define INPUT_KEY_RELEASED 0x8000 // a key went up: fighters drop back to their stance
+#define INPUT_QUEUE_SIZE 256
+
+// Everything the simulation owns. The sim thread steps its own copy and
+// publishes immutable snapshots of it for the renderer.
+typedef struct {
+    Uint32 tick;
+    Player player1, player2;
+    Projectile player1Projectile, player2Projectile;
+    Sprite sprite1, sprite2;
+    int player1_health, player2_health;
+    int winner;              // 0 while fighting, then 1 or 2
+    IntervalStats tickStats; // simulation tick jitter, reported apart from render jitter
+} MatchState;
+
+// Lock-free triple buffer: the writer always has a slot to fill, the reader
+// always has a complete snapshot, and neither ever waits for the other.
+#define SNAPSHOT_FRESH 0x4 // set on `middle` when it holds a snapshot the reader has not taken
+typedef struct {
+    MatchState slots[3];
+    SDL_atomic_t middle;  // slot handed between writer and reader
+    int back;             // owned by the writer
+    int front;            // owned by the reader
+} SnapshotBuffer;
+
+void snapshot_init(SnapshotBuffer *buffer, const MatchState *state) {
+    for (int i = 0; i < 3; i++) {
+        buffer->slots[i] = *state;
+    }
+    buffer->back = 0;
+    buffer->front = 1;
+    SDL_AtomicSet(&buffer->middle, 2);
+}
+
+MatchState *snapshot_back(SnapshotBuffer *buffer) {
+    return &buffer->slots[buffer->back];
+}
+
+// Writer: hand the filled back slot over and take the old middle one
+void snapshot_publish(SnapshotBuffer *buffer) {
+    buffer->back = SDL_AtomicSet(&buffer->middle, buffer->back | SNAPSHOT_FRESH) & 3;
+}
+
+// Reader: swap in the newest snapshot if one was published since the last call
+const MatchState *snapshot_latest(SnapshotBuffer *buffer) {
+    if (SDL_AtomicGet(&buffer->middle) & SNAPSHOT_FRESH) {
+        buffer->front = SDL_AtomicSet(&buffer->middle, buffer->front) & 3;
+    }
+    return &buffer->slots[buffer->front];
+}
+
+// Single-producer/single-consumer ring of button states (main thread -> sim thread)
+typedef struct {
+    Uint32 buttons[INPUT_QUEUE_SIZE];
+    SDL_atomic_t head; // next slot to write, advanced by the main thread
+    SDL_atomic_t tail; // next slot to read, advanced by the sim thread
+} InputQueue;
+
+void input_init(InputQueue *queue) {
+    SDL_AtomicSet(&queue->head, 0);
+    SDL_AtomicSet(&queue->tail, 0);
+}
+
+bool input_push(InputQueue *queue, Uint32 buttons) {
+    Uint32 head = SDL_AtomicGet(&queue->head);
+    if (head - (Uint32)SDL_AtomicGet(&queue->tail) == INPUT_QUEUE_SIZE) {
+        return false; // Full; the sim thread is stalled
+    }
+    queue->buttons[head % INPUT_QUEUE_SIZE] = buttons;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queue->head, head + 1);
+    return true;
+}
+
+bool input_pop(InputQueue *queue, Uint32 *buttons) {
+    Uint32 tail = SDL_AtomicGet(&queue->tail);
+    if (tail == (Uint32)SDL_AtomicGet(&queue->head)) {
+        return false;
+    }
+    SDL_MemoryBarrierAcquire();
+    *buttons = queue->buttons[tail % INPUT_QUEUE_SIZE];
+    SDL_AtomicSet(&queue->tail, tail + 1);
+    return true;
+}
+
+
+typedef struct Game Game;
+
+// A scene owns one screen of the game. Only the scene on top of the stack
+// receives events, updates and renders; enter/exit run on push/pop.
+// Static scenes set onDemand and are only redrawn after input marks them dirty.
+typedef struct {
+    const char *name;
+    bool onDemand;
+    void (*enter)(Game *game);
+    void (*exit)(Game *game);
+    void (*event)(Game *game, SDL_Event *event);
+    void (*update)(Game *game, Uint32 now);
+    void (*render)(Game *game);
+    int images;  // startup images (in load order) that must be uploaded before the scene shows
+    Uint32 textures; // streamed textures it draws (STREAM_BIT)
+    Uint32 prefetch; // and the ones the scenes it leads to draw
+} Scene;
+
+#define MAX_SCENES 8
+#define IMAGES_MENU 2        // menu background and button
+#define IMAGES_PAGES 5       // plus the option, help and credits pages
+#define IMAGES_ALL MAX_IMAGE_JOBS
+#define INTRO_FRAME_DELAY 25 // ms per credits video frame (~40 FPS)
+#define LOADING_DURATION 3000
+#define WINNER_DURATION 5000
+#define IDLE_WAIT_TIMEOUT 500 // ms an on-demand scene sleeps in SDL_WaitEventTimeout
+#define TICK_RATE 60          // fixed simulation rate, independent of the render rate
+#define MAX_CATCHUP_TICKS 5   // drop time instead of spiralling after a long stall
+
+struct Game {
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    bool run;
+    bool renderOnDemand; // cleared by --no-idle to compare against always redrawing
+    bool dirty;          // the top scene has to be redrawn
+
+    // Idle accounting: wall and process CPU time spent on on-demand scenes
+    Uint64 idleWallTicks;
+    clock_t idleCpuTicks;
+
+    FramePacer pacer;
+    Resolution resolution;
+    bool showMetrics;      // F1 toggles the metrics overlay
+    bool showMemory;       // F3 toggles the memory overlay
+    bool debugDraw;        // F2 (or --hitboxes) toggles the debug body and hitbox draws
+    DrawList draws;        // match draw commands, recorded and submitted every frame
+    Uint64 simAccumulator; // counter ticks not yet consumed by fixed updates
+
+    DecodePool decoder;    // startup images still streaming in
+    Uint64 startupBegin;   // for time-to-first-frame
+    bool presented;        // the first frame is on screen
+
+    // Scene stack; enteredAt drives the timed transitions
+    const Scene *scenes[MAX_SCENES];
+    Uint32 enteredAt[MAX_SCENES];
+    int sceneCount;
+
+    // Assets
+    SDL_Texture *menuTexture;
+    SDL_Texture *ButtonTexture;
+    SDL_Texture *optionTexture;
+    SDL_Texture *helpTexture;
+    SDL_Texture *arenaTexture;
+    SDL_Texture *healthTexture;
+    SDL_Texture *loadTexture;
+    SDL_Texture *winner1;
+    SDL_Texture *winner2;
+    SDL_Texture *creditsmenu;
+    SDL_Texture *Haduoken;
+    SDL_Texture *ryu1;
+    SDL_Texture *ken1;
+    TTF_Font *menuFont;
+    TTF_Font *normalfont;
+    Mix_Music *bgMusic;
+    Mix_Chunk *sfxselect;
+    Mix_Chunk *sfxnavigate;
+    Mix_Chunk *punch;
+    Mix_Chunk *kick;
+
+    // Menu and option state
+    bool voice;
+    int borderpos;
+    int borderposY;
+    int musiccount, prevmusic;
+
+    // Credits video
+    int introFrame;
+    SDL_Texture *introTexture;
+
+    // Match data shared read-only with the sim thread
+    Sprite sprite1, sprite2; // templates the match state starts from
+    AnimSet ryuAnims, kenAnims;
+    FrameData frameData;
+    int idleMove, punchMove, kickMove;
+    SDL_Texture **winnerTexture; // winner1 or winner2
+    SDL_Texture *player1Label, *player2Label; // HUD names, rendered once per match
+    SDL_Rect player1LabelRect, player2LabelRect;
+
+    // Static HUD (health frames and names) composed into one target texture
+    SDL_Texture *hudTexture;
+    bool hudDirty;         // rebuild before the next match frame
+    bool hudDirect;        // --hud-direct: draw the pieces every frame, for comparison
+    IntervalStats hudStats; // CPU time issuing the HUD layers per match frame
+    IntervalStats renderStats; // match frame submit through RenderFlush, per backend
+
+    // Match state: `sim` belongs to the sim thread while it runs; the renderer
+    // only reads snapshots, and input reaches the sim through the queue
+    MatchState sim;
+    SnapshotBuffer snapshots;
+    InputQueue input;
+    SDL_atomic_t simRunning;
+    SDL_Thread *simThread;
+    bool lockstep;         // capture: exactly one sim tick per rendered frame, so frames are reproducible
+    SDL_sem *tickStart;    // lockstep: main -> sim, run one tick
+    SDL_sem *tickDone;     // lockstep: sim -> main, its snapshot is published
+    bool silent;           // replay verification: the sim plays no sounds
+};
+
+extern const Scene introScene;
+extern const Scene menuScene;
+extern const Scene optionScene;
+extern const Scene helpScene;
+extern const Scene creditScene;
+extern const Scene loadingScene;
+extern const Scene matchScene;
+extern const Scene winnerScene;
+
+const Scene *scene_top(Game *game) {
+    return game->sceneCount > 0 ? game->scenes[game->sceneCount - 1] : NULL;
+}
+
+// Milliseconds since the top scene was entered
+Uint32 scene_elapsed(Game *game, Uint32 now) {
+    return now - game->enteredAt[game->sceneCount - 1];
+}
+
+void scene_push(Game *game, const Scene *scene) {
+    if (game->sceneCount == MAX_SCENES) {
+        errors("Scene Error: Scene stack overflow.");
+    }
+    decode_wait(&game->decoder, game->renderer, scene->images);
+    game->scenes[game->sceneCount] = scene;
+    game->enteredAt[game->sceneCount] = SDL_GetTicks();
+    game->sceneCount++;
+    game->dirty = true;
+    residency_scene(scene->textures, scene->prefetch);
+    if (scene->enter) {
+        scene->enter(game);
+    }
+}
+
+void scene_pop(Game *game) {
+    const Scene *scene = scene_top(game);
+    if (!scene) {
+        return;
+    }
+    if (scene->exit) {
+        scene->exit(game);
+    }
+    game->sceneCount--;
+    game->dirty = true;
+    scene = scene_top(game);
+    residency_scene(scene ? scene->textures : 0, scene ? scene->prefetch : 0);
+}
+
+// Replace the top scene
+void scene_switch(Game *game, const Scene *scene) {
+    scene_pop(game);
+    scene_push(game, scene);
+}
+
+// Drop every scene and start over from the given one
+void scene_reset(Game *game, const Scene *scene) {
+    while (game->sceneCount > 0) {
+        scene_pop(game);
+    }
+    scene_push(game, scene);
+}
+
+// Swap the background track, honouring the music on/off toggle
+void change_music(Game *game) {
+    music_free(game->bgMusic);  // Free the previous music
+    const char *path = music(&game->musiccount);
+    game->bgMusic = music_load(path);  // Load new music based on musiccount
+    if (!game->bgMusic) {
+        SDL_Log("No music at %s, playing none", path); // the tracks are optional in a checkout
+    }
+    if (game->voice && game->bgMusic) {
+        Mix_PlayMusic(game->bgMusic, -1);
+    }
+}
+
+
+// ---- Startup timing ----
+
+// Boot is split into phases so a slow driver, device or asset shows up by
+// name; the phases are printed with the first frame.
+#define STARTUP_PHASES 12
+
+typedef struct {
+    Uint64 last;
+    const char *names[STARTUP_PHASES];
+    double ms[STARTUP_PHASES];
+    int count;
+} StartupTimes;
+
+StartupTimes startup;
+
+// Close the phase that ran since the previous mark
+void startup_mark(const char *name) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (startup.count < STARTUP_PHASES) {
+        startup.names[startup.count] = name;
+        startup.ms[startup.count++] = (now - startup.last) * 1000.0 / SDL_GetPerformanceFrequency();
+    }
+    startup.last = now;
+}
+
+void startup_report(void) {
+    printf("Startup:");
+    for (int i = 0; i < startup.count; i++) {
+        printf("%s %s %.1f ms", i ? "," : "", startup.names[i], startup.ms[i]);
+    }
+    printf("\n");
+}
+
+
+// ---- Game controllers ----
+
+// Pads and arcade sticks through SDL_GameController. The subsystem is only
+// brought up after the first frame, so enumerating devices does not delay
+// boot, and SDL reports every pad already plugged in as an added device.
+// Pads take the first free player slot as they are plugged in and free it
+// when unplugged. In a match the sim thread samples them itself right
+// before each tick instead of waiting for the main thread to pump events;
+// SDL serializes that with the event pump under the joystick lock. Outside
+// a match the d-pad and buttons drive the menus as keys.
+#define CONTROLLER_DEADZONE 12000
+#define CONTROLLER_LATENCY_TIMEOUT 250 // ms; presses no tick applied in time are not counted
+
+typedef struct {
+    bool enabled;
+    SDL_GameController *pads[2];      // by player; guarded by SDL_LockJoysticks
+    SDL_JoystickID ids[2];
+    int connected;
+    double initMs;
+
+    // Latency: SDL timestamps a press when a pump (either thread's) first
+    // sees it; the sim notes when a tick applied a new press
+    SDL_atomic_t appliedAt[2];        // SDL_GetTicks of the last tick that applied a new press
+    Uint32 pendingSince[2];           // main thread: press seen by the event pump, awaiting its tick
+    IntervalStats latency;
+    Uint32 unapplied;
+} Controllers;
+
+Controllers controllers;
+
+void controllers_open(void) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER) != 0) {
+        SDL_Log("No game controller support: %s", SDL_GetError());
+        return;
+    }
+    controllers.initMs = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    controllers.enabled = true;
+    printf("Controllers: subsystem up in %.1f ms, after the first frame\n", controllers.initMs);
+}
+
+// Main thread: SDL_CONTROLLERDEVICEADDED/REMOVED
+void controllers_hotplug(const SDL_Event *event) {
+    SDL_LockJoysticks();
+    if (event->type == SDL_CONTROLLERDEVICEADDED) {
+        int slot = !controllers.pads[0] ? 0 : !controllers.pads[1] ? 1 : -1;
+        SDL_GameController *pad = slot >= 0 ? SDL_GameControllerOpen(event->cdevice.which) : NULL;
+        if (pad) {
+            controllers.pads[slot] = pad;
+            controllers.ids[slot] = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(pad));
+            controllers.connected++;
+            printf("Controller connected: %s, player %d\n", SDL_GameControllerName(pad), slot + 1);
+        }
+    } else {
+        for (int slot = 0; slot < 2; slot++) {
+            if (controllers.pads[slot] && controllers.ids[slot] == event->cdevice.which) {
+                printf("Controller disconnected: player %d\n", slot + 1);
+                SDL_GameControllerClose(controllers.pads[slot]);
+                controllers.pads[slot] = NULL;
+            }
+        }
+    }
+    SDL_UnlockJoysticks();
+}
+
+// Player slot of a controller event, or -1
+int controllers_slot(SDL_JoystickID id) {
+    for (int slot = 0; slot < 2; slot++) {
+        if (controllers.pads[slot] && controllers.ids[slot] == id) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// Menu key for a pad button, 0 for none
+SDL_Keycode controllers_menu_key(Uint8 button) {
+    switch (button) {
+    case SDL_CONTROLLER_BUTTON_DPAD_UP: return SDLK_UP;
+    case SDL_CONTROLLER_BUTTON_DPAD_DOWN: return SDLK_DOWN;
+    case SDL_CONTROLLER_BUTTON_DPAD_LEFT: return SDLK_LEFT;
+    case SDL_CONTROLLER_BUTTON_DPAD_RIGHT: return SDLK_RIGHT;
+    case SDL_CONTROLLER_BUTTON_A:
+    case SDL_CONTROLLER_BUTTON_START: return SDLK_RETURN;
+    case SDL_CONTROLLER_BUTTON_B:
+    case SDL_CONTROLLER_BUTTON_BACK: return SDLK_ESCAPE;
+    default: return 0;
+    }
+}
+
+// Sim thread, once per tick: both pads as INPUT_* bits. `previous` keeps
+// the pads' last bits so letting go drops the fighters back to stance.
+Uint32 controllers_poll(Uint32 *previous) {
+    if (!controllers.enabled) {
+        return 0;
+    }
+    static const struct { SDL_GameControllerButton button; Uint32 bit; } bindings[] = {
+        { SDL_CONTROLLER_BUTTON_DPAD_UP, INPUT_P1_JUMP }, { SDL_CONTROLLER_BUTTON_A, INPUT_P1_JUMP },
+        { SDL_CONTROLLER_BUTTON_DPAD_LEFT, INPUT_P1_LEFT }, { SDL_CONTROLLER_BUTTON_DPAD_RIGHT, INPUT_P1_RIGHT },
+        { SDL_CONTROLLER_BUTTON_X, INPUT_P1_PUNCH }, { SDL_CONTROLLER_BUTTON_B, INPUT_P1_KICK },
+        { SDL_CONTROLLER_BUTTON_Y, INPUT_P1_SPECIAL },
+    };
+    Uint32 buttons = 0;
+    SDL_LockJoysticks();
+    SDL_GameControllerUpdate();
+    for (int slot = 0; slot < 2; slot++) {
+        SDL_GameController *pad = controllers.pads[slot];
+        if (!pad) {
+            continue;
+        }
+        Uint32 bits = 0;
+        for (size_t i = 0; i < sizeof(bindings) / sizeof(bindings[0]); i++) {
+            if (SDL_GameControllerGetButton(pad, bindings[i].button)) {
+                bits |= bindings[i].bit;
+            }
+        }
+        Sint16 x = SDL_GameControllerGetAxis(pad, SDL_CONTROLLER_AXIS_LEFTX);
+        bits |= x < -CONTROLLER_DEADZONE ? INPUT_P1_LEFT : x > CONTROLLER_DEADZONE ? INPUT_P1_RIGHT : 0;
+        bits |= SDL_GameControllerGetAxis(pad, SDL_CONTROLLER_AXIS_LEFTY) < -CONTROLLER_DEADZONE * 2 ? INPUT_P1_JUMP : 0;
+        bits <<= slot * 6; // player 2's bits sit six above player 1's
+        if (bits & ~*previous) {
+            SDL_AtomicSet(&controllers.appliedAt[slot], (int)SDL_GetTicks());
+        }
+        buttons |= bits;
+    }
+    SDL_UnlockJoysticks();
+    Uint32 released = *previous & ~buttons ? INPUT_KEY_RELEASED : 0;
+    *previous = buttons;
+    return buttons | released;
+}
+
+// Main thread, in a match: a press the event pump delivered
+void controllers_pressed(const SDL_Event *event) {
+    int slot = controllers_slot(event->cbutton.which);
+    if (slot >= 0 && controllers.pendingSince[slot] == 0) {
+        controllers.pendingSince[slot] = SDL_max(event->cbutton.timestamp, 1);
+    }
+}
+
+// Main thread, every frame: match pending presses with the tick that applied them
+void controllers_latency(void) {
+    Uint32 now = SDL_GetTicks();
+    for (int slot = 0; slot < 2; slot++) {
+        Uint32 since = controllers.pendingSince[slot];
+        if (since == 0) {
+            continue;
+        }
+        Uint32 applied = (Uint32)SDL_AtomicGet(&controllers.appliedAt[slot]);
+        if ((Sint32)(applied - since) >= 0) {
+            stats_add(&controllers.latency, applied - since, applied - since > 1000 / TICK_RATE);
+            controllers.pendingSince[slot] = 0;
+        } else if (now - since > CONTROLLER_LATENCY_TIMEOUT) {
+            controllers.unapplied++;
+            controllers.pendingSince[slot] = 0;
+        }
+    }
+}
+
+void controllers_close(void) {
+    if (!controllers.enabled) {
+        return;
+    }
+    IntervalStats *latency = &controllers.latency;
+    printf("Controllers: %d connected, press to tick %.2f ms (sd %.2f, worst %.0f) over %llu presses, "
+           "%u over a tick, %u not applied\n", controllers.connected, latency->meanMs, stats_stddev(latency),
+           latency->worstMs, (unsigned long long)latency->count, latency->missed, controllers.unapplied);
+    SDL_LockJoysticks();
+    for (int slot = 0; slot < 2; slot++) {
+        if (controllers.pads[slot]) {
+            SDL_GameControllerClose(controllers.pads[slot]);
+            controllers.pads[slot] = NULL;
+        }
+    }
+    SDL_UnlockJoysticks();
+    SDL_QuitSubSystem(SDL_INIT_GAMECONTROLLER);
+    controllers.enabled = false;
+}
+
+
+// ---- Spectator stream ----
+
+// Secondary screens watch a match through the stream in spectator.h rather
+// than a second copy of the game. The sim thread encodes one packet per
+// changed tick into a byte ring; the main thread drains the ring to a file
+// (--spectate) and to any number of viewers on a local TCP port
+// (--spectate-port). A viewer that cannot keep up loses deltas, which are
+// self-contained, and after a lost keyframe resumes at the next one.
+#define SPECTATOR_RING 16384
+#define MAX_SPECTATORS 16
+#define SPECTATOR_BACKLOG 4096 // unsent bytes held per viewer
+
+#ifdef _WIN32
+typedef SOCKET Socket;
+#define NO_SOCKET INVALID_SOCKET
+#define close_socket closesocket
+#define SOCKET_WOULD_BLOCK (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+typedef int Socket;
+#define NO_SOCKET (-1)
+#define close_socket close
+#define SOCKET_WOULD_BLOCK (errno == EAGAIN || errno == EWOULDBLOCK)
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+typedef struct {
+    Socket socket;
+    Uint8 backlog[SPECTATOR_BACKLOG];
+    int backlogBytes;
+    bool waitKeyframe;       // missed a keyframe: the deltas after it are useless
+    Uint32 skipped;
+} Spectator;
+
+typedef struct {
+    bool enabled;
+
+    // Sim thread
+    Sint32 keyframe[SPECTATOR_FIELDS];
+    Sint32 last[SPECTATOR_FIELDS];
+    Uint32 keyTick;
+    bool needKeyframe;
+    Uint32 ticks;
+    Uint32 lost;             // packets the ring had no room for
+
+    // Sim -> main
+    Uint8 ring[SPECTATOR_RING];
+    SDL_atomic_t head;       // bytes written, advanced by the sim thread
+    SDL_atomic_t tail;       // bytes read, advanced by the main thread
+
+    // Main thread
+    FILE *file;
+    Socket listener;
+    Spectator viewers[MAX_SPECTATORS];
+    int viewerCount;
+    Uint64 bytes;
+    Uint32 packets, keyframes;
+} SpectatorStream;
+
+SpectatorStream spectator = { .listener = NO_SOCKET };
+
+void spectator_header(SpectatorHeader *header) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, SPECTATOR_MAGIC, sizeof(header->magic));
+    header->version = SPECTATOR_VERSION;
+    header->tickRate = TICK_RATE;
+    header->fieldCount = SPECTATOR_FIELDS;
+    header->arenaW = width;
+    header->arenaH = height;
+    header->projectileW = PROJECTILE_WIDTH;
+    header->projectileH = PROJECTILE_HEIGHT;
+}
+
+bool spectator_set_nonblocking(Socket socket) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(socket, FIONBIO, &mode) == 0;
+#else
+    return fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+}
+
+// Open the outputs; either may be missing
+bool spectator_open(const char *path, int port) {
+    if (path) {
+        spectator.file = fopen(path, "wb");
+        if (!spectator.file) {
+            SDL_Log("Unable to write spectator stream %s", path);
+            return false;
+        }
+        SpectatorHeader header;
+        spectator_header(&header);
+        fwrite(&header, sizeof(header), 1, spectator.file);
+    }
+    if (port > 0) {
+#ifdef _WIN32
+        WSADATA wsa;
+        WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons((Uint16)port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // viewers on this machine only
+        int reuse = 1;
+        spectator.listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (spectator.listener == NO_SOCKET ||
+            setsockopt(spectator.listener, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse)) != 0 ||
+            bind(spectator.listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+            listen(spectator.listener, MAX_SPECTATORS) != 0 || !spectator_set_nonblocking(spectator.listener)) {
+            SDL_Log("Unable to listen for spectators on port %d", port);
+            if (spectator.listener != NO_SOCKET) {
+                close_socket(spectator.listener);
+            }
+            spectator.listener = NO_SOCKET;
+            return false;
+        }
+        printf("Spectators: connect to 127.0.0.1:%d\n", port);
+    }
+    spectator.enabled = true;
+    return true;
+}
+
+// Describe the match as the stream's fields
+void spectator_fields(const MatchState *state, Sint32 *fields) {
+    const Player *players[2] = { &state->player1, &state->player2 };
+    const Sprite *sprites[2] = { &state->sprite1, &state->sprite2 };
+    const Projectile *projectiles[2] = { &state->player1Projectile, &state->player2Projectile };
+    const int health[2] = { state->player1_health, state->player2_health };
+    for (int p = 0; p < 2; p++) {
+        Sint32 *f = fields + SPECTATOR_FIGHTER(p);
+        const Sprite *sprite = sprites[p];
+        f[SPECTATOR_X] = players[p]->rect.x;
+        f[SPECTATOR_Y] = players[p]->rect.y;
+        f[SPECTATOR_WIDTH] = players[p]->rect.w;
+        f[SPECTATOR_HEIGHT] = players[p]->rect.h;
+        f[SPECTATOR_SPRITE_X] = sprite->x;
+        f[SPECTATOR_SPRITE_Y] = sprite->y;
+        f[SPECTATOR_ANIMATION] = sprite->playingAnimation;
+        f[SPECTATOR_FRAME] = sprite->currentFrame - sprite->anims->clips[sprite->playingAnimation].first;
+        f[SPECTATOR_HEALTH] = health[p];
+
+        Sint32 *q = fields + SPECTATOR_PROJECTILE(p);
+        q[SPECTATOR_ACTIVE] = projectiles[p]->active;
+        q[SPECTATOR_PROJECTILE_X] = projectiles[p]->rect.x;
+        q[SPECTATOR_PROJECTILE_Y] = projectiles[p]->rect.y;
+    }
+    fields[SPECTATOR_WINNER] = state->winner;
+}
+
+// Start a new match with a keyframe; called before the sim thread starts
+void spectator_restart(void) {
+    spectator.needKeyframe = true;
+}
+
+// Sim thread, after every tick
+void spectator_tick(const MatchState *state) {
+    if (!spectator.enabled) {
+        return;
+    }
+    spectator.ticks++;
+    Sint32 fields[SPECTATOR_FIELDS];
+    spectator_fields(state, fields);
+    bool keyframe = spectator.needKeyframe || state->tick - spectator.keyTick >= SPECTATOR_KEYFRAME_TICKS;
+    if (!keyframe && memcmp(fields, spectator.last, sizeof(fields)) == 0) {
+        return; // Nothing moved: viewers keep showing the last state
+    }
+
+    Uint8 packet[SPECTATOR_MAX_PACKET];
+    int size = spectator_encode(packet, keyframe ? SPECTATOR_KEYFRAME : SPECTATOR_DELTA, state->tick, fields,
+                                spectator.keyframe);
+    Uint32 head = SDL_AtomicGet(&spectator.head);
+    if (SPECTATOR_RING - (head - (Uint32)SDL_AtomicGet(&spectator.tail)) < (Uint32)size) {
+        spectator.lost++; // Main thread stalled; a lost delta is resent next tick, a lost keyframe retried
+        return;
+    }
+    for (int i = 0; i < size; i++) {
+        spectator.ring[(head + i) % SPECTATOR_RING] = packet[i];
+    }
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&spectator.head, head + size);
+
+    if (keyframe) {
+        memcpy(spectator.keyframe, fields, sizeof(fields));
+        spectator.keyTick = state->tick;
+        spectator.needKeyframe = false;
+    }
+    memcpy(spectator.last, fields, sizeof(fields));
+}
+
+void spectator_queue(Spectator *viewer, const Uint8 *packet, int size) {
+    bool keyframe = packet[1] == SPECTATOR_KEYFRAME;
+    if (viewer->waitKeyframe && !keyframe) {
+        viewer->skipped++;
+        return;
+    }
+    if (viewer->backlogBytes + size > SPECTATOR_BACKLOG) {
+        viewer->skipped++;
+        viewer->waitKeyframe |= keyframe;
+        return;
+    }
+    memcpy(viewer->backlog + viewer->backlogBytes, packet, size);
+    viewer->backlogBytes += size;
+    viewer->waitKeyframe = false;
+}
+
+// Send what the socket takes without blocking; false when the viewer is gone
+bool spectator_flush(Spectator *viewer) {
+    while (viewer->backlogBytes > 0) {
+        int sent = send(viewer->socket, (const char *)viewer->backlog, viewer->backlogBytes, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return sent < 0 && SOCKET_WOULD_BLOCK;
+        }
+        memmove(viewer->backlog, viewer->backlog + sent, viewer->backlogBytes - sent);
+        viewer->backlogBytes -= sent;
+    }
+    return true;
+}
+
+// Main thread, once per loop: accept viewers and fan the new packets out
+void spectator_pump(void) {
+    if (!spectator.enabled) {
+        return;
+    }
+    while (spectator.listener != NO_SOCKET && spectator.viewerCount < MAX_SPECTATORS) {
+        Socket client = accept(spectator.listener, NULL, NULL);
+        if (client == NO_SOCKET) {
+            break;
+        }
+        Spectator *viewer = &spectator.viewers[spectator.viewerCount++];
+        memset(viewer, 0, sizeof(*viewer));
+        viewer->socket = client;
+        viewer->waitKeyframe = true; // joins at the next keyframe
+        spectator_set_nonblocking(client);
+        SpectatorHeader header;
+        spectator_header(&header);
+        memcpy(viewer->backlog, &header, sizeof(header));
+        viewer->backlogBytes = sizeof(header);
+    }
+
+    Uint32 tail = SDL_AtomicGet(&spectator.tail);
+    Uint32 head = SDL_AtomicGet(&spectator.head);
+    SDL_MemoryBarrierAcquire();
+    while (tail != head) {
+        Uint8 packet[SPECTATOR_MAX_PACKET];
+        int size = spectator.ring[tail % SPECTATOR_RING] + 1;
+        for (int i = 0; i < size; i++) {
+            packet[i] = spectator.ring[(tail + i) % SPECTATOR_RING];
+        }
+        tail += size;
+        spectator.packets++;
+        spectator.keyframes += packet[1] == SPECTATOR_KEYFRAME;
+        spectator.bytes += size;
+        if (spectator.file) {
+            fwrite(packet, 1, size, spectator.file);
+        }
+        for (int v = 0; v < spectator.viewerCount; v++) {
+            spectator_queue(&spectator.viewers[v], packet, size);
+        }
+    }
+    SDL_AtomicSet(&spectator.tail, tail);
+
+    for (int v = 0; v < spectator.viewerCount;) {
+        if (spectator_flush(&spectator.viewers[v])) {
+            v++;
+        } else {
+            close_socket(spectator.viewers[v].socket);
+            spectator.viewers[v] = spectator.viewers[--spectator.viewerCount];
+        }
+    }
+}
+
+void spectator_close(void) {
+    if (!spectator.enabled) {
+        return;
+    }
+    spectator_pump();
+    for (int v = 0; v < spectator.viewerCount; v++) {
+        close_socket(spectator.viewers[v].socket);
+    }
+    if (spectator.listener != NO_SOCKET) {
+        close_socket(spectator.listener);
+    }
+    if (spectator.file) {
+        fclose(spectator.file);
+    }
+    double seconds = (double)spectator.ticks / TICK_RATE;
+    printf("Spectator stream: %u packets (%u keyframes), %llu bytes, %.0f bytes/s over %.1f s of match, lost %u\n",
+           spectator.packets, spectator.keyframes, (unsigned long long)spectator.bytes,
+           seconds > 0 ? spectator.bytes / seconds : 0.0, seconds, spectator.lost);
+}
+
+
+// ---- Match telemetry ----
+
+// Hits, moves, specials and round results for offline analysis (see
+// telemetry.h and tools/telemetry.c). The sim thread is the only producer:
+// it drops events into a lock-free ring and never waits. A flusher thread
+// wakes every TELEMETRY_FLUSH_MS and appends whatever has accumulated as one
+// batch. (match_enter also records, but before the sim thread exists.)
+#define TELEMETRY_RING 4096 // events, a power of two
+#define TELEMETRY_FLUSH_MS 250
+
+typedef struct {
+    bool enabled;
+    TelemetryEvent ring[TELEMETRY_RING];
+    SDL_atomic_t head;       // events recorded, advanced by the producer
+    SDL_atomic_t tail;       // events written, advanced by the flusher
+    SDL_atomic_t dropped;    // ring full; reported in the next batch
+    Uint16 match;
+
+    FILE *file;
+    SDL_Thread *thread;
+    SDL_sem *wake;
+    SDL_atomic_t quit;
+    Uint64 events;
+    Uint32 batches;
+    Uint32 totalDropped;
+} Telemetry;
+
+Telemetry telemetry;
+
+void telemetry_record(const MatchState *state, int type, int player, int move, int damage) {
+    if (!telemetry.enabled) {
+        return;
+    }
+    Uint32 head = SDL_AtomicGet(&telemetry.head);
+    if (head - (Uint32)SDL_AtomicGet(&telemetry.tail) == TELEMETRY_RING) {
+        SDL_AtomicAdd(&telemetry.dropped, 1);
+        return;
+    }
+    const Player *actor = player == 2 ? &state->player2 : &state->player1;
+    const Player *other = player == 2 ? &state->player1 : &state->player2;
+    TelemetryEvent *event = &telemetry.ring[head % TELEMETRY_RING];
+    event->tick = state->tick;
+    event->match = telemetry.match;
+    event->type = (Uint8)type;
+    event->player = (Uint8)player;
+    event->move = (Uint8)move;
+    event->reserved = 0;
+    event->damage = (Sint16)damage;
+    event->attackerX = (Sint16)actor->rect.x;
+    event->attackerY = (Sint16)actor->rect.y;
+    event->defenderX = (Sint16)other->rect.x;
+    event->defenderY = (Sint16)other->rect.y;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&telemetry.head, head + 1);
+}
+
+// Write everything recorded so far as one batch; false when nothing was pending
+bool telemetry_flush(void) {
+    Uint32 tail = SDL_AtomicGet(&telemetry.tail);
+    Uint32 head = SDL_AtomicGet(&telemetry.head);
+    SDL_MemoryBarrierAcquire();
+    TelemetryBatch batch = { head - tail, (Uint32)SDL_AtomicSet(&telemetry.dropped, 0) };
+    if (batch.count == 0 && batch.dropped == 0) {
+        return false;
+    }
+    fwrite(&batch, sizeof(batch), 1, telemetry.file);
+    // At most two contiguous runs, split where the ring wraps
+    Uint32 start = tail % TELEMETRY_RING;
+    Uint32 first = SDL_min(batch.count, TELEMETRY_RING - start);
+    fwrite(&telemetry.ring[start], sizeof(TelemetryEvent), first, telemetry.file);
+    fwrite(&telemetry.ring[0], sizeof(TelemetryEvent), batch.count - first, telemetry.file);
+    fflush(telemetry.file);
+    SDL_AtomicSet(&telemetry.tail, head);
+    telemetry.events += batch.count;
+    telemetry.totalDropped += batch.dropped;
+    telemetry.batches++;
+    return true;
+}
+
+int telemetry_flusher(void *data) {
+    (void)data;
+    while (!SDL_AtomicGet(&telemetry.quit)) {
+        SDL_SemWaitTimeout(telemetry.wake, TELEMETRY_FLUSH_MS);
+        telemetry_flush();
+    }
+    telemetry_flush(); // whatever was recorded before the stop
+    return 0;
+}
+
+bool telemetry_open(const char *path, const FrameData *data) {
+    telemetry.file = fopen(path, "wb");
+    if (!telemetry.file) {
+        SDL_Log("Unable to write telemetry log %s", path);
+        return false;
+    }
+    TelemetryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TELEMETRY_MAGIC, sizeof(header.magic));
+    header.version = TELEMETRY_VERSION;
+    header.tickRate = TICK_RATE;
+    header.moveCount = data->moveCount;
+    for (int i = 0; i < data->moveCount && i < TELEMETRY_MAX_MOVES; i++) {
+        memcpy(header.moveNames[i], data->moves[i].name, sizeof(header.moveNames[i]));
+    }
+    fwrite(&header, sizeof(header), 1, telemetry.file);
+
+    telemetry.wake = SDL_CreateSemaphore(0);
+    telemetry.thread = SDL_CreateThread(telemetry_flusher, "telemetry", NULL);
+    if (!telemetry.thread) {
+        fclose(telemetry.file);
+        return false;
+    }
+    telemetry.enabled = true;
+    return true;
+}
+
+// Number the next match; called before its sim thread starts
+void telemetry_match_start(const MatchState *state) {
+    telemetry.match++;
+    telemetry_record(state, TELEMETRY_MATCH_START, 0, 0, 0);
+}
+
+void telemetry_close(void) {
+    if (!telemetry.enabled) {
+        return;
+    }
+    SDL_AtomicSet(&telemetry.quit, 1);
+    SDL_SemPost(telemetry.wake);
+    SDL_WaitThread(telemetry.thread, NULL);
+    SDL_DestroySemaphore(telemetry.wake);
+    fclose(telemetry.file);
+    telemetry.enabled = false;
+    printf("Telemetry: %llu events in %u batches over %u match(es), dropped %u\n",
+           (unsigned long long)telemetry.events, telemetry.batches, telemetry.match, telemetry.totalDropped);
+}
+
+
+// ---- Shared-memory state export ----
+
+// Overlays, bots and the monitoring agent read the match straight out of a
+// POSIX shared-memory object (--shm, layout in sharedstate.h) instead of
+// scraping the window. The sim thread copies the state in under a seqlock
+// after every tick, so a reader sees the tick within microseconds and can
+// never stall the game. The same mapping carries a ring of player 2 inputs
+// that the sim thread drains at the top of each tick, next to the keyboard
+// queue.
+typedef struct {
+    bool enabled;
+    SharedState *map;
+    Uint32 held;             // external player 2 buttons as INPUT_P2_* (sim thread)
+    Uint32 tail;             // next input slot to read; the map's inputTail is only a copy for the writer
+    Uint32 applied;
+    Uint32 overruns;         // times the writer's head ran more than a ring ahead
+    Uint64 published;
+    Uint64 lastInputNs;
+} SharedExport;
+
+SharedExport shared;
+
+Uint64 shared_now_ns(void) {
+#ifdef _WIN32
+    return 0;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (Uint64)now.tv_sec * 1000000000ull + (Uint64)now.tv_nsec;
+#endif
+}
+
+bool shared_open(void) {
+#ifdef _WIN32
+    SDL_Log("--shm needs POSIX shared memory; not available on this platform");
+    return false;
+#else
+    int fd = shm_open(SHAREDSTATE_NAME, O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+        SDL_Log("Unable to create shared memory %s: %s", SHAREDSTATE_NAME, strerror(errno));
+        return false;
+    }
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, sizeof(SharedState)) == 0) {
+        map = mmap(NULL, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd); // the mapping keeps the object alive
+    if (map == MAP_FAILED) {
+        SDL_Log("Unable to map shared memory %s: %s", SHAREDSTATE_NAME, strerror(errno));
+        shm_unlink(SHAREDSTATE_NAME);
+        return false;
+    }
+    shared.map = map;
+    memset(shared.map, 0, sizeof(SharedState));
+    shared.map->version = SHAREDSTATE_VERSION;
+    shared.map->size = sizeof(SharedState);
+    shared.map->pid = (Uint32)getpid();
+    // Magic last: a reader that sees it sees an initialised region
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(shared.map->magic, SHAREDSTATE_MAGIC, sizeof(shared.map->magic));
+    shared.enabled = true;
+    return true;
+#endif
+}
+
+// Drop inputs sent while no match was running; called before the sim thread starts
+void shared_restart(void) {
+    if (!shared.enabled) {
+        return;
+    }
+    shared.held = 0;
+    shared.tail = __atomic_load_n(&shared.map->inputHead, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&shared.map->inputTail, shared.tail, __ATOMIC_RELEASE);
+}
+
+// Sim thread, before the step: external player 2 buttons, plus any pressed
+// and released since the last tick. A released button counts as a key
+// release, the same as on the keyboard. Any client can write the map, so
+// only the head is read from it, and a head more than a ring ahead skips
+// to the newest ring's worth of inputs.
+Uint32 shared_input(void) {
+    if (!shared.enabled) {
+        return 0;
+    }
+    static const Uint32 bits[6] = {
+        INPUT_P2_JUMP, INPUT_P2_LEFT, INPUT_P2_RIGHT, INPUT_P2_PUNCH, INPUT_P2_KICK, INPUT_P2_SPECIAL
+    };
+    Uint32 tail = shared.tail;
+    Uint32 head = __atomic_load_n(&shared.map->inputHead, __ATOMIC_ACQUIRE);
+    if (head - tail > SHAREDSTATE_INPUTS) {
+        tail = head - SHAREDSTATE_INPUTS;
+        shared.overruns++;
+    }
+    Uint32 buttons = 0;
+    for (; tail != head; tail++) {
+        const SharedInput *input = &shared.map->inputs[tail % SHAREDSTATE_INPUTS];
+        Uint32 held = 0;
+        for (int i = 0; i < 6; i++) {
+            held |= input->buttons & (1u << i) ? bits[i] : 0;
+        }
+        if (shared.held & ~held) {
+            buttons |= INPUT_KEY_RELEASED;
+        }
+        buttons |= held;
+        shared.held = held;
+        shared.lastInputNs = input->sentNs;
+        shared.applied++;
+    }
+    shared.tail = tail;
+    __atomic_store_n(&shared.map->inputTail, tail, __ATOMIC_RELEASE);
+    return buttons | shared.held;
+}
+
+// Sim thread, after every tick
+void shared_publish(const MatchState *state) {
+    if (!shared.enabled) {
+        return;
+    }
+    SharedMatch match;
+    memset(&match, 0, sizeof(match));
+    match.tick = state->tick;
+    match.inMatch = 1;
+    match.winner = state->winner;
+    match.inputsApplied = shared.applied;
+    match.lastInputSentNs = shared.lastInputNs;
+    const Player *players[2] = { &state->player1, &state->player2 };
+    const Sprite *sprites[2] = { &state->sprite1, &state->sprite2 };
+    const Projectile *projectiles[2] = { &state->player1Projectile, &state->player2Projectile };
+    const int health[2] = { state->player1_health, state->player2_health };
+    for (int p = 0; p < 2; p++) {
+        SharedFighter *f = &match.fighters[p];
+        const Sprite *sprite = sprites[p];
+        f->x = players[p]->rect.x;
+        f->y = players[p]->rect.y;
+        f->w = players[p]->rect.w;
+        f->h = players[p]->rect.h;
+        f->health = health[p];
+        f->animation = sprite->playingAnimation;
+        f->frame = sprite->currentFrame - sprite->anims->clips[sprite->playingAnimation].first;
+        f->projectileActive = projectiles[p]->active;
+        f->projectileX = projectiles[p]->rect.x;
+        f->projectileY = projectiles[p]->rect.y;
+    }
+    match.publishNs = shared_now_ns();
+    sharedstate_write(shared.map, &match);
+    shared.published++;
+}
+
+// After the sim thread stopped: tell readers the state is stale
+void shared_match_end(void) {
+    if (!shared.enabled) {
+        return;
+    }
+    SharedMatch match = shared.map->match;
+    match.inMatch = 0;
+    sharedstate_write(shared.map, &match);
+}
+
+void shared_close(void) {
+#ifndef _WIN32
+    if (!shared.enabled) {
+        return;
+    }
+    munmap(shared.map, sizeof(SharedState));
+    shm_unlink(SHAREDSTATE_NAME);
+    shared.enabled = false;
+    printf("Shared memory: %llu ticks published, %u player 2 inputs applied, %u ring overruns\n",
+           (unsigned long long)shared.published, shared.applied, shared.overruns);
+#endif
+}
+
+
+// ---- Match replays ----
+
+// --record DIR saves every match as <dir>/replay_NNNNN.rpl (see replay.h)
+// for --verify-replays to re-simulate later, and --replay-db adds it to the
+// replay database. The sim thread appends the buttons of each tick it steps,
+// folds the resulting state into a rolling hash and, for the database, keeps
+// keyframes and damage by move; the replay is written by match_exit once the
+// thread stopped. The buffers are kept between matches, so only a long
+// match reallocates.
+#define REPLAY_CHECK_INTERVAL 30  // ticks between stored checksums
+#define REPLAY_RESERVE (TICK_RATE * 120)
+#define REPLAY_HASH_SEED 14695981039346656037ull
+
+typedef struct {
+    const char *directory;   // --record, or NULL
+    int next;                // file number to try next
+    Uint32 *buttons;         // NULL: not recording
+    int ticks;
+    int capacity;
+    Uint64 *checksums;
+    int checks;
+    int checkCapacity;
+    ReplayDbKeyframe *keyframes;
+    int keyframeCount;
+    int keyframeCapacity;
+    Uint32 hits[2];
+    Sint32 damage[2][REPLAYDB_MOVES + 1];
+    Uint64 hash;
+    bool overflow;           // out of memory: this match is not saved
+    int saved;
+} ReplayRecorder;
+
+ReplayRecorder recorder;
+
+Uint64 replay_fold_int(Uint64 hash, Sint32 value) {
+    Uint32 bits = (Uint32)value;
+    for (int i = 0; i < 4; i++) {
+        hash = (hash ^ ((bits >> (i * 8)) & 0xFF)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// FNV-1a over everything a tick can change, field by field so padding,
+// texture pointers and tick timing stay out of it
+Uint64 replay_fold(Uint64 hash, const MatchState *state) {
+    const Player *players[2] = { &state->player1, &state->player2 };
+    const Projectile *projectiles[2] = { &state->player1Projectile, &state->player2Projectile };
+    const Sprite *sprites[2] = { &state->sprite1, &state->sprite2 };
+    hash = replay_fold_int(hash, (Sint32)state->tick);
+    for (int p = 0; p < 2; p++) {
+        const Player *player = players[p];
+        hash = replay_fold_int(hash, player->rect.x);
+        hash = replay_fold_int(hash, player->rect.y);
+        hash = replay_fold_int(hash, player->rect.w);
+        hash = replay_fold_int(hash, player->rect.h);
+        hash = replay_fold_int(hash, player->velocityY);
+        hash = replay_fold_int(hash, player->onGround);
+        hash = replay_fold_int(hash, player->move);
+        hash = replay_fold_int(hash, player->attackTimer);
+        hash = replay_fold_int(hash, player->hitLanded);
+        hash = replay_fold_int(hash, projectiles[p]->rect.x);
+        hash = replay_fold_int(hash, projectiles[p]->rect.y);
+        hash = replay_fold_int(hash, projectiles[p]->velocityX);
+        hash = replay_fold_int(hash, projectiles[p]->active);
+        hash = replay_fold_int(hash, sprites[p]->currentAnimation);
+        hash = replay_fold_int(hash, sprites[p]->playingAnimation);
+        hash = replay_fold_int(hash, sprites[p]->currentFrame);
+        hash = replay_fold_int(hash, sprites[p]->frameTime);
+    }
+    hash = replay_fold_int(hash, state->player1_health);
+    hash = replay_fold_int(hash, state->player2_health);
+    return replay_fold_int(hash, state->winner);
+}
+
+// Copy the state replay_fold covers into a database keyframe
+void replay_keyframe(const MatchState *state, Uint64 hash, ReplayDbKeyframe *keyframe) {
+    const Player *players[2] = { &state->player1, &state->player2 };
+    const Projectile *projectiles[2] = { &state->player1Projectile, &state->player2Projectile };
+    const Sprite *sprites[2] = { &state->sprite1, &state->sprite2 };
+    const int health[2] = { state->player1_health, state->player2_health };
+    keyframe->tick = state->tick;
+    keyframe->winner = state->winner;
+    keyframe->hash = hash;
+    for (int p = 0; p < 2; p++) {
+        ReplayDbFighter *f = &keyframe->fighters[p];
+        f->x = players[p]->rect.x;
+        f->y = players[p]->rect.y;
+        f->w = players[p]->rect.w;
+        f->h = players[p]->rect.h;
+        f->velocityY = players[p]->velocityY;
+        f->onGround = players[p]->onGround;
+        f->move = players[p]->move;
+        f->attackTimer = players[p]->attackTimer;
+        f->hitLanded = players[p]->hitLanded;
+        f->projectileX = projectiles[p]->rect.x;
+        f->projectileY = projectiles[p]->rect.y;
+        f->projectileVelocityX = projectiles[p]->velocityX;
+        f->projectileActive = projectiles[p]->active;
+        f->animation = sprites[p]->currentAnimation;
+        f->playingAnimation = sprites[p]->playingAnimation;
+        f->frame = sprites[p]->currentFrame;
+        f->frameTime = sprites[p]->frameTime;
+        f->spriteX = sprites[p]->x;
+        f->spriteY = sprites[p]->y;
+        f->health = health[p];
+    }
+}
+
+// Recording buffers, shared by --record and --replay-db
+bool replay_reserve(void) {
+    if (recorder.buttons) {
+        return true;
+    }
+    recorder.buttons = SDL_malloc(sizeof(Uint32) * REPLAY_RESERVE);
+    recorder.checksums = SDL_malloc(sizeof(Uint64) * (REPLAY_RESERVE / REPLAY_CHECK_INTERVAL));
+    recorder.keyframes = SDL_malloc(sizeof(ReplayDbKeyframe) * (REPLAY_RESERVE / REPLAYDB_KEYFRAME_INTERVAL));
+    if (!recorder.buttons || !recorder.checksums || !recorder.keyframes) {
+        SDL_free(recorder.buttons);
+        SDL_free(recorder.checksums);
+        SDL_free(recorder.keyframes);
+        recorder.buttons = NULL;
+        return false;
+    }
+    recorder.capacity = REPLAY_RESERVE;
+    recorder.checkCapacity = REPLAY_RESERVE / REPLAY_CHECK_INTERVAL;
+    recorder.keyframeCapacity = REPLAY_RESERVE / REPLAYDB_KEYFRAME_INTERVAL;
+    return true;
+}
+
+bool replay_open(const char *directory) {
+#ifdef _WIN32
+    bool ok = CreateDirectoryA(directory, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    bool ok = mkdir(directory, 0755) == 0 || errno == EEXIST;
+#endif
+    if (!ok || !replay_reserve()) {
+        SDL_Log("Unable to record replays to %s", directory);
+        return false;
+    }
+    recorder.directory = directory;
+    return true;
+}
+
+// Before the sim thread starts, with the match in its initial state
+void replay_restart(const MatchState *state) {
+    recorder.ticks = 0;
+    recorder.checks = 0;
+    recorder.hash = REPLAY_HASH_SEED;
+    recorder.overflow = false;
+    memset(recorder.hits, 0, sizeof(recorder.hits));
+    memset(recorder.damage, 0, sizeof(recorder.damage));
+    recorder.keyframeCount = 0;
+    if (recorder.buttons) {
+        replay_keyframe(state, recorder.hash, &recorder.keyframes[recorder.keyframeCount++]);
+    }
+}
+
+// Sim thread: player's move (or fireball) hit for damage
+void replay_hit(int player, int move, int damage) {
+    int slot = move == TELEMETRY_PROJECTILE ? REPLAYDB_PROJECTILE : move;
+    if (recorder.buttons && slot >= 0 && slot <= REPLAYDB_PROJECTILE) {
+        recorder.hits[player - 1]++;
+        recorder.damage[player - 1][slot] += damage;
+    }
+}
+
+bool replay_grow(void **buffer, int *capacity, size_t size) {
+    void *grown = SDL_realloc(*buffer, size * *capacity * 2);
+    if (!grown) {
+        return false;
+    }
+    *buffer = grown;
+    *capacity *= 2;
+    return true;
+}
+
+// Sim thread, after each tick it stepped
+void replay_record(const MatchState *state, Uint32 buttons) {
+    if (!recorder.buttons || recorder.overflow) {
+        return;
+    }
+    if ((recorder.ticks == recorder.capacity &&
+         !replay_grow((void **)&recorder.buttons, &recorder.capacity, sizeof(Uint32))) ||
+        (recorder.checks == recorder.checkCapacity &&
+         !replay_grow((void **)&recorder.checksums, &recorder.checkCapacity, sizeof(Uint64))) ||
+        (recorder.keyframeCount == recorder.keyframeCapacity &&
+         !replay_grow((void **)&recorder.keyframes, &recorder.keyframeCapacity, sizeof(ReplayDbKeyframe)))) {
+        SDL_Log("Replay not saved: out of memory after %d ticks", recorder.ticks);
+        recorder.overflow = true;
+        return;
+    }
+    recorder.buttons[recorder.ticks++] = buttons;
+    recorder.hash = replay_fold(recorder.hash, state);
+    if (state->tick % REPLAY_CHECK_INTERVAL == 0) {
+        recorder.checksums[recorder.checks++] = recorder.hash;
+    }
+    if (state->tick % REPLAYDB_KEYFRAME_INTERVAL == 0) {
+        replay_keyframe(state, recorder.hash, &recorder.keyframes[recorder.keyframeCount++]);
+    }
+}
+
+void replay_header(const MatchState *state, ReplayHeader *header) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, REPLAY_MAGIC, sizeof(header->magic));
+    header->version = REPLAY_VERSION;
+    header->tickRate = TICK_RATE;
+    header->checkInterval = REPLAY_CHECK_INTERVAL;
+    header->ticks = recorder.ticks;
+    header->winner = state->winner;
+    header->health[0] = state->player1_health;
+    header->health[1] = state->player2_health;
+    header->finalHash = recorder.hash;
+    header->recordedAt = (Uint64)time(NULL);
+}
+
+// After the sim thread stopped: write the match out under the next free number
+void replay_save(const MatchState *state) {
+    if (!recorder.directory || recorder.ticks == 0 || recorder.overflow) {
+        return;
+    }
+    char path[280];
+    FILE *file = NULL;
+    for (; !file; recorder.next++) {
+        snprintf(path, sizeof(path), "%s/replay_%05d.rpl", recorder.directory, recorder.next);
+        FILE *existing = fopen(path, "rb");
+        if (existing) {
+            fclose(existing);
+            continue;
+        }
+        if (!(file = fopen(path, "wb"))) {
+            SDL_Log("Unable to write replay %s", path);
+            return;
+        }
+    }
+    ReplayHeader header;
+    replay_header(state, &header);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(recorder.buttons, sizeof(Uint32), recorder.ticks, file) == (size_t)recorder.ticks &&
+              fwrite(recorder.checksums, sizeof(Uint64), recorder.checks, file) == (size_t)recorder.checks;
+    if (fclose(file) != 0 || !ok) {
+        SDL_Log("Unable to write replay %s", path);
+        remove(path);
+        return;
+    }
+    recorder.saved++;
+}
+
+void replay_close(void) {
+    if (recorder.directory) {
+        printf("Replays: %d match(es) recorded to %s\n", recorder.saved, recorder.directory);
+    }
+    SDL_free(recorder.buttons);
+    SDL_free(recorder.checksums);
+    SDL_free(recorder.keyframes);
+    recorder.buttons = NULL;
+    recorder.directory = NULL;
+}
+
+
+// ---- Replay database ----
+
+// --replay-db DIR appends every match to a replay database (layout in
+// replaydb.h) for tools/replaydb.c to query and --replay-seek to jump into.
+// The record is copied into the mapped segment and committed by bumping
+// its `used` counter, then the match's metadata is appended to the index.
+// Both happen in match_exit, after the sim thread stopped. POSIX only,
+// like --shm.
+typedef struct {
+    bool enabled;
+    const char *directory;
+    int segment;             // number of the mapped segment
+    Uint8 *map;              // REPLAYDB_SEGMENT_SIZE bytes of it
+    FILE *index;
+    Uint32 entries;          // in the index, this session's included
+    int appended;
+} ReplayDb;
+
+ReplayDb replayDb;
+
+// Bytes of a record with this many ticks and keyframes
+Uint64 replaydb_record_size(Uint32 ticks, Uint32 keyframes, Uint32 checkInterval) {
+    return sizeof(ReplayHeader) + (((Uint64)ticks * sizeof(Uint32) + 7) & ~7ull) +
+           (Uint64)(ticks / checkInterval) * sizeof(Uint64) + (Uint64)keyframes * sizeof(ReplayDbKeyframe);
+}
+
+// Map segment number `segment` of the database, read-write or read-only;
+// a new segment is created when writable. NULL on failure.
+Uint8 *replaydb_map(const char *directory, int segment, bool writable) {
+#ifdef _WIN32
+    (void)directory;
+    (void)segment;
+    (void)writable;
+    return NULL;
+#else
+    char path[280];
+    snprintf(path, sizeof(path), "%s/segment_%04d.rdb", directory, segment);
+    int fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    bool fresh = fstat(fd, &info) == 0 && info.st_size == 0;
+    if (fresh && (!writable || ftruncate(fd, REPLAYDB_SEGMENT_SIZE) != 0)) {
+        close(fd);
+        return NULL;
+    }
+    if (!fresh && (fstat(fd, &info) != 0 || (Uint64)info.st_size != REPLAYDB_SEGMENT_SIZE)) {
+        close(fd);
+        return NULL;
+    }
+    Uint8 *map = mmap(NULL, REPLAYDB_SEGMENT_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    ReplayDbSegment *header = (ReplayDbSegment *)map;
+    if (fresh) {
+        memcpy(header->magic, REPLAYDB_SEGMENT_MAGIC, sizeof(header->magic));
+        header->version = REPLAYDB_VERSION;
+        header->size = REPLAYDB_SEGMENT_SIZE;
+        header->used = sizeof(ReplayDbSegment);
+    }
+    if (memcmp(header->magic, REPLAYDB_SEGMENT_MAGIC, 4) != 0 || header->version != REPLAYDB_VERSION ||
+        header->size != REPLAYDB_SEGMENT_SIZE || header->used < sizeof(ReplayDbSegment) || header->used > header->size) {
+        munmap(map, REPLAYDB_SEGMENT_SIZE);
+        return NULL;
+    }
+    return map;
+#endif
+}
+
+void replaydb_unmap(Uint8 *map) {
+#ifndef _WIN32
+    if (map) {
+        munmap(map, REPLAYDB_SEGMENT_SIZE);
+    }
+#endif
+}
+
+// Open (or start) the database for appending. Its damage columns follow the
+// frame data moves, so an index built from other frame data is refused.
+bool replaydb_open(const char *directory, const FrameData *data) {
+#ifdef _WIN32
+    (void)directory;
+    (void)data;
+    SDL_Log("The replay database is not supported on this platform");
+    return false;
+#else
+    bool ok = mkdir(directory, 0755) == 0 || errno == EEXIST;
+    char path[280];
+    snprintf(path, sizeof(path), "%s/index.rdx", directory);
+    ReplayDbIndex header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, REPLAYDB_INDEX_MAGIC, sizeof(header.magic));
+    header.version = REPLAYDB_VERSION;
+    header.moveCount = SDL_min(data->moveCount, REPLAYDB_MOVES);
+    for (Uint32 i = 0; i < header.moveCount; i++) {
+        memcpy(header.moveNames[i], data->moves[i].name, sizeof(header.moveNames[i]));
+    }
+    replayDb.index = ok ? fopen(path, "rb+") : NULL;
+    if (!replayDb.index && ok) {
+        replayDb.index = fopen(path, "wb+");
+        ok = replayDb.index && fwrite(&header, sizeof(header), 1, replayDb.index) == 1;
+    }
+    ReplayDbIndex existing;
+    ok = ok && replayDb.index && fseek(replayDb.index, 0, SEEK_SET) == 0 &&
+         fread(&existing, sizeof(existing), 1, replayDb.index) == 1 &&
+         memcmp(existing.magic, REPLAYDB_INDEX_MAGIC, 4) == 0 && existing.version == REPLAYDB_VERSION;
+    if (ok && memcmp(&existing, &header, sizeof(header)) != 0) {
+        SDL_Log("Replay database %s was built from different frame data", directory);
+        ok = false;
+    }
+    if (ok && fseek(replayDb.index, 0, SEEK_END) == 0) {
+        // A torn last entry from a crash is overwritten by the next append
+        long size = ftell(replayDb.index);
+        replayDb.entries = size > (long)sizeof(ReplayDbIndex) ? (size - sizeof(ReplayDbIndex)) / sizeof(ReplayDbEntry) : 0;
+    }
+
+    // Append to the newest segment
+    replayDb.directory = directory;
+    replayDb.segment = 0;
+    for (;; replayDb.segment++) {
+        snprintf(path, sizeof(path), "%s/segment_%04d.rdb", directory, replayDb.segment + 1);
+        struct stat info;
+        if (stat(path, &info) != 0) {
+            break;
+        }
+    }
+    replayDb.map = ok ? replaydb_map(directory, replayDb.segment, true) : NULL;
+    if (!ok || !replayDb.map || !replay_reserve()) {
+        SDL_Log("Unable to open the replay database in %s", directory);
+        replaydb_unmap(replayDb.map);
+        replayDb.map = NULL;
+        if (replayDb.index) {
+            fclose(replayDb.index);
+            replayDb.index = NULL;
+        }
+        return false;
+    }
+    replayDb.enabled = true;
+    return true;
+#endif
+}
+
+void replaydb_append(const MatchState *state) {
+    if (!replayDb.map || recorder.ticks == 0 || recorder.overflow) {
+        return;
+    }
+    Uint64 length = replaydb_record_size(recorder.ticks, recorder.keyframeCount, REPLAY_CHECK_INTERVAL);
+    if (length > REPLAYDB_SEGMENT_SIZE - sizeof(ReplayDbSegment)) {
+        SDL_Log("Replay of %d ticks does not fit a database segment", recorder.ticks);
+        return;
+    }
+    ReplayDbSegment *segment = (ReplayDbSegment *)replayDb.map;
+    if (segment->used + length > segment->size) {
+        Uint8 *next = replaydb_map(replayDb.directory, replayDb.segment + 1, true);
+        if (!next) {
+            SDL_Log("Unable to start replay database segment %d", replayDb.segment + 1);
+            return;
+        }
+        replaydb_unmap(replayDb.map);
+        replayDb.map = next;
+        replayDb.segment++;
+        segment = (ReplayDbSegment *)next;
+    }
+
+    ReplayHeader header;
+    replay_header(state, &header);
+    Uint64 offset = segment->used;
+    Uint8 *record = replayDb.map + offset;
+    memcpy(record, &header, sizeof(header));
+    record += sizeof(header);
+    memcpy(record, recorder.buttons, sizeof(Uint32) * recorder.ticks);
+    record += ((Uint64)recorder.ticks * sizeof(Uint32) + 7) & ~7ull;
+    memcpy(record, recorder.checksums, sizeof(Uint64) * recorder.checks);
+    record += sizeof(Uint64) * recorder.checks;
+    memcpy(record, recorder.keyframes, sizeof(ReplayDbKeyframe) * recorder.keyframeCount);
+    SDL_MemoryBarrierRelease();
+    segment->used = offset + length;
+
+    ReplayDbEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.segment = replayDb.segment;
+    entry.keyframes = recorder.keyframeCount;
+    entry.offset = offset;
+    entry.length = length;
+    entry.recordedAt = header.recordedAt;
+    entry.ticks = header.ticks;
+    entry.winner = header.winner;
+    entry.health[0] = header.health[0];
+    entry.health[1] = header.health[1];
+    entry.characters[0] = REPLAYDB_RYU;
+    entry.characters[1] = REPLAYDB_KEN;
+    memcpy(entry.hits, recorder.hits, sizeof(entry.hits));
+    memcpy(entry.damage, recorder.damage, sizeof(entry.damage));
+    if (fseek(replayDb.index, (long)(sizeof(ReplayDbIndex) + (Uint64)replayDb.entries * sizeof(ReplayDbEntry)), SEEK_SET) != 0 ||
+        fwrite(&entry, sizeof(entry), 1, replayDb.index) != 1 || fflush(replayDb.index) != 0) {
+        SDL_Log("Unable to add the replay to the database index");
+        return;
+    }
+    replayDb.entries++;
+    replayDb.appended++;
+}
+
+void replaydb_close(void) {
+    if (!replayDb.enabled) {
+        return;
+    }
+    replaydb_unmap(replayDb.map);
+    fclose(replayDb.index);
+    replayDb.map = NULL;
+    replayDb.enabled = false;
+    printf("Replay database: %d match(es) added to %s, %u in all\n", replayDb.appended, replayDb.directory,
+           replayDb.entries);
+}
+
+
+// ---- Credits video ----
+
+void intro_enter(Game *game) {
+    game->introFrame = 0;
+    game->introTexture = NULL;
+}
+
+void intro_exit(Game *game) {
+    texture_destroy(game->introTexture);
+    game->introTexture = NULL;
+}
+
+void intro_event(Game *game, SDL_Event *event) {
+    if (event->type == SDL_KEYDOWN &&
+        (event->key.keysym.sym == SDLK_ESCAPE || event->key.keysym.sym == SDLK_RETURN)) {
+        scene_switch(game, &menuScene);
+    }
+}
+
+void intro_update(Game *game, Uint32 now) {
+    // Pick the frame from elapsed time so slow frames skip ahead instead of stretching the video
+    int frame = scene_elapsed(game, now) / INTRO_FRAME_DELAY + 1;
+    if (frame > FRAME_COUNT) {
+        scene_switch(game, &menuScene);
+        return;
+    }
+    if (frame == game->introFrame) {
+        return;
+    }
+    game->introFrame = frame;
+
+    // Generate the file path dynamically
+    const char *frame_path = arena_printf(&frameArena, "rsrc/animation/Credits/%d.jpg", frame);
+
+    int previous = memory_tag(MEMORY_VIDEO);
+    SDL_Surface *image = surface_track(IMG_Load_RW(asset_open(frame_path), 1));
+    if (!image) {
+        printf("IMG_Load Error: %s\n", IMG_GetError());
+        memory_tag(previous);
+        return; // Keep showing the previous frame
+    }
+    // Every frame has the same size and format, so one streaming texture is
+    // uploaded into for the whole video instead of a new texture per frame
+    Uint32 format = 0;
+    int w = 0, h = 0;
+    if (game->introTexture) {
+        SDL_QueryTexture(game->introTexture, &format, NULL, &w, &h);
+    }
+    if (!game->introTexture || format != image->format->format || w != image->w || h != image->h) {
+        texture_destroy(game->introTexture);
+        game->introTexture = texture_track(SDL_CreateTexture(game->renderer, image->format->format,
+                                                             SDL_TEXTUREACCESS_STREAMING, image->w, image->h),
+                                           MEMORY_VIDEO);
+    }
+    if (!game->introTexture || SDL_UpdateTexture(game->introTexture, NULL, image->pixels, image->pitch) != 0) {
+        printf("Credits frame upload Error: %s\n", SDL_GetError());
+    }
+    surface_free(image);
+    memory_tag(previous);
+}
+
+void intro_render(Game *game) {
+    if (game->introTexture) {
+        SDL_RenderCopy(game->renderer, game->introTexture, NULL, NULL);
+    }
+}
+
+
+// ---- Main menu ----
+
+void menu_event(Game *game, SDL_Event *event) {
+    if (event->type != SDL_KEYDOWN) {
+        return;
+    }
+    SDL_Keycode key = event->key.keysym.sym;
+
+    if (key == SDLK_RETURN) {
+        play_sound(-1, game->sfxselect);
+        if (game->borderpos == height / 2 + 90) {
+            scene_push(game, &loadingScene);
+        } else if (game->borderpos == height / 2 + 150) {
+            scene_push(game, &optionScene);
+        } else if (game->borderpos == height / 2 + 210) {
+            game->run = false;
+        }
+    } else if (key == SDLK_UP || key == SDLK_w) {
+        play_sound(-1, game->sfxnavigate);
+        if (game->borderpos > height / 2 + 90) {
+            game->borderpos -= 60;
+        }
+    } else if (key == SDLK_DOWN || key == SDLK_s) {
+        play_sound(-1, game->sfxnavigate);
+        if (game->borderpos < height / 2 + 210) {
+            game->borderpos += 60;
+        }
+    }
+}
+
+void menu_render(Game *game) {
+    SDL_Renderer *renderer = game->renderer;
+
+    // Render the menu screen
+    SDL_RenderCopy(renderer, game->menuTexture, NULL, NULL);
+
+    // Render menu buttons, highlighting the selected one
+    SDL_Rect playRect = {width / 2 - 100, height / 2 + 90, 200, 50};
+    renderButton(renderer, game->ButtonTexture, &playRect, game->borderpos == height / 2 + 90);
+    SDL_Rect optionRect = {width / 2 - 100, height / 2 + 150, 200, 50};
+    renderButton(renderer, game->ButtonTexture, &optionRect, game->borderpos == height / 2 + 150);
+    SDL_Rect quitRect = {width / 2 - 100, height / 2 + 210, 200, 50};
+    renderButton(renderer, game->ButtonTexture, &quitRect, game->borderpos == height / 2 + 210);
+
+    //Menu Controls
+    renderText(renderer, game->normalfont, "UP/DOWN = NAVIGATE", 0, 0, -20, 0);
+    renderText(renderer, game->normalfont, "ENTER = SELECT", 0, 20, -20, 0);
+
+    // Button labels
+    renderText(renderer, game->menuFont, "Play", width / 2 - 55, height / 2 + 90, -20, -20);
+    renderText(renderer, game->menuFont, "Option", width / 2 - 80, height / 2 + 150, -20, -20);
+    renderText(renderer, game->menuFont, "Quit", width / 2 - 55, height / 2 + 210, -20, -20);
+
+    // Draw the border around the selected menu item
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 0);
+    SDL_Rect borderRect = {width / 2 - 100, game->borderpos, 200, 50};
+    SDL_RenderDrawRect(renderer, &borderRect);
+}
+
+
+// ---- Option page ----
+
+void option_event(Game *game, SDL_Event *event) {
+    if (event->type != SDL_KEYDOWN) {
+        return;
+    }
+    SDL_Keycode key = event->key.keysym.sym;
+
+    if (key == SDLK_ESCAPE) {
+        game->borderpos = height / 2 + 150;
+        scene_pop(game);
+        return;
+    }
+
+    if (key == SDLK_RETURN) {
+        play_sound(-1, game->sfxselect);
+        if (game->borderposY == height / 2 - 90) {
+            if (game->voice) {
+                Mix_PauseMusic();
+                game->voice = false;
+            } else {
+                // Resume the paused track, or start the one picked while music was off
+                if (Mix_PausedMusic()) {
+                    Mix_ResumeMusic();
+                } else if (game->bgMusic) {
+                    Mix_PlayMusic(game->bgMusic, -1);
+                }
+                game->voice = true;
+            }
+        } else if (game->borderposY == height / 2 + 90) {
+            scene_push(game, &helpScene);
+        } else if (game->borderposY == height / 2 + 180) {
+            scene_push(game, &creditScene);
+        }
+        return;
+    }
+
+    if (key == SDLK_UP) {
+        play_sound(-1, game->sfxnavigate);
+        if (game->borderposY > height / 2 - 90) {
+            game->borderposY -= 90;
+        }
+    } else if (key == SDLK_DOWN) {
+        play_sound(-1, game->sfxnavigate);
+        if (game->borderposY < height / 2 + 180) {
+            game->borderposY += 90;
+        }
+    } else if (game->borderposY == height / 2 && key == SDLK_LEFT) {
+        play_sound(-1, game->sfxnavigate);
+        if (game->musiccount > 1) {
+            game->musiccount--;
+        }
+    } else if (game->borderposY == height / 2 && key == SDLK_RIGHT) {
+        play_sound(-1, game->sfxnavigate);
+        if (game->musiccount < 3) {
+            game->musiccount++;
+        }
+    }
+    if (game->musiccount != game->prevmusic) {
+        game->prevmusic = game->musiccount;
+        change_music(game);
+    }
+}
+
+void option_render(Game *game) {
+    SDL_Renderer *renderer = game->renderer;
+    SDL_RenderCopy(renderer, game->optionTexture, NULL, NULL);
+
+    SDL_Rect soundRect = {width / 2 - 130, height / 2 - 90, 250, 50};
+    renderButton(renderer, game->ButtonTexture, &soundRect, game->borderposY == height / 2 - 90);
+    SDL_Rect musicRect = {width / 2 - 205, height / 2, 400, 50};
+    renderButton(renderer, game->ButtonTexture, &musicRect, game->borderposY == height / 2);
+    SDL_Rect helpRect = {width / 2 - 85, height / 2 + 90, 150, 50};
+    renderButton(renderer, game->ButtonTexture, &helpRect, game->borderposY == height / 2 + 90);
+    SDL_Rect creditRect = {width / 2 - 105, height / 2 + 180, 190, 50};
+    renderButton(renderer, game->ButtonTexture, &creditRect, game->borderposY == height / 2 + 180);
+
+    renderText(renderer, game->normalfont, "UP/DOWN = NAVIGATE", 0, 0, -20, 0);
+    renderText(renderer, game->normalfont, "LEFT/RIGHT = CHANGE MUSIC", 0, 20, -18, 0);
+    renderText(renderer, game->normalfont, "ENTER = SELECT", 0, 40, -20, 0);
+    renderText(renderer, game->normalfont, "ESC = BACK", 0, 60, -20, 0);
+
+    renderText(renderer, game->menuFont, "Music:", width / 2 - 120, height / 2 - 85, -20, -35);
+    if (game->voice) {
+        renderText(renderer, game->menuFont, "ON", width / 2 + 55, height / 2 - 85, -70, -35);
+    } else {
+        renderText(renderer, game->menuFont, "OFF", width / 2 + 53, height / 2 - 85, -100, -35);
+    }
+    if (game->musiccount == 1) {
+        renderText(renderer, game->menuFont, "Music:Bane", width / 2 - 160, height / 2 + 5, -20, -35);
+    } else if (game->musiccount == 2) {
+        renderText(renderer, game->menuFont, "Music:War", width / 2 - 145, height / 2 + 5, -20, -35);
+    } else if (game->musiccount == 3) {
+        renderText(renderer, game->menuFont, "Music:Intense", width / 2 - 185, height / 2 + 5, -20, -35);
+    }
+    renderText(renderer, game->menuFont, "Help", width / 2 - 75, height / 2 + 95, 0, -35);
+    renderText(renderer, game->menuFont, "Credits", width / 2 - 95, height / 2 + 185, -20, -35);
+
+    // Border Around Selected Buttons
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 0);
+    SDL_Rect borderRect = {width / 2 - 200, game->borderposY, 300, 50};
+    SDL_RenderDrawRect(renderer, &borderRect);
+}
+
+
+// ---- Help and credits pages ----
+
+// Both pages only listen for ESC
+void page_event(Game *game, SDL_Event *event) {
+    if (event->type == SDL_KEYDOWN && event->key.keysym.sym == SDLK_ESCAPE) {
+        scene_pop(game);
+    }
+}
+
+void help_render(Game *game) {
+    SDL_RenderCopy(game->renderer, game->helpTexture, NULL, NULL);
+    renderText(game->renderer, game->normalfont, "ESC = BACK", 0, 0, -20, 0);
+}
+
+void credit_render(Game *game) {
+    SDL_RenderCopy(game->renderer, game->creditsmenu, NULL, NULL);  // Full-screen credit image
+    renderText(game->renderer, game->normalfont, "CREDITS", width / 2 - 95, height / 2 - 100, -20, -35);
+    renderText(game->renderer, game->normalfont, "ESC = BACK", 0, 0, -20, 0);
+}
+
+
+// ---- Loading screen ----
+
+void match_reset(Game *game, MatchState *state) {
+    Player player1 = {
+        .rect = {100, GROUND_LEVEL - RECT_HEIGHT, RECT_WIDTH, RECT_HEIGHT},
+        .velocityY = 0,
+        .onGround = true,
+        .originalY = GROUND_LEVEL - RECT_HEIGHT,
+        .move = game->idleMove,
+        .attackTimer = 0,
+        .hitLanded = false
+    };
+    Player player2 = player1;
+    player2.rect.x = width - 150;
+
+    memset(state, 0, sizeof(*state));
+    state->player1 = player1;
+    state->player2 = player2;
+
+    Projectile projectile = { .rect = {0, 0, PROJECTILE_WIDTH, PROJECTILE_HEIGHT}, .velocityX = 0, .active = false };
+    state->player1Projectile = projectile;
+    state->player2Projectile = projectile;
+
+    state->player1_health = 375;
+    state->player2_health = 375;
+    state->sprite1 = game->sprite1;
+    state->sprite2 = game->sprite2;
+    state->sprite1.currentAnimation = STANCE;
+    state->sprite2.currentAnimation = STANCE;
+    resetSprite(&state->sprite1);
+    resetSprite(&state->sprite2);
+}
+
+void loading_enter(Game *game) {
+    match_reset(game, &game->sim);
+    game->loadTexture = cachedTexture(game->renderer, loader);
+    if (!game->loadTexture) {
+        errors("SDL_image Error: Unable to load menu image.");
+    }
+}
+
+void loading_exit(Game *game) {
+    cpu_forget(game->loadTexture);
+    texture_destroy(game->loadTexture);
+    game->loadTexture = NULL;
+}
+
+void loading_update(Game *game, Uint32 now) {
+    // Under a texture budget, also until the match's textures are back in
+    if (scene_elapsed(game, now) >= LOADING_DURATION && residency_ready(STREAM_MATCH)) {
+        scene_switch(game, &matchScene);
+    }
+}
+
+void loading_render(Game *game) {
+    SDL_RenderCopy(game->renderer, game->loadTexture, NULL, NULL);
+}
+
+
+// ---- Match simulation (runs on the sim thread) ----
+
+// Start jumps, attacks and specials from the buttons held this tick
+void match_input(Game *game, MatchState *state, Uint32 buttons) {
+    Player *player1 = &state->player1, *player2 = &state->player2;
+    Sprite *sprite1 = &state->sprite1, *sprite2 = &state->sprite2;
+
+    if (buttons & INPUT_KEY_RELEASED) {
+        sprite1->currentAnimation = STANCE;
+        sprite2->currentAnimation = STANCE;
+    }
+
+    // Handle jumping
+    if ((buttons & INPUT_P1_JUMP) && player1->onGround) {
+        player1->velocityY = JUMP_FORCE;
+        player1->onGround = false;
+        sprite1->currentAnimation = JUMPING;
+    }
+    if ((buttons & INPUT_P2_JUMP) && player2->onGround) {
+        player2->velocityY = JUMP_FORCE;
+        player2->onGround = false;
+        sprite2->currentAnimation = JUMPING;
+    }
+
+    // Handle attack inputs for Player 1
+    if ((buttons & INPUT_P1_PUNCH) && player1->attackTimer == 0) {
+        startMove(&game->frameData, player1, game->punchMove);
+        telemetry_record(state, TELEMETRY_MOVE, 1, game->punchMove, 0);
+        sprite1->currentAnimation = PUNCHNG;
+    }
+    if ((buttons & INPUT_P1_KICK) && player1->attackTimer == 0) {
+        startMove(&game->frameData, player1, game->kickMove);
+        telemetry_record(state, TELEMETRY_MOVE, 1, game->kickMove, 0);
+        sprite1->currentAnimation = KICKING;
+    }
+    // Handle attack inputs for Player 2
+    if ((buttons & INPUT_P2_PUNCH) && player2->attackTimer == 0) {
+        startMove(&game->frameData, player2, game->punchMove);
+        telemetry_record(state, TELEMETRY_MOVE, 2, game->punchMove, 0);
+        sprite2->currentAnimation = KICKING;
+    }
+    if ((buttons & INPUT_P2_KICK) && player2->attackTimer == 0) {
+        startMove(&game->frameData, player2, game->kickMove);
+        telemetry_record(state, TELEMETRY_MOVE, 2, game->kickMove, 0);
+        sprite2->currentAnimation = PUNCHNG;
+    }
+    if (buttons & (INPUT_P2_LEFT | INPUT_P2_RIGHT)) {
+        sprite2->currentAnimation = WALKING;
+    }
+    if (buttons & (INPUT_P1_LEFT | INPUT_P1_RIGHT)) {
+        sprite1->currentAnimation = WALKING;
+    }
+
+    // Handle special moves
+    if ((buttons & INPUT_P1_SPECIAL) && !state->player1Projectile.active) {
+        state->player1Projectile.rect.x = player1->rect.x + (player1->rect.w / 2);
+        state->player1Projectile.rect.y = player1->rect.y + (player1->rect.h / 2);
+        state->player1Projectile.velocityX = (player1->rect.x < player2->rect.x) ? PROJECTILE_SPEED : -PROJECTILE_SPEED;
+        state->player1Projectile.active = true;
+        sprite1->currentAnimation = SPECIAL;
+        telemetry_record(state, TELEMETRY_SPECIAL, 1, TELEMETRY_PROJECTILE, 0);
+    }
+    if ((buttons & INPUT_P2_SPECIAL) && !state->player2Projectile.active) {
+        state->player2Projectile.rect.x = player2->rect.x + (player2->rect.w / 2);
+        state->player2Projectile.rect.y = player2->rect.y + (player2->rect.h / 2);
+        state->player2Projectile.velocityX = (player2->rect.x < player1->rect.x) ? PROJECTILE_SPEED : -PROJECTILE_SPEED;
+        state->player2Projectile.active = true;
+        sprite2->currentAnimation = SPECIAL;
+        telemetry_record(state, TELEMETRY_SPECIAL, 2, TELEMETRY_PROJECTILE, 0);
+    }
+}
+
+// React to events attached to animation frames
+void match_anim_events(Game *game, Uint16 events) {
+    if (game->silent) {
+        return;
+    }
+    if (events & ANIM_EVENT_SOUND_PUNCH) {
+        play_sound(-1, game->punch);
+    }
+    if (events & ANIM_EVENT_SOUND_KICK) {
+        play_sound(-1, game->kick);
+    }
+}
+
+// Projectiles hit the defender's hurtboxes, not the whole fighter rect
+bool projectileHits(Game *game, const Projectile *proj, const Player *defender) {
+    const FrameData *data = &game->frameData;
+    FrameDataSpan hurt = data->moves[defender->move].hurt[moveTick(data, defender)];
+    return hitsHurtboxes(data, &proj->rect, hurt, defender->rect.x, defender->rect.y, proj->velocityX < 0);
+}
+
+// Advance the match by one fixed tick
+void match_step(Game *game, MatchState *state, Uint32 buttons) {
+    Player *player1 = &state->player1, *player2 = &state->player2;
+
+    match_input(game, state, buttons);
+
+    // Handle movement and collision for both players
+    handle_movement(player2, buttons & INPUT_P2_LEFT, buttons & INPUT_P2_RIGHT, &player1->rect);
+    handle_movement(player1, buttons & INPUT_P1_LEFT, buttons & INPUT_P1_RIGHT, &player2->rect);
+
+    // Handle jump for both players
+    handle_jump(player1);
+    handle_jump(player2);
+
+    // Handle attacks: only active hitboxes against the opponent's current hurtboxes, one hit per move
+    int damage = resolveAttack(&game->frameData, player1, player2);
+    if (damage > 0 && !game->silent) {
+        play_sound(1, player1->move == game->punchMove ? game->punch : game->kick);
+    }
+    if (damage > 0) {
+        telemetry_record(state, TELEMETRY_HIT, 1, player1->move, damage);
+        replay_hit(1, player1->move, damage);
+        state->player2_health -= damage;
+    }
+    damage = resolveAttack(&game->frameData, player2, player1);
+    if (damage > 0 && !game->silent) {
+        play_sound(1, player2->move == game->punchMove ? game->punch : game->kick);
+    }
+    if (damage > 0) {
+        telemetry_record(state, TELEMETRY_HIT, 2, player2->move, damage);
+        replay_hit(2, player2->move, damage);
+        state->player1_health -= damage;
+    }
+    if (state->player1Projectile.active && projectileHits(game, &state->player1Projectile, player2)) {
+        state->player2_health -= 5; // Only hits the opponent
+        telemetry_record(state, TELEMETRY_HIT, 1, TELEMETRY_PROJECTILE, 5);
+        replay_hit(1, TELEMETRY_PROJECTILE, 5);
+        state->player1Projectile.active = false;
+    }
+    if (state->player2Projectile.active && projectileHits(game, &state->player2Projectile, player1)) {
+        state->player1_health -= 5; // Only hits the opponent
+        telemetry_record(state, TELEMETRY_HIT, 2, TELEMETRY_PROJECTILE, 5);
+        replay_hit(2, TELEMETRY_PROJECTILE, 5);
+        state->player2Projectile.active = false;
+    }
+
+    // Clamp health to a minimum of 0
+    if (state->player1_health < 0) {
+        state->player1_health = 0;
+    }
+    if (state->player2_health < 0) {
+        state->player2_health = 0;
+    }
+
+    // Decrease attack timers
+    if (player1->attackTimer > 0) {
+        player1->attackTimer--;
+        if (player1->attackTimer == 0) {
+            player1->move = game->idleMove;
+        }
+    }
+    if (player2->attackTimer > 0) {
+        player2->attackTimer--;
+        if (player2->attackTimer == 0) {
+            player2->move = game->idleMove;
+        }
+    }
+
+    //Update sprite positions based on player rects
+    state->sprite1.x = player1->rect.x + player1->rect.w / 2;
+    state->sprite1.y = player1->rect.y + player1->rect.h / 2;
+    state->sprite2.x = player2->rect.x + player2->rect.w / 2;
+    state->sprite2.y = player2->rect.y + player2->rect.h / 2;
+    match_anim_events(game, updateSprite(&state->sprite1, 1000 / TICK_RATE));
+    match_anim_events(game, updateSprite(&state->sprite2, 1000 / TICK_RATE));
+
+    // Update projectiles
+    update_projectile(&state->player1Projectile, player2);
+    update_projectile(&state->player2Projectile, player1);
+
+    // The first knock-out decides the match
+    if (state->player2_health == 0) {
+        state->winner = 1;
+    } else if (state->player1_health == 0) {
+        state->winner = 2;
+    }
+    if (state->winner != 0) {
+        int left = state->winner == 1 ? state->player1_health : state->player2_health;
+        telemetry_record(state, TELEMETRY_ROUND, state->winner, 0, left);
+    }
+    state->tick++;
+}
+
+// Simulation thread: steps the match at TICK_RATE and publishes a snapshot after every tick
+int sim_thread(void *data) {
+    Game *game = data;
+    MatchState *state = &game->sim;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 period = frequency / TICK_RATE;
+    Uint64 next = SDL_GetPerformanceCounter();
+    Uint64 lastTick = 0;
+    Uint32 held = 0, padHeld = 0;
+
+    SDL_SetThreadPriority(SDL_THREAD_PRIORITY_HIGH);
+    while (SDL_AtomicGet(&game->simRunning)) {
+        if (game->lockstep) {
+            SDL_SemWait(game->tickStart);
+            if (!SDL_AtomicGet(&game->simRunning)) {
+                break;
+            }
+        } else {
+            sleep_until(next, frequency);
+        }
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (lastTick != 0) {
+            // Lockstep ticks follow the frames and have no deadline to miss
+            stats_add(&state->tickStats, (double)(now - lastTick) * 1000.0 / frequency,
+                      !game->lockstep && now >= next + period);
+        }
+        lastTick = now;
+
+        // Latest held buttons, plus anything pressed and released since the last tick
+        Uint32 buttons = 0, queued;
+        while (input_pop(&game->input, &queued)) {
+            held = queued & ~INPUT_KEY_RELEASED;
+            buttons |= queued;
+        }
+        buttons |= held | shared_input() | controllers_poll(&padHeld);
+
+        if (state->winner == 0) {
+            match_step(game, state, buttons);
+            replay_record(state, buttons);
+        }
+        *snapshot_back(&game->snapshots) = *state;
+        snapshot_publish(&game->snapshots);
+        spectator_tick(state);
+        shared_publish(state);
+        if (game->lockstep) {
+            SDL_SemPost(game->tickDone);
+        }
+
+        next += period;
+        if (now > next + period) {
+            next = now + period; // fell behind: resync instead of running a burst of ticks
+        }
+    }
+    return 0;
+}
+
+
+// ---- Replay verification ----
+
+// --verify-replays DIR re-simulates <dir>/replay_00000.rpl, replay_00001.rpl
+// and so on, on the main thread and as fast as the sim goes, comparing the
+// rolling hash with each stored checksum. The first mismatch pins the
+// divergence down to one checksum interval. The summary doubles as the sim
+// throughput benchmark: only stepping and hashing are timed.
+//
+// CI runs the checked-in corpus in tests/replays; the README has the command
+// and how tools/replaycorpus.c re-records it.
+typedef struct {
+    int replays;
+    int diverged;
+    Uint64 ticks;
+    Uint64 counter;  // performance counter ticks spent simulating
+} ReplayCheck;
+
+// Read a replay's header, buttons and checksums; false (nothing allocated)
+// when it is not a replay for this version
+bool replay_read(FILE *file, ReplayHeader *header, Uint32 **buttons, Uint64 **checksums) {
+    *buttons = NULL;
+    *checksums = NULL;
+    bool ok = fread(header, sizeof(*header), 1, file) == 1 && memcmp(header->magic, REPLAY_MAGIC, 4) == 0 &&
+              header->version == REPLAY_VERSION && header->tickRate == TICK_RATE && header->checkInterval > 0;
+    Uint32 checks = ok ? header->ticks / header->checkInterval : 0;
+    if (ok) {
+        *buttons = SDL_malloc(sizeof(Uint32) * (header->ticks + 1));
+        *checksums = SDL_malloc(sizeof(Uint64) * (checks + 1));
+        ok = *buttons && *checksums && fread(*buttons, sizeof(Uint32), header->ticks, file) == header->ticks &&
+             fread(*checksums, sizeof(Uint64), checks, file) == checks;
+    }
+    if (!ok) {
+        SDL_free(*buttons);
+        SDL_free(*checksums);
+        *buttons = NULL;
+        *checksums = NULL;
+    }
+    return ok;
+}
+
+// Re-simulate one replay; false when it is missing or unreadable
+bool replay_verify(Game *game, const char *path, ReplayCheck *check) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    ReplayHeader header;
+    Uint32 *buttons;
+    Uint64 *checksums;
+    bool ok = replay_read(file, &header, &buttons, &checksums);
+    fclose(file);
+    Uint32 checks = ok ? header.ticks / header.checkInterval : 0;
+    if (!ok) {
+        printf("%s: not a replay for this version\n", name);
+        check->replays++;
+        check->diverged++;
+        return true;
+    }
+
+    MatchState state;
+    match_reset(game, &state);
+    Uint64 hash = REPLAY_HASH_SEED;
+    Uint32 next = 0, divergedAt = 0, matchedAt = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (Uint32 i = 0; i < header.ticks; i++) {
+        match_step(game, &state, buttons[i]);
+        hash = replay_fold(hash, &state);
+        if (state.tick % header.checkInterval == 0 && next < checks) {
+            if (hash == checksums[next++]) {
+                matchedAt = divergedAt == 0 ? state.tick : matchedAt;
+            } else if (divergedAt == 0) {
+                divergedAt = state.tick;
+            }
+        }
+    }
+    check->counter += SDL_GetPerformanceCounter() - start;
+    check->ticks += header.ticks;
+    check->replays++;
+    if (divergedAt == 0 && hash != header.finalHash) {
+        divergedAt = header.ticks; // within the last partial interval
+    }
+
+    if (divergedAt == 0) {
+        printf("%s: %u ticks, matches\n", name, header.ticks);
+    } else {
+        check->diverged++;
+        printf("%s: diverged after tick %u, by tick %u; ends winner %d at %d/%d health, recorded winner %u at %d/%d\n",
+               name, matchedAt, divergedAt, state.winner, state.player1_health, state.player2_health, header.winner,
+               header.health[0], header.health[1]);
+    }
+    SDL_free(buttons);
+    SDL_free(checksums);
+    return true;
+}
+
+// Check every replay in the directory; the number that diverged, or -1 without any
+int replay_verify_all(Game *game, const char *directory) {
+    ReplayCheck check;
+    memset(&check, 0, sizeof(check));
+    game->silent = true;
+    char path[280];
+    for (int i = 0;; i++) {
+        snprintf(path, sizeof(path), "%s/replay_%05d.rpl", directory, i);
+        if (!replay_verify(game, path, &check)) {
+            break;
+        }
+    }
+    game->silent = false;
+    if (check.replays == 0) {
+        printf("Replays: none in %s\n", directory);
+        return -1;
+    }
+    double ms = check.counter * 1000.0 / SDL_GetPerformanceFrequency();
+    printf("Replays: %d checked, %d diverged; %llu ticks simulated in %.1f ms, %.0f ticks/s (%.0fx real time)\n",
+           check.replays, check.diverged, (unsigned long long)check.ticks, ms, ms > 0 ? check.ticks * 1000.0 / ms : 0.0,
+           ms > 0 ? check.ticks * 1000.0 / ms / TICK_RATE : 0.0);
+    return check.diverged;
+}
+
+
+// Rebuild a match from a database keyframe
+void replay_restore(Game *game, MatchState *state, const ReplayDbKeyframe *keyframe) {
+    match_reset(game, state);
+    Player *players[2] = { &state->player1, &state->player2 };
+    Projectile *projectiles[2] = { &state->player1Projectile, &state->player2Projectile };
+    Sprite *sprites[2] = { &state->sprite1, &state->sprite2 };
+    int *health[2] = { &state->player1_health, &state->player2_health };
+    state->tick = keyframe->tick;
+    state->winner = keyframe->winner;
+    for (int p = 0; p < 2; p++) {
+        const ReplayDbFighter *f = &keyframe->fighters[p];
+        players[p]->rect = (SDL_Rect){ f->x, f->y, f->w, f->h };
+        players[p]->velocityY = f->velocityY;
+        players[p]->onGround = f->onGround;
+        players[p]->move = f->move;
+        players[p]->attackTimer = f->attackTimer;
+        players[p]->hitLanded = f->hitLanded;
+        projectiles[p]->rect.x = f->projectileX;
+        projectiles[p]->rect.y = f->projectileY;
+        projectiles[p]->velocityX = f->projectileVelocityX;
+        projectiles[p]->active = f->projectileActive;
+        sprites[p]->currentAnimation = f->animation;
+        sprites[p]->playingAnimation = f->playingAnimation;
+        sprites[p]->currentFrame = f->frame;
+        sprites[p]->frameTime = f->frameTime;
+        sprites[p]->x = f->spriteX;
+        sprites[p]->y = f->spriteY;
+        *health[p] = f->health;
+    }
+}
+
+// --replay-seek ID:TICK prints database replay ID as it stood at TICK. The
+// keyframe before TICK is restored and at most REPLAYDB_KEYFRAME_INTERVAL - 1
+// ticks simulated on top; when TICK has a checksum the result is checked
+// against it. False when the replay is missing or the check fails.
+bool replaydb_seek(Game *game, const char *directory, const char *target) {
+    Uint32 id, tick;
+    if (sscanf(target, "%u:%u", &id, &tick) != 2) {
+        printf("--replay-seek takes ID:TICK\n");
+        return false;
+    }
+    Uint64 start = SDL_GetPerformanceCounter();
+    char path[280];
+    snprintf(path, sizeof(path), "%s/index.rdx", directory);
+    FILE *index = fopen(path, "rb");
+    ReplayDbIndex header;
+    ReplayDbEntry entry;
+    bool ok = index && fread(&header, sizeof(header), 1, index) == 1 &&
+              memcmp(header.magic, REPLAYDB_INDEX_MAGIC, 4) == 0 && header.version == REPLAYDB_VERSION &&
+              fseek(index, (long)(sizeof(header) + (Uint64)id * sizeof(entry)), SEEK_SET) == 0 &&
+              fread(&entry, sizeof(entry), 1, index) == 1 && entry.keyframes > 0;
+    if (index) {
+        fclose(index);
+    }
+    Uint8 *map = ok ? replaydb_map(directory, entry.segment, false) : NULL;
+    const ReplayDbSegment *segment = (const ReplayDbSegment *)map;
+    if (!map || entry.offset + entry.length > segment->used ||
+        entry.length != replaydb_record_size(entry.ticks, entry.keyframes, REPLAY_CHECK_INTERVAL)) {
+        printf("No replay %u in %s\n", id, directory);
+        replaydb_unmap(map);
+        return false;
+    }
+    const Uint8 *record = map + entry.offset;
+    ReplayHeader replay;
+    memcpy(&replay, record, sizeof(replay));
+    // The record's size was checked against the index; its own header has to agree before it lays out the arrays
+    if (replay.ticks != entry.ticks || replay.checkInterval != REPLAY_CHECK_INTERVAL) {
+        printf("Replay %u in %s is damaged\n", id, directory);
+        replaydb_unmap(map);
+        return false;
+    }
+    const Uint32 *buttons = (const Uint32 *)(record + sizeof(replay));
+    const Uint64 *checksums = (const Uint64 *)(record + sizeof(replay) + (((Uint64)replay.ticks * sizeof(Uint32) + 7) & ~7ull));
+    const ReplayDbKeyframe *keyframes = (const ReplayDbKeyframe *)(checksums + replay.ticks / replay.checkInterval);
+
+    tick = SDL_min(tick, replay.ticks);
+    const ReplayDbKeyframe *keyframe = &keyframes[SDL_min(tick / REPLAYDB_KEYFRAME_INTERVAL, entry.keyframes - 1)];
+    MatchState state;
+    replay_restore(game, &state, keyframe);
+    Uint64 hash = keyframe->hash;
+    game->silent = true;
+    for (Uint32 t = keyframe->tick; t < tick; t++) {
+        match_step(game, &state, buttons[t]);
+        hash = replay_fold(hash, &state);
+    }
+    game->silent = false;
+    double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    ok = tick == 0 || (tick == replay.ticks ? hash == replay.finalHash
+                       : tick % replay.checkInterval != 0 || hash == checksums[tick / replay.checkInterval - 1]);
+
+    printf("Replay %u at tick %u of %u: keyframe at tick %u plus %u ticks, %.3f ms%s\n", id, tick, replay.ticks,
+           keyframe->tick, tick - keyframe->tick, ms, ok ? "" : ", DOES NOT MATCH the recorded checksum");
+    const Player *players[2] = { &state.player1, &state.player2 };
+    const Sprite *sprites[2] = { &state.sprite1, &state.sprite2 };
+    const int health[2] = { state.player1_health, state.player2_health };
+    for (int p = 0; p < 2; p++) {
+        printf("  P%d at %d,%d health %d, animation %d frame %d%s\n", p + 1, players[p]->rect.x, players[p]->rect.y,
+               health[p], sprites[p]->playingAnimation, sprites[p]->currentFrame,
+               state.winner == p + 1 ? ", winner" : "");
+    }
+    replaydb_unmap(map);
+    return ok;
+}
+
+
+// ---- Replay playback ----
+
+// --play FILE.rpl runs a recorded match through the real scenes: it implies
+// lockstep and --start match, and each rendered frame pushes that tick's
+// recorded buttons to the sim thread in place of the keyboard. With --golden
+// or --capture this renders a real fight instead of idle opening frames.
+// When the buttons run out the run ends, after the winner banner if there is
+// one, and the final state is checked against the replay's header.
+typedef struct {
+    const char *name;
+    ReplayHeader header;
+    Uint32 *buttons;   // NULL: not playing
+    Uint32 next;       // ticks fed to the sim so far
+    bool reported;
+    bool matched;
+} Playback;
+
+Playback playback;
+
+bool playback_open(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        SDL_Log("Playback: unable to open %s", path);
+        return false;
+    }
+    Uint64 *checksums;
+    bool ok = replay_read(file, &playback.header, &playback.buttons, &checksums);
+    fclose(file);
+    if (!ok) {
+        SDL_Log("Playback: %s is not a replay for this version", path);
+        return false;
+    }
+    SDL_free(checksums); // the end state is checked against the header instead
+    playback.name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    playback.matched = true;
+    return true;
+}
+
+// Queue the next recorded tick before the lockstep tick runs; false once the
+// replay has run out, so the sim is not stepped past its end
+bool playback_tick(Game *game) {
+    if (!playback.buttons) {
+        return true;
+    }
+    if (playback.next < playback.header.ticks) {
+        input_push(&game->input, playback.buttons[playback.next++]);
+        return true;
+    }
+    if (snapshot_latest(&game->snapshots)->winner == 0) {
+        game->run = false; // recorded without a knockout: nothing more to show
+    }
+    return false;
+}
+
+// The match is over: compare where it ended with the recording and stop the run
+void playback_end(Game *game, const MatchState *state) {
+    if (!playback.buttons || playback.reported) {
+        return;
+    }
+    const ReplayHeader *header = &playback.header;
+    playback.matched = state->tick == header->ticks && state->winner == (int)header->winner &&
+                       state->player1_health == header->health[0] && state->player2_health == header->health[1];
+    printf("Playback: %s, %u of %u ticks, ends winner %d at %d/%d health, recorded winner %u at %d/%d, %s\n",
+           playback.name, state->tick, header->ticks, state->winner, state->player1_health, state->player2_health,
+           header->winner, header->health[0], header->health[1], playback.matched ? "matches" : "DIVERGED");
+    playback.reported = true;
+    game->run = false;
+}
+
+// True unless a played replay ended somewhere other than where it was recorded
+bool playback_close(void) {
+    SDL_free(playback.buttons);
+    playback.buttons = NULL;
+    return playback.matched || !playback.reported;
+}
+
+
+// ---- Particles ----
+
+// Hit sparks, landing dust and fireball trails. The simulation does not know
+// about them: the main thread spawns them from what changed between the
+// snapshots it draws (a health bar dropped, a fighter touched down, a
+// fireball is in flight), so the sim thread, replays and checksums are
+// untouched.
+//
+// The pool is a fixed block of parallel arrays, integrated four particles
+// per SSE2 step, and a dead particle is replaced by the last live one so the
+// live range stays dense. Every particle is a quad of the same soft dot, so
+// the whole pool is one SDL_RenderGeometry call. The update and vertex build
+// are timed against PARTICLE_BUDGET_MS: an overrun lowers the live cap (the
+// excess is culled, new spawns dropped) and it creeps back up while frames
+// stay under budget.
+
+#define PARTICLE_CAPACITY 65536   // pool size, a multiple of 4
+#define PARTICLE_BUDGET_MS 1.0    // update and vertex build, per frame
+#define PARTICLE_MIN_CAP 2048     // the budget never cuts the live cap below this
+#define PARTICLE_DOT_SIZE 16      // soft-dot texture, pixels square
+#define PARTICLE_MAX_DT 0.05f     // seconds; a long frame does not fling particles across the screen
+#define PARTICLE_SEED 0x9E3779B9u // reset every match, so lockstep captures repeat
+#define PARTICLE_SPARKS 40        // per hit
+#define PARTICLE_DUST 12          // per landing, each way
+#define PARTICLE_TRAIL 4          // per fireball per tick
+#define PARTICLE_BENCH_WARMUP 60  // --particle-bench frames before measuring
+#define PARTICLE_BENCH_FRAMES 600
+
+// How a burst starts out; each particle randomizes speed, direction, life and size
+typedef struct {
+    float speed;   // pixels/s, the fastest of the burst
+    float arc;     // cone width around the burst's direction, radians
+    float ay;      // vertical acceleration: gravity for sparks, lift for dust
+    float life;    // seconds, the longest of the burst
+    float size;    // half the quad's side
+    float jitter;  // spawn position spread, pixels
+    SDL_Color color;
+} ParticleEmitter;
+
+const ParticleEmitter sparkEmitter = { 650, 1.8f, 1400, 0.35f, 3, 4, {255, 220, 120, 255} };
+const ParticleEmitter dustEmitter = { 110, 0.7f, -60, 0.6f, 5, 10, {190, 170, 140, 160} };
+const ParticleEmitter trailEmitter = { 60, 0.8f, -20, 0.3f, 4, 12, {120, 180, 255, 200} };
+
+typedef struct {
+    float *x, *y, *vx, *vy;
+    float *ay;
+    float *life;           // seconds left
+    float *fade;           // 1 / lifetime, so alpha is life * fade
+    float *size;
+    SDL_Color *color;
+    int count;
+    int cap;               // live particles the budget allows, 0 without a pool
+    Uint32 dropped;        // spawns refused at the cap
+    Uint32 seed;           // xorshift state
+    SDL_Texture *texture;
+    SDL_Vertex *vertices;  // 4 per particle, rebuilt every frame
+    int *indices;          // 6 per particle, built once
+    DrawGeometry geometry;
+    Uint64 lastUpdate;     // performance counter, 0 before the first frame
+    Uint32 lastTick;       // snapshot tick effects were spawned up to
+    int health[2];         // at lastTick
+    bool onGround[2];
+    IntervalStats updateStats; // update and vertex build per frame
+} Particles;
+
+Particles particles;
+
+// Uniform in [0, 1)
+static inline float particle_random(void) {
+    Uint32 x = particles.seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    particles.seed = x;
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Allocate the pool, the index buffer and the soft-dot texture. Without them
+// the match just has no particles.
+bool particles_open(SDL_Renderer *renderer) {
+    Particles *p = &particles;
+    float *floats = SDL_malloc(sizeof(float) * 8 * PARTICLE_CAPACITY);
+    p->color = SDL_malloc(sizeof(SDL_Color) * PARTICLE_CAPACITY);
+    p->vertices = SDL_malloc(sizeof(SDL_Vertex) * 4 * PARTICLE_CAPACITY);
+    p->indices = SDL_malloc(sizeof(int) * 6 * PARTICLE_CAPACITY);
+    if (!floats || !p->color || !p->vertices || !p->indices) {
+        SDL_Log("Out of memory for particles, the match has none");
+        SDL_free(floats);
+        SDL_free(p->color);
+        SDL_free(p->vertices);
+        SDL_free(p->indices);
+        memset(p, 0, sizeof(*p));
+        return false;
+    }
+    float **arrays[] = { &p->x, &p->y, &p->vx, &p->vy, &p->ay, &p->life, &p->fade, &p->size };
+    for (int i = 0; i < 8; i++) {
+        *arrays[i] = floats + i * PARTICLE_CAPACITY;
+    }
+    for (int i = 0; i < PARTICLE_CAPACITY; i++) {
+        int *index = &p->indices[i * 6], v = i * 4;
+        index[0] = v;
+        index[1] = v + 1;
+        index[2] = v + 2;
+        index[3] = v;
+        index[4] = v + 2;
+        index[5] = v + 3;
+    }
+    p->geometry.vertices = p->vertices;
+    p->geometry.indices = p->indices;
+
+    // White, alpha falling off with the square of the distance from the middle
+    Uint32 pixels[PARTICLE_DOT_SIZE * PARTICLE_DOT_SIZE];
+    float radius = PARTICLE_DOT_SIZE / 2.0f;
+    for (int y = 0; y < PARTICLE_DOT_SIZE; y++) {
+        for (int x = 0; x < PARTICLE_DOT_SIZE; x++) {
+            float dx = (x + 0.5f - radius) / radius, dy = (y + 0.5f - radius) / radius;
+            float falloff = SDL_max(0.0f, 1.0f - sqrtf(dx * dx + dy * dy));
+            pixels[y * PARTICLE_DOT_SIZE + x] = ((Uint32)(255 * falloff * falloff) << 24) | 0xFFFFFF;
+        }
+    }
+    p->texture = texture_track(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC,
+                                                 PARTICLE_DOT_SIZE, PARTICLE_DOT_SIZE), MEMORY_RENDER);
+    if (!p->texture) {
+        SDL_Log("Unable to create the particle texture, the match has none: %s", SDL_GetError());
+        return false; // particles_close frees the pool
+    }
+    SDL_UpdateTexture(p->texture, NULL, pixels, PARTICLE_DOT_SIZE * sizeof(Uint32));
+    SDL_SetTextureBlendMode(p->texture, SDL_BLENDMODE_BLEND);
+    p->cap = PARTICLE_CAPACITY;
+    return true;
+}
+
+// Empty the pool and restart the random sequence
+void particles_clear(void) {
+    Particles *p = &particles;
+    p->count = 0;
+    p->seed = PARTICLE_SEED;
+    p->lastUpdate = 0;
+}
+
+// A new match: nothing has happened yet
+void particles_reset(const MatchState *state) {
+    Particles *p = &particles;
+    particles_clear();
+    p->lastTick = state->tick;
+    p->health[0] = state->player1_health;
+    p->health[1] = state->player2_health;
+    p->onGround[0] = state->player1.onGround;
+    p->onGround[1] = state->player2.onGround;
+}
+
+// Start a burst of n particles at (x, y) heading along angle (radians, y down)
+void particles_emit(const ParticleEmitter *emitter, float x, float y, float angle, int n) {
+    Particles *p = &particles;
+    for (int k = 0; k < n; k++) {
+        if (p->count >= p->cap) {
+            p->dropped += n - k;
+            return;
+        }
+        int i = p->count++;
+        float direction = angle + (particle_random() - 0.5f) * emitter->arc;
+        float speed = emitter->speed * (0.4f + 0.6f * particle_random());
+        float life = emitter->life * (0.5f + 0.5f * particle_random());
+        p->x[i] = x + (particle_random() - 0.5f) * emitter->jitter;
+        p->y[i] = y + (particle_random() - 0.5f) * emitter->jitter;
+        p->vx[i] = cosf(direction) * speed;
+        p->vy[i] = sinf(direction) * speed;
+        p->ay[i] = emitter->ay;
+        p->life[i] = life;
+        p->fade[i] = 1.0f / life;
+        p->size[i] = emitter->size * (0.6f + 0.4f * particle_random());
+        p->color[i] = emitter->color;
+    }
+}
+
+// The screen rect of a fighter's current animation frame
+SDL_Rect particle_bounds(const Sprite *sprite) {
+    const SDL_Rect *dst = &sprite->anims->frames[sprite->currentFrame].dst;
+    return (SDL_Rect){ sprite->x + dst->x, sprite->y + dst->y, dst->w, dst->h };
+}
+
+// Effects for the ticks the sim ran since the last frame
+void particles_spawn(const MatchState *view, Uint32 ticks) {
+    Particles *p = &particles;
+    const Player *fighters[2] = { &view->player1, &view->player2 };
+    const Sprite *sprites[2] = { &view->sprite1, &view->sprite2 };
+    const Projectile *fireballs[2] = { &view->player1Projectile, &view->player2Projectile };
+    int health[2] = { view->player1_health, view->player2_health };
+    for (int f = 0; f < 2; f++) {
+        SDL_Rect body = particle_bounds(sprites[f]);
+        if (health[f] < p->health[f]) {
+            // Out of the side facing the attacker, away from it
+            bool fromLeft = fighters[1 - f]->rect.x < fighters[f]->rect.x;
+            float x = fromLeft ? body.x + body.w * 0.3f : body.x + body.w * 0.7f;
+            particles_emit(&sparkEmitter, x, body.y + body.h * 0.35f, fromLeft ? -0.3f : (float)M_PI + 0.3f,
+                           PARTICLE_SPARKS);
+        }
+        if (fighters[f]->onGround && !p->onGround[f]) {
+            // handle_jump put the fighter back on the ground: dust both ways along the floor
+            float x = body.x + body.w * 0.5f, y = body.y + body.h;
+            particles_emit(&dustEmitter, x, y, (float)M_PI, PARTICLE_DUST);
+            particles_emit(&dustEmitter, x, y, 0, PARTICLE_DUST);
+        }
+        const Projectile *fireball = fireballs[f];
+        if (fireball->active) {
+            // From the trailing edge, drifting back the way it came
+            bool right = fireball->velocityX >= 0;
+            float x = right ? fireball->rect.x : fireball->rect.x + fireball->rect.w;
+            particles_emit(&trailEmitter, x, fireball->rect.y + fireball->rect.h * 0.5f, right ? (float)M_PI : 0,
+                           PARTICLE_TRAIL * ticks);
         }
-            
-                
+        p->health[f] = health[f];
+        p->onGround[f] = fighters[f]->onGround;
+    }
+}
+
+// Move every live particle on by dt seconds, then drop the dead ones
+void particles_integrate(float dt) {
+    Particles *p = &particles;
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 step = _mm_set1_ps(dt);
+    for (; i + 4 <= p->count; i += 4) {
+        __m128 vy = _mm_add_ps(_mm_loadu_ps(p->vy + i), _mm_mul_ps(_mm_loadu_ps(p->ay + i), step));
+        __m128 vx = _mm_loadu_ps(p->vx + i);
+        _mm_storeu_ps(p->x + i, _mm_add_ps(_mm_loadu_ps(p->x + i), _mm_mul_ps(vx, step)));
+        _mm_storeu_ps(p->y + i, _mm_add_ps(_mm_loadu_ps(p->y + i), _mm_mul_ps(vy, step)));
+        _mm_storeu_ps(p->vy + i, vy);
+        _mm_storeu_ps(p->life + i, _mm_sub_ps(_mm_loadu_ps(p->life + i), step));
+    }
+#endif
+    for (; i < p->count; i++) {
+        p->vy[i] += p->ay[i] * dt;
+        p->x[i] += p->vx[i] * dt;
+        p->y[i] += p->vy[i] * dt;
+        p->life[i] -= dt;
+    }
+
+    // Order does not matter, so the last live particle fills each hole
+    p->count = SDL_min(p->count, p->cap);
+    for (i = 0; i < p->count;) {
+        if (p->life[i] > 0) {
+            i++;
+            continue;
         }
+        int last = --p->count;
+        p->x[i] = p->x[last];
+        p->y[i] = p->y[last];
+        p->vx[i] = p->vx[last];
+        p->vy[i] = p->vy[last];
+        p->ay[i] = p->ay[last];
+        p->life[i] = p->life[last];
+        p->fade[i] = p->fade[last];
+        p->size[i] = p->size[last];
+        p->color[i] = p->color[last];
+    }
+}
 
+// One quad per live particle, fading out with its life
+void particles_build(void) {
+    Particles *p = &particles;
+    SDL_Vertex *v = p->vertices;
+    for (int i = 0; i < p->count; i++, v += 4) {
+        float s = p->size[i];
+        float x0 = p->x[i] - s, y0 = p->y[i] - s, x1 = p->x[i] + s, y1 = p->y[i] + s;
+        SDL_Color c = p->color[i];
+        c.a = (Uint8)(c.a * SDL_min(1.0f, p->life[i] * p->fade[i]));
+        v[0] = (SDL_Vertex){ {x0, y0}, c, {0, 0} };
+        v[1] = (SDL_Vertex){ {x1, y0}, c, {1, 0} };
+        v[2] = (SDL_Vertex){ {x1, y1}, c, {1, 1} };
+        v[3] = (SDL_Vertex){ {x0, y1}, c, {0, 1} };
+    }
+    p->geometry.vertexCount = p->count * 4;
+    p->geometry.indexCount = p->count * 6;
+}
 
-        SDL_Event event;
-        // Event handling
-        if(!play){
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT) {
-                run = false;  // Exit the game
-            }
+// Account one frame's update and build, and fit the live cap to the budget
+void particles_budget(double ms) {
+    Particles *p = &particles;
+    stats_add(&p->updateStats, ms, ms > PARTICLE_BUDGET_MS);
+    if (ms > PARTICLE_BUDGET_MS && p->count > 0) {
+        // What would have fit, with some headroom
+        int fit = (int)(p->count * PARTICLE_BUDGET_MS / ms * 0.9);
+        p->cap = SDL_max(PARTICLE_MIN_CAP, SDL_min(p->cap, fit));
+    } else if (ms < PARTICLE_BUDGET_MS * 0.5 && p->cap < PARTICLE_CAPACITY) {
+        p->cap = SDL_min(PARTICLE_CAPACITY, p->cap + p->cap / 16);
+    }
+}
 
-            if (event.type == SDL_KEYDOWN) {
-                if (event.key.keysym.sym == SDLK_ESCAPE) {
-                    if (option && !help && !credit) {
-                        option = false;
-                        voicecount = 0;
-                        borderpos = height / 2 + 150;
-                    } else if (help && helpcount!=0) {  
-                        helpcount = 0; 
-                        help = false;
-                    } else if (credit) {
-                        credit = false;
-                    }
-                }
+// Spawn, advance and record the pool for this frame. Lockstep frames are
+// one tick each, so they advance by exactly that.
+void particles_frame(Game *game, DrawList *draws, const MatchState *view) {
+    Particles *p = &particles;
+    if (!p->texture) {
+        return;
+    }
+    Uint64 start = SDL_GetPerformanceCounter();
+    float dt = 1.0f / TICK_RATE;
+    if (!game->lockstep) {
+        dt = p->lastUpdate ? SDL_min((float)(start - p->lastUpdate) / SDL_GetPerformanceFrequency(), PARTICLE_MAX_DT) : 0;
+    }
+    p->lastUpdate = start;
+    if (view->tick > p->lastTick) {
+        particles_spawn(view, SDL_min(view->tick - p->lastTick, MAX_CATCHUP_TICKS));
+        p->lastTick = view->tick;
+    }
+    particles_integrate(dt);
+    particles_build();
+    particles_budget((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+    if (p->count > 0) {
+        draw_geometry(draws, LAYER_PARTICLES, p->texture, &p->geometry);
+    }
+}
 
-                if (event.key.keysym.sym == SDLK_RETURN) {
-                    Mix_PlayChannel(-1, sfxselect, 0);
-                    // Handle menu selection on Enter key press
-                    if (menu) {
-                        
-                        if (borderpos == height / 2 + 90) {
-                            menu = false;
-                            play = true;
-                        } else if (borderpos == height / 2 + 150) {
-                            option = true;
-                            
-                        } else if (borderpos == height / 2 + 210) {
-                            menu = false;
-                            run = false;
-                        }
-                    }
-                    if(option){
-                        voicecount++;
-                        helpcount++;
-                        creditcount++;
-                        if(borderposY==height /2-90){
-                            if (voice == true && voicecount > 1) {
-                            Mix_PauseMusic();
-                            voice = false;
-                        } else if (voicecount > 1 && voice == false) {
-                            // If music was off, resume or play the new music
-                            if (musiccount == prevmusic) {
-                                Mix_ResumeMusic();
-                            } else {
-                                // Play new music
-                                Mix_FreeMusic(bgMusic);  // Free previous music
-                                bgMusic = Mix_LoadMUS(music(&musiccount));  // Load new music
-                                if (!bgMusic) {
-                                    errors("Mix_LoadMUS Error: Unable to load new music.");
-                                }
-                                Mix_PlayMusic(bgMusic, -1);  // Play new music
-                            }
-                            voice = true;
-                        }
-                        }
-                        //help button toggle
-                        if(borderposY==height/2+90){
-                            if(helpcount>1){
-                                help=true;
-                            }
-                        }
-                        
-                        
-                        //credit button toggle
-                        else if(borderposY==height/2+180){
-                            if(creditcount>1){
-                                credit=true;
-                            }
-                        }
+// --particle-bench N: keep N particles alive for PARTICLE_BENCH_FRAMES frames,
+// with the cap pinned, and time the update, vertex build and submit through
+// the selected renderer. Fails when the update and build average over budget.
+bool particles_bench(Game *game, int target) {
+    Particles *p = &particles;
+    SDL_Renderer *renderer = game->renderer;
+    if (!p->texture) {
+        printf("Particles: no pool to benchmark\n");
+        return false;
+    }
+    target = SDL_max(1, SDL_min(target, PARTICLE_CAPACITY));
+    particles_clear();
+    IntervalStats update = {0}, build = {0}, submit = {0};
+    double frequency = SDL_GetPerformanceFrequency();
+    for (int frame = -PARTICLE_BENCH_WARMUP; frame < PARTICLE_BENCH_FRAMES; frame++) {
+        arena_reset(&frameArena);
+        p->cap = PARTICLE_CAPACITY;
+        while (p->count < target) {
+            // Bursts anywhere on the screen, as after a flurry of hits
+            particles_emit(&sparkEmitter, particle_random() * width, particle_random() * height,
+                           particle_random() * 2 * (float)M_PI, SDL_min(PARTICLE_SPARKS, target - p->count));
+        }
+        Uint64 t0 = SDL_GetPerformanceCounter();
+        particles_integrate(1.0f / TICK_RATE);
+        Uint64 t1 = SDL_GetPerformanceCounter();
+        particles_build();
+        Uint64 t2 = SDL_GetPerformanceCounter();
+        SDL_RenderClear(renderer);
+        draw_begin(&game->draws);
+        draw_geometry(&game->draws, LAYER_PARTICLES, p->texture, &p->geometry);
+        if (cpuRenderer.enabled) {
+            cpu_submit(&game->draws, renderer);
+        } else {
+            draw_submit(&game->draws, renderer);
+        }
+        SDL_RenderFlush(renderer);
+        Uint64 t3 = SDL_GetPerformanceCounter();
+        SDL_RenderPresent(renderer);
+        if (frame >= 0) {
+            stats_add(&update, (t1 - t0) * 1000.0 / frequency, false);
+            stats_add(&build, (t2 - t1) * 1000.0 / frequency, false);
+            stats_add(&submit, (t3 - t2) * 1000.0 / frequency, false);
+        }
+    }
+    const char *integration = "scalar";
+#ifdef __SSE2__
+    integration = "SSE2";
+#endif
+    double used = update.meanMs + build.meanMs;
+    bool within = used <= PARTICLE_BUDGET_MS;
+    printf("Particles: %d live over %d frames, %s integration\n", target, PARTICLE_BENCH_FRAMES, integration);
+    printf("  update %.3f ms (worst %.3f), build %.3f ms (worst %.3f), submit %.3f ms (worst %.3f)\n", update.meanMs,
+           update.worstMs, build.meanMs, build.worstMs, submit.meanMs, submit.worstMs);
+    printf("  %.3f of %.1f ms budget, about %d particles fit: %s\n", used, PARTICLE_BUDGET_MS,
+           used > 0 ? (int)SDL_min(PARTICLE_CAPACITY, target * PARTICLE_BUDGET_MS / used) : PARTICLE_CAPACITY,
+           within ? "PASS" : "FAIL");
+    particles_clear();
+    return within;
+}
 
+void particles_close(void) {
+    Particles *p = &particles;
+    IntervalStats *stats = &p->updateStats;
+    if (stats->count > 0) {
+        printf("Particles: %.3f ms per frame (sd %.3f, worst %.2f), %u frame(s) over the %.1f ms budget, "
+               "cap %d, %u spawn(s) dropped\n", stats->meanMs, stats_stddev(stats), stats->worstMs, stats->missed,
+               PARTICLE_BUDGET_MS, p->cap, p->dropped);
+    }
+    texture_destroy(p->texture);
+    SDL_free(p->x); // the start of the float block
+    SDL_free(p->color);
+    SDL_free(p->vertices);
+    SDL_free(p->indices);
+    memset(p, 0, sizeof(*p));
+}
 
 
+// ---- Match (main thread side) ----
 
+// Pack the keyboard state into INPUT_* bits
+Uint32 read_buttons(void) {
+    static const struct { SDL_Scancode scancode; Uint32 button; } bindings[] = {
+        { SDL_SCANCODE_W, INPUT_P1_JUMP }, { SDL_SCANCODE_A, INPUT_P1_LEFT }, { SDL_SCANCODE_D, INPUT_P1_RIGHT },
+        { SDL_SCANCODE_E, INPUT_P1_PUNCH }, { SDL_SCANCODE_Q, INPUT_P1_KICK }, { SDL_SCANCODE_S, INPUT_P1_SPECIAL },
+        { SDL_SCANCODE_I, INPUT_P2_JUMP }, { SDL_SCANCODE_J, INPUT_P2_LEFT }, { SDL_SCANCODE_L, INPUT_P2_RIGHT },
+        { SDL_SCANCODE_O, INPUT_P2_PUNCH }, { SDL_SCANCODE_U, INPUT_P2_KICK }, { SDL_SCANCODE_K, INPUT_P2_SPECIAL },
+    };
+    const Uint8 *keystate = SDL_GetKeyboardState(NULL);
+    Uint32 buttons = 0;
+    for (size_t i = 0; i < sizeof(bindings) / sizeof(bindings[0]); i++) {
+        if (keystate[bindings[i].scancode]) {
+            buttons |= bindings[i].button;
+        }
+    }
+    return buttons;
+}
 
-                    }
-                }
+void match_enter(Game *game) {
+    game->player1LabelRect = (SDL_Rect){137, 0, 0, 0};
+    game->player2LabelRect = (SDL_Rect){687, 0, 0, 0};
+    game->player1Label = textTexture(game->renderer, game->normalfont, "PLAYER 1", &game->player1LabelRect, 100, 50, true);
+    game->player2Label = textTexture(game->renderer, game->normalfont, "PLAYER 2", &game->player2LabelRect, 100, 50, true);
+    game->hudDirty = true;
+    memset(&game->hudStats, 0, sizeof(game->hudStats));
+    memset(&game->renderStats, 0, sizeof(game->renderStats));
+
+    snapshot_init(&game->snapshots, &game->sim);
+    spectator_restart();
+    telemetry_match_start(&game->sim);
+    shared_restart();
+    replay_restart(&game->sim);
+    particles_reset(&game->sim);
+    input_init(&game->input);
+    if (!playback.buttons) {
+        input_push(&game->input, read_buttons());
+    }
+    SDL_AtomicSet(&game->simRunning, 1);
+    game->simThread = SDL_CreateThread(sim_thread, "sim", game);
+    if (!game->simThread) {
+        errors("SDL_CreateThread Error: Unable to start the simulation thread.");
+    }
+}
 
-                // Selection movement
-                if (menu == true && option == false) {
-                    if (event.key.keysym.sym == SDLK_UP || event.key.keysym.sym == SDLK_w) {
-                    Mix_PlayChannel(-1, sfxnavigate, 0);                    
-                        if (borderpos > height / 2 + 90) {
-                            borderpos -= 60;
-                        }
-                    } else if (event.key.keysym.sym == SDLK_DOWN || event.key.keysym.sym == SDLK_s){
-                    Mix_PlayChannel(-1, sfxnavigate, 0);                    
-                        if (borderpos < height / 2 + 210) {
-                            borderpos += 60;
-                            
-                        }
-                    }
+void match_exit(Game *game) {
+    SDL_AtomicSet(&game->simRunning, 0);
+    if (game->lockstep) {
+        SDL_SemPost(game->tickStart);
+    }
+    SDL_WaitThread(game->simThread, NULL);
+    game->simThread = NULL;
+    shared_match_end();
+    playback_end(game, &game->sim);
+    replay_save(&game->sim);
+    replaydb_append(&game->sim);
+    cpu_forget(game->player1Label);
+    cpu_forget(game->player2Label);
+    texture_destroy(game->player1Label);
+    texture_destroy(game->player2Label);
+    game->player1Label = game->player2Label = NULL;
+    texture_destroy(game->hudTexture);
+    game->hudTexture = NULL;
+
+    IntervalStats *hud = &game->hudStats;
+    printf("HUD: %.4f ms per frame (sd %.4f, worst %.3f) over %llu frames, %s\n",
+           hud->meanMs, stats_stddev(hud), hud->worstMs, (unsigned long long)hud->count,
+           game->hudDirect ? "drawn directly" : "prerendered");
+
+    IntervalStats *render = &game->renderStats;
+    SDL_RendererInfo info;
+    SDL_GetRendererInfo(game->renderer, &info);
+    printf("Match render: %.3f ms per frame (sd %.3f, worst %.2f), %s\n", render->meanMs, stats_stddev(render),
+           render->worstMs, cpuRenderer.enabled ? cpuRenderer.description : info.name);
+
+    IntervalStats *ticks = &game->sim.tickStats;
+    printf("Sim ticks: %llu, interval %.2f ms (sd %.2f, worst %.1f), missed %u\n",
+           (unsigned long long)ticks->count, ticks->meanMs, stats_stddev(ticks), ticks->worstMs, ticks->missed);
+}
 
-                //option page
-                } else if(!(menu == true && option == false)){
-                    if(event.key.keysym.sym == SDLK_UP){
-                        Mix_PlayChannel(-1, sfxnavigate, 0);
-                        if (borderposY > height / 2-90) {
-                            borderposY -= 90;
-                        }
+// Keyboard changes are forwarded to the sim thread as they happen, unless a replay is playing
+void match_event(Game *game, SDL_Event *event) {
+    if (event->type == SDL_KEYDOWN && event->key.keysym.sym == SDLK_SPACE) {
+        scene_pop(game);
+    } else if (((event->type == SDL_KEYDOWN && !event->key.repeat) || event->type == SDL_KEYUP) && !playback.buttons) {
+        input_push(&game->input, read_buttons() | (event->type == SDL_KEYUP ? INPUT_KEY_RELEASED : 0));
+    }
+}
 
+void match_update(Game *game, Uint32 now) {
+    (void)now;
+    // Show the winner banner on top of the frozen match
+    const MatchState *view = snapshot_latest(&game->snapshots);
+    if (view->winner != 0) {
+        game->winnerTexture = view->winner == 1 ? &game->winner1 : &game->winner2;
+        scene_push(game, &winnerScene);
+    }
+}
 
+// Record the hitboxes a player has active this tick
+void drawHitboxes(Game *game, const Player *attacker, const Player *defender, Uint8 r, Uint8 g, Uint8 b) {
+    const FrameData *data = &game->frameData;
+    if (attacker->attackTimer == 0) {
+        return;
+    }
+    FrameDataSpan hit = data->moves[attacker->move].hit[moveTick(data, attacker)];
+    for (int i = 0; i < hit.count; i++) {
+        SDL_Rect box = boxRect(data, hit.first + i, attacker->rect.x, attacker->rect.y, attacker->rect.x < defender->rect.x);
+        draw_fill(&game->draws, LAYER_DEBUG_HITBOXES, &box, r, g, b, 0);
+    }
+}
 
-                    } else if(event.key.keysym.sym == SDLK_DOWN){
-                        Mix_PlayChannel(-1, sfxnavigate, 0);
-                        if (borderposY < height / 2+180) {
-                            borderposY += 90;
-                        }
+// The static HUD covers both health frames and the names
+#define HUD_X 100
+#define HUD_Y 0
+#define HUD_W 1000
+#define HUD_H 175
+
+// Record the health frames and names at the given offset
+void hud_draw_static(Game *game, DrawList *draws, int x, int y) {
+    SDL_Rect healthRect_p1 = {100 + x, y, 450, 175};
+    draw_copy(draws, LAYER_HUD_FRAME, game->healthTexture, NULL, &healthRect_p1, false);
+    SDL_Rect healthRect_p2 = {650 + x, y, 450, 175};
+    draw_copy(draws, LAYER_HUD_FRAME, game->healthTexture, NULL, &healthRect_p2, false);
+
+    SDL_Rect label1 = game->player1LabelRect, label2 = game->player2LabelRect;
+    label1.x += x;
+    label1.y += y;
+    label2.x += x;
+    label2.y += y;
+    draw_copy(draws, LAYER_HUD_TEXT, game->player1Label, NULL, &label1, false);
+    draw_copy(draws, LAYER_HUD_TEXT, game->player2Label, NULL, &label2, false);
+}
 
-                    }
-                    if(borderposY==height/2){
-                        if(event.key.keysym.sym == SDLK_LEFT){
-                        Mix_PlayChannel(-1, sfxnavigate, 0);
-                            if(musiccount>1){
-                                prevmusic=musiccount;
-                                musiccount--;
-                            }
-                            
-
-
-                        } else if(event.key.keysym.sym == SDLK_RIGHT){
-                        Mix_PlayChannel(-1,sfxnavigate, 0);
-                            if(musiccount<3){
-                                prevmusic=musiccount;
-                                musiccount++;
-                            }
-                            
-
-
-                        }
-                    }
-                    if(musiccount!=prevmusic){
-                        prevmusic=musiccount;
-                        // Change the music dynamically
-                        Mix_FreeMusic(bgMusic);  // Free the previous music
-                        bgMusic = Mix_LoadMUS(music(&musiccount));  // Load new music based on musiccount
-                        if (!bgMusic) {
-                            errors("Mix_LoadMUS Error: Unable to load new music.");
-                        }
-                        if(voice) {
-                            Mix_PlayMusic(bgMusic, -1);
-                        }
-                        
-                    }
-                }
-            }
-        }
+// Compose the static HUD into its target texture. Falls back to drawing the
+// pieces every frame if the renderer has no render targets. Uses the draw
+// list, so it has to run before a frame starts recording.
+void hud_build(Game *game) {
+    SDL_Renderer *renderer = game->renderer;
+    game->hudDirty = false;
+    if (game->hudDirect || !SDL_RenderTargetSupported(renderer)) {
+        return;
+    }
+    if (!game->hudTexture) {
+        game->hudTexture = texture_track(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+                                                           HUD_W, HUD_H), MEMORY_RENDER);
+        if (!game->hudTexture) {
+            SDL_Log("Unable to create the HUD texture, drawing it directly: %s", SDL_GetError());
+            return;
         }
-        // Rendering Logic
-        if (menu) {
-            loading=true;
-            player1_health=375;
-            player2_health=375;
-            player1.rect.x=100;
-            player2.rect.x=width - 150;
-
-            // Render the menu screen
-            SDL_RenderClear(renderer);
-            SDL_RenderCopy(renderer, menuTexture, NULL, NULL);
+        SDL_SetTextureBlendMode(game->hudTexture, SDL_BLENDMODE_BLEND);
+    }
 
-            // Render menu buttons with text
+    SDL_Texture *previous = SDL_GetRenderTarget(renderer);
+    SDL_SetRenderTarget(renderer, game->hudTexture);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+    hud_draw_static(game, &game->draws, -HUD_X, -HUD_Y);
+    draw_submit(&game->draws, renderer);
+    SDL_SetRenderTarget(renderer, previous);
+    resolution_apply(&game->resolution, renderer);
+}
 
-            // Set opacity based on selection
-            if (borderpos == height / 2 + 90) {
-                opacity = 0;
-            } else {
-                opacity = 100;
-            }
+// Record the most recent snapshot published by the sim thread
+void match_draw(Game *game) {
+    DrawList *draws = &game->draws;
+    if (game->hudDirty) {
+        hud_build(game); // before anything is recorded for this frame
+    }
+    const MatchState *view = snapshot_latest(&game->snapshots);
+    const Player *player1 = &view->player1, *player2 = &view->player2;
+
+    // Arena (gameplay)
+    SDL_Rect arenaRect = {0, 0, width, height};
+    draw_copy(draws, LAYER_ARENA, game->arenaTexture, NULL, &arenaRect, false);
+
+    // Debug draws are skipped entirely unless switched on
+    if (game->debugDraw) {
+        draw_fill(draws, LAYER_DEBUG_BODIES, &player1->rect, 255, 0, 0, 0); // Red for Player 1
+        draw_fill(draws, LAYER_DEBUG_BODIES, &player2->rect, 0, 0, 255, 0); // Blue for Player 2
+        drawHitboxes(game, player1, player2, 255, 165, 0); // Orange for Player 1's attack
+        drawHitboxes(game, player2, player1, 0, 255, 255); // Cyan for Player 2's attack
+    }
 
-            SDL_Rect playRect = {width / 2 - 100, height / 2 + 90, 200, 50};
-            SDL_SetRenderDrawColor(renderer, 128, 128, 128, opacity);
-            SDL_RenderCopy(renderer, ButtonTexture, NULL, &playRect);
-            SDL_RenderFillRect(renderer, &playRect);
+    bool faceRight = player1->rect.x < player2->rect.x;
+    drawSprite(draws, LAYER_FIGHTERS, &view->sprite1, !faceRight);
+    drawSprite(draws, LAYER_FIGHTERS, &view->sprite2, faceRight);
 
-            if (borderpos == height / 2 + 150) {
-                opacity = 0;
-            } else {
-                opacity = 100;
-            }
-            SDL_Rect optionRect = {width / 2 - 100, height / 2 + 150, 200, 50};
-            SDL_SetRenderDrawColor(renderer, 128, 128, 128, opacity);
-            SDL_RenderCopy(renderer, ButtonTexture, NULL, &optionRect);
-            SDL_RenderFillRect(renderer, &optionRect);
+    // Projectiles, flipped when moving left
+    drawProjectile(draws, LAYER_PROJECTILES, game->Haduoken, &view->player1Projectile, view->player1Projectile.velocityX < 0);
+    drawProjectile(draws, LAYER_PROJECTILES, game->Haduoken, &view->player2Projectile, view->player2Projectile.velocityX < 0);
+    particles_frame(game, draws, view);
 
-            if (borderpos == height / 2 + 210) {
-                opacity = 0;
-            } else {
-                opacity = 100;
-            }
-            SDL_Rect quitRect = {width / 2 - 100, height / 2 + 210, 200, 50}; 
-            SDL_SetRenderDrawColor(renderer, 128, 128, 128, opacity);
-            SDL_RenderCopy(renderer, ButtonTexture, NULL, &quitRect);
-            SDL_RenderFillRect(renderer, &quitRect);
-
-            //Menu Controls
-            SDL_Surface *navigateText = TTF_RenderText_Solid(normalfont, "UP/DOWN = NAVIGATE", textWhite);
-            SDL_Texture *navigateTextTexture = SDL_CreateTextureFromSurface(renderer, navigateText);
-            SDL_Rect navigateTextRect = {0, 0, navigateText->w-20, navigateText->h};
-            SDL_RenderCopy(renderer, navigateTextTexture, NULL, &navigateTextRect);
-            SDL_FreeSurface(navigateText);
-            SDL_DestroyTexture(navigateTextTexture);
-
-            SDL_Surface *selectText = TTF_RenderText_Solid(normalfont, "ENTER = SELECT", textWhite);
-            SDL_Texture *selectTextTexture = SDL_CreateTextureFromSurface(renderer, selectText);
-            SDL_Rect selectTextRect = {0,20, selectText->w-20, selectText->h};
-            SDL_RenderCopy(renderer, selectTextTexture, NULL, &selectTextRect);
-            SDL_FreeSurface(selectText);
-            SDL_DestroyTexture(selectTextTexture);
-
-            // Render the text for the buttons (the same code you had previously)
-            SDL_Surface *playText = TTF_RenderText_Solid(menuFont, "Play", textWhite);
-            SDL_Texture *playTextTexture = SDL_CreateTextureFromSurface(renderer, playText);
-            SDL_Rect playTextRect = {width / 2 - 55, height / 2 + 90, playText->w-20, playText->h-20};
-            SDL_RenderCopy(renderer, playTextTexture, NULL, &playTextRect);
-            SDL_FreeSurface(playText);
-            SDL_DestroyTexture(playTextTexture);
-
-            SDL_Surface *optionText = TTF_RenderText_Solid(menuFont, "Option", textWhite);
-            SDL_Texture *optionTextTexture = SDL_CreateTextureFromSurface(renderer, optionText);
-            SDL_Rect optionTextRect = {width / 2 - 80, height / 2 + 150, optionText->w-20, optionText->h-20};
-            SDL_RenderCopy(renderer, optionTextTexture, NULL, &optionTextRect);
-            SDL_FreeSurface(optionText);
-            SDL_DestroyTexture(optionTextTexture);
-
-            SDL_Surface *quitText = TTF_RenderText_Solid(menuFont, "Quit", textWhite);
-            SDL_Texture *quitTextTexture = SDL_CreateTextureFromSurface(renderer, quitText);
-            SDL_Rect quitTextRect = {width / 2 - 55, height / 2 + 210, quitText->w-20, quitText->h-20};
-            SDL_RenderCopy(renderer, quitTextTexture, NULL, &quitTextRect);
-            SDL_FreeSurface(quitText);
-            SDL_DestroyTexture(quitTextTexture);
-
-            // Draw the border around the selected menu item
-            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 0);
-            SDL_Rect borderRect = {width / 2 - 100, borderpos, 200, 50};
-            SDL_RenderDrawRect(renderer, &borderRect);
-
-
-
-            //option
-            if(option){
-                opacity=255;
-                SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, optionTexture, NULL, NULL);
-                
-                 // Set opacity based on selection
-                if (borderposY==height/2-90) {
-                    opacity = 0;
-                } else {
-                    opacity = 100;
-                }
+    SDL_Rect health1 = {140, 80, view->player1_health, 20};
+    draw_fill(draws, LAYER_HUD, &health1, 255, 0, 0, 255);
+    SDL_Rect health2 = {1070 - view->player2_health, 80, view->player2_health, 20};
+    draw_fill(draws, LAYER_HUD, &health2, 255, 0, 0, 255);
 
-                SDL_Rect soundRect = {width / 2-130, height / 2-90 , 250, 50};
-                SDL_SetRenderDrawColor(renderer, 128, 128, 128, opacity);
-                SDL_RenderCopy(renderer, ButtonTexture, NULL, &soundRect);
-                SDL_RenderFillRect(renderer, &soundRect);
+    // Static HUD: one prerendered copy, rebuilt only when invalidated
+    if (game->hudTexture) {
+        SDL_Rect hudRect = {HUD_X, HUD_Y, HUD_W, HUD_H};
+        draw_copy(draws, LAYER_HUD_FRAME, game->hudTexture, NULL, &hudRect, false);
+    } else {
+        hud_draw_static(game, draws, 0, 0);
+    }
+}
 
-                if (borderposY==height/2) {
-                    opacity = 0;
-                } else {
-                    opacity = 100;
-                }
-                SDL_Rect musicRect = {width / 2-205, height / 2, 400, 50};
-                SDL_SetRenderDrawColor(renderer, 128, 128, 128, opacity);
-                SDL_RenderCopy(renderer, ButtonTexture, NULL, &musicRect);
-                SDL_RenderFillRect(renderer, &musicRect);
-
-                if (borderposY==height/2+90) {
-                    opacity = 0;
-                } else {
-                    opacity = 100;
-                }
-                SDL_Rect helpRect = {width / 2-85, height / 2+90, 150, 50}; 
-                SDL_SetRenderDrawColor(renderer, 128, 128, 128, opacity);
-                SDL_RenderCopy(renderer, ButtonTexture, NULL, &helpRect);
-                SDL_RenderFillRect(renderer, &helpRect);
-        
-                if (borderposY==height/2+180) {
-                    opacity = 0;
-                } else {
-                    opacity = 100;
-                }
-                SDL_Rect creditRect = {width /2-105, height / 2+180, 190, 50}; 
-                SDL_SetRenderDrawColor(renderer, 128, 128, 128, opacity);
-                SDL_RenderCopy(renderer, ButtonTexture, NULL, &creditRect);
-                SDL_RenderFillRect(renderer, &creditRect);
-
-
-                SDL_Surface *navigateText = TTF_RenderText_Solid(normalfont, "UP/DOWN = NAVIGATE", textWhite);
-                SDL_Texture *navigateTextTexture = SDL_CreateTextureFromSurface(renderer, navigateText);
-                SDL_Rect navigateTextRect = {0, 0, navigateText->w-20, navigateText->h};
-                SDL_RenderCopy(renderer, navigateTextTexture, NULL, &navigateTextRect);
-                SDL_FreeSurface(navigateText);
-                SDL_DestroyTexture(navigateTextTexture);
-
-                SDL_Surface *soundchangeText = TTF_RenderText_Solid(normalfont, "LEFT/RIGHT = CHANGE MUSIC", textWhite);
-                SDL_Texture *soundchangeTextTexture = SDL_CreateTextureFromSurface(renderer, soundchangeText);
-                SDL_Rect soundchangeTextRect = {0, 20, soundchangeText->w-18, soundchangeText->h};
-                SDL_RenderCopy(renderer, soundchangeTextTexture, NULL, &soundchangeTextRect);
-                SDL_FreeSurface(soundchangeText);
-                SDL_DestroyTexture(soundchangeTextTexture);
-
-
-                SDL_Surface *selectText = TTF_RenderText_Solid(normalfont, "ENTER = SELECT", textWhite);
-                SDL_Texture *selectTextTexture = SDL_CreateTextureFromSurface(renderer, selectText);
-                SDL_Rect selectTextRect = {0,40, selectText->w-20, selectText->h};
-                SDL_RenderCopy(renderer, selectTextTexture, NULL, &selectTextRect);
-                SDL_FreeSurface(selectText);
-                SDL_DestroyTexture(selectTextTexture);
-
-                SDL_Surface *backText = TTF_RenderText_Solid(normalfont, "ESC = BACK", textWhite);
-                SDL_Texture *backTextTexture = SDL_CreateTextureFromSurface(renderer, backText);
-                SDL_Rect backTextRect = {0,60, backText->w-20, backText->h};
-                SDL_RenderCopy(renderer, backTextTexture, NULL, &backTextRect);
-                SDL_FreeSurface(backText);
-                SDL_DestroyTexture(backTextTexture);
-
-
-
-                SDL_Surface *soundText = TTF_RenderText_Solid(menuFont, "Music:", textWhite);
-                SDL_Texture *soundTextTexture = SDL_CreateTextureFromSurface(renderer, soundText);
-                SDL_Rect soundTextRect = {width / 2-120, height /2-85, soundText->w-20, soundText->h-35};
-                SDL_RenderCopy(renderer, soundTextTexture, NULL, &soundTextRect);
-                SDL_FreeSurface(soundText);
-                SDL_DestroyTexture(soundTextTexture);
-                if(voice){
-                //sound on text
-                    SDL_Surface *soundText = TTF_RenderText_Solid(menuFont, "ON", textWhite);
-                    SDL_Texture *soundTextTexture = SDL_CreateTextureFromSurface(renderer, soundText);
-                    SDL_Rect soundTextRect = {width / 2+55, height /2-85, soundText->w-70, soundText->h-35};
-                    SDL_RenderCopy(renderer, soundTextTexture, NULL, &soundTextRect);
-                    SDL_FreeSurface(soundText);
-                    SDL_DestroyTexture(soundTextTexture);
-                } else {
-                //sound off text
-                    SDL_Surface *soundText = TTF_RenderText_Solid(menuFont, "OFF", textWhite);
-                    SDL_Texture *soundTextTexture = SDL_CreateTextureFromSurface(renderer, soundText);
-                    SDL_Rect soundTextRect = {width / 2+53, height /2-85, soundText->w-100, soundText->h-35};
-                    SDL_RenderCopy(renderer, soundTextTexture, NULL, &soundTextRect);
-                    SDL_FreeSurface(soundText);
-                    SDL_DestroyTexture(soundTextTexture);
-                }
-                if(musiccount==1){
-                    SDL_Surface *changeText = TTF_RenderText_Solid(menuFont, "Music:Bane", textWhite);
-                    SDL_Texture *changeTextTexture = SDL_CreateTextureFromSurface(renderer, changeText);
-                    SDL_Rect changeTextRect = {width / 2-160, height /2+5, changeText->w-20, changeText->h-35};
-                    SDL_RenderCopy(renderer,changeTextTexture, NULL, &changeTextRect);
-                    SDL_FreeSurface(changeText);
-                    SDL_DestroyTexture(changeTextTexture);
-                } else if(musiccount==2){
-                    SDL_Surface *changeText = TTF_RenderText_Solid(menuFont, "Music:War", textWhite);
-                    SDL_Texture *changeTextTexture = SDL_CreateTextureFromSurface(renderer, changeText);
-                    SDL_Rect changeTextRect = {width / 2-145, height /2+5, changeText->w-20, changeText->h-35};
-                    SDL_RenderCopy(renderer,changeTextTexture, NULL, &changeTextRect);
-                    SDL_FreeSurface(changeText);
-                    SDL_DestroyTexture(changeTextTexture);  
-                } else if(musiccount==3){
-                    SDL_Surface *changeText = TTF_RenderText_Solid(menuFont, "Music:Intense", textWhite);
-                    SDL_Texture *changeTextTexture = SDL_CreateTextureFromSurface(renderer, changeText);
-                    SDL_Rect changeTextRect = {width / 2-185, height /2+5, changeText->w-20, changeText->h-35};
-                    SDL_RenderCopy(renderer,changeTextTexture, NULL, &changeTextRect);
-                    SDL_FreeSurface(changeText);
-                    SDL_DestroyTexture(changeTextTexture);  
-                    
-                }
-                
-                SDL_Surface *helpText = TTF_RenderText_Solid(menuFont, "Help", textWhite);
-                SDL_Texture *helpTextTexture = SDL_CreateTextureFromSurface(renderer, helpText);
-                SDL_Rect helpTextRect = {width / 2-75, height /2+95, helpText->w, helpText->h-35};
-                SDL_RenderCopy(renderer,helpTextTexture, NULL, &helpTextRect);
-                SDL_FreeSurface(helpText);
-                SDL_DestroyTexture(helpTextTexture);
-                
-                
-                
-                SDL_Surface *creditText = TTF_RenderText_Solid(menuFont, "Credits", textWhite);
-                SDL_Texture *creditTextTexture = SDL_CreateTextureFromSurface(renderer, creditText);
-                SDL_Rect creditTextRect = {width / 2-95, height /2+185, creditText->w-20, creditText->h-35};
-                SDL_RenderCopy(renderer,creditTextTexture, NULL, &creditTextRect);
-                SDL_FreeSurface(creditText);
-                SDL_DestroyTexture(creditTextTexture);
-                
-                // Border Around Selected Buttons
-                SDL_SetRenderDrawColor(renderer, 255, 255, 255, 0);
-                SDL_Rect borderRect = {width/2-200, borderposY, 300, 50};
-                SDL_RenderDrawRect(renderer, &borderRect);
-                
-                
-                if(help){
-                    SDL_RenderClear(renderer); 
-                    SDL_RenderCopy(renderer, helpTexture, NULL, NULL);
-                    SDL_Surface *backText = TTF_RenderText_Solid(normalfont, "ESC = BACK", textWhite);
-                    SDL_Texture *backTextTexture = SDL_CreateTextureFromSurface(renderer, backText);
-                    SDL_Rect backTextRect = {0,0, backText->w-20, backText->h};
-                    SDL_RenderCopy(renderer, backTextTexture, NULL, &backTextRect);
-                    SDL_FreeSurface(backText);
-                    SDL_DestroyTexture(backTextTexture);
-
-
-
-                    SDL_RenderPresent(renderer); // Present the rendered frame to the screen
-                   
+// Submit the match draws and account for the render time and the HUD's share
+void match_submit(Game *game) {
+    DrawList *draws = &game->draws;
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (cpuRenderer.enabled) {
+        cpu_submit(draws, game->renderer);
+    } else {
+        draw_submit(draws, game->renderer);
+    }
+    SDL_RenderFlush(game->renderer); // count the backend's batched work in this frame
+    stats_add(&game->renderStats, (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency(), false);
+    Uint64 hudTicks = draws->layerTicks[LAYER_HUD] + draws->layerTicks[LAYER_HUD_FRAME] + draws->layerTicks[LAYER_HUD_TEXT];
+    stats_add(&game->hudStats, hudTicks * 1000.0 / SDL_GetPerformanceFrequency(), false);
+}
 
-                }
-                if(credit){
-                    //credit on text
-                    SDL_RenderClear(renderer);  // Clear screen to fill with credit content_
-                    SDL_RenderCopy(renderer,creditsmenu, NULL, NULL);  // Full-screen credit image
-                    SDL_Surface *creditstext = TTF_RenderText_Solid(normalfont,"CREDITS",textWhite);
-                    SDL_Rect creditsTextRect = {width / 2-95, height /2-100, creditstext->w-20, creditstext->h-35};
-                    SDL_Texture *creditsTextTexture= SDL_CreateTextureFromSurface(renderer,creditstext);
-                    SDL_RenderCopy(renderer,creditsTextTexture,NULL,&creditsTextRect);
-                    SDL_FreeSurface(creditstext);
-                    SDL_DestroyTexture(creditsTextTexture);
-                    SDL_Surface *backText = TTF_RenderText_Solid(normalfont, "ESC = BACK", textWhite);
-                    SDL_Texture *backTextTexture = SDL_CreateTextureFromSurface(renderer, backText);
-                    SDL_Rect backTextRect = {0,0, backText->w-20, backText->h};
-                    SDL_RenderCopy(renderer, backTextTexture, NULL, &backTextRect);
-                    SDL_FreeSurface(backText);
-                    SDL_DestroyTexture(backTextTexture);
-                    SDL_RenderPresent(renderer);
-                }
+void match_render(Game *game) {
+    if (game->lockstep && playback_tick(game)) {
+        SDL_SemPost(game->tickStart);
+        SDL_SemWait(game->tickDone);
+    }
+    draw_begin(&game->draws);
+    match_draw(game);
+    match_submit(game);
+}
 
 
+// ---- Winner banner ----
 
+void winner_update(Game *game, Uint32 now) {
+    if (scene_elapsed(game, now) >= WINNER_DURATION) {
+        scene_reset(game, &menuScene);
+    }
+}
 
+void winner_render(Game *game) {
+    draw_begin(&game->draws);
+    match_draw(game);
+    draw_copy(&game->draws, LAYER_OVERLAY, *game->winnerTexture, NULL, NULL, false);
+    match_submit(game);
+}
 
-            }
-        SDL_RenderPresent(renderer);
 
-        bool face=true;
+const Scene introScene = { "intro", false, intro_enter, intro_exit, intro_event, intro_update, intro_render, 0,
+                           0, STREAM_MENUS };
+const Scene menuScene = { "menu", true, NULL, NULL, menu_event, NULL, menu_render, IMAGES_MENU,
+                          STREAM_MENUS, STREAM_BIT(STREAM_OPTION) | STREAM_MATCH };
+const Scene optionScene = { "option", true, NULL, NULL, option_event, NULL, option_render, IMAGES_PAGES,
+                            STREAM_BIT(STREAM_BUTTON) | STREAM_BIT(STREAM_OPTION),
+                            STREAM_BIT(STREAM_HELP) | STREAM_BIT(STREAM_CREDITS) | STREAM_MENUS };
+const Scene helpScene = { "help", true, NULL, NULL, page_event, NULL, help_render, IMAGES_PAGES,
+                          STREAM_BIT(STREAM_HELP), STREAM_BIT(STREAM_BUTTON) | STREAM_BIT(STREAM_OPTION) };
+const Scene creditScene = { "credit", true, NULL, NULL, page_event, NULL, credit_render, IMAGES_PAGES,
+                            STREAM_BIT(STREAM_CREDITS), STREAM_BIT(STREAM_BUTTON) | STREAM_BIT(STREAM_OPTION) };
+const Scene loadingScene = { "loading", false, loading_enter, loading_exit, NULL, loading_update, loading_render, IMAGES_ALL,
+                             0, STREAM_MATCH };
+const Scene matchScene = { "match", false, match_enter, match_exit, match_event, match_update, match_render, IMAGES_ALL,
+                           STREAM_MATCH, STREAM_WINNERS };
+const Scene winnerScene = { "winner", false, NULL, NULL, NULL, winner_update, winner_render, IMAGES_ALL,
+                            STREAM_MATCH | STREAM_WINNERS, STREAM_MENUS };
+
+
+// Route one event to the top scene; key presses and window changes dirty static scenes
+void dispatch_event(Game *game, SDL_Event *event) {
+    if (event->type == SDL_QUIT) {
+        game->run = false;  // Exit the game
+        return;
+    }
+    if (event->type == SDL_KEYDOWN || event->type == SDL_WINDOWEVENT) {
+        game->dirty = true;
+    }
+    // Render target contents are lost on a device reset, and a resize changes the output scale
+    if (event->type == SDL_RENDER_TARGETS_RESET || event->type == SDL_RENDER_DEVICE_RESET ||
+        (event->type == SDL_WINDOWEVENT && event->window.event == SDL_WINDOWEVENT_SIZE_CHANGED)) {
+        game->hudDirty = true;
+    }
+    if (event->type == SDL_CONTROLLERDEVICEADDED || event->type == SDL_CONTROLLERDEVICEREMOVED) {
+        controllers_hotplug(event);
+        return;
+    }
+    if (event->type == SDL_CONTROLLERBUTTONDOWN && controllers_slot(event->cbutton.which) >= 0) {
+        // The sim thread polls pads in a match; everywhere else they stand in for the keyboard
+        if (scene_top(game) == &matchScene) {
+            controllers_pressed(event);
+            return;
+        }
+        SDL_Keycode key = controllers_menu_key(event->cbutton.button);
+        if (key) {
+            SDL_Event keyEvent;
+            memset(&keyEvent, 0, sizeof(keyEvent));
+            keyEvent.type = SDL_KEYDOWN;
+            keyEvent.key.timestamp = event->cbutton.timestamp;
+            keyEvent.key.state = SDL_PRESSED;
+            keyEvent.key.keysym.sym = key;
+            dispatch_event(game, &keyEvent);
+        }
+        return;
+    }
+    if (event->type == SDL_KEYDOWN && event->key.keysym.sym == SDLK_F1) {
+        game->showMetrics = !game->showMetrics;
+        return;
+    }
+    if (event->type == SDL_KEYDOWN && event->key.keysym.sym == SDLK_F2) {
+        game->debugDraw = !game->debugDraw;
+        return;
+    }
+    if (event->type == SDL_KEYDOWN && event->key.keysym.sym == SDLK_F3) {
+        game->showMemory = !game->showMemory;
+        return;
+    }
+    if (scene_top(game)->event) {
+        scene_top(game)->event(game, event);
+    }
+}
 
-        } else if (play) {
+// ---- Soak test ----
+
+// --soak N drives the real scenes through N cycles on the dummy drivers:
+// credits, menu, options (sound toggle, music switching, help and credits
+// pages), loading, a scripted fight and the winner banner. Keys go through
+// dispatch_event like real ones; the timed screens are fast-forwarded and
+// the match runs in lockstep, one tick per frame, as fast as frames render.
+// Once SOAK_WARMUP cycles have filled every cache, live texture, surface,
+// sound, music and font counts must stay exactly where they were, and heap
+// and RSS may only grow by a small slack, or the run fails.
+#define SOAK_WARMUP 3
+#define SOAK_WAIT_FRAMES 5          // frames each scripted screen is shown
+#define SOAK_STUCK_FRAMES 600       // waiting longer than this for a scene fails the run
+#define SOAK_MATCH_FRAMES (TICK_RATE * 180)
+#define SOAK_REPORT_EVERY 50
+#define SOAK_FPS 1000               // frame cap unless --fps says otherwise
+#define SOAK_HEAP_SLACK (1 << 20)
+#define SOAK_RSS_SLACK (32 << 20)
+
+enum { SOAK_KEY, SOAK_WAIT, SOAK_FAST_FORWARD, SOAK_FIGHT };
 
-            if(loading){
-                
-                loadTexture =IMG_LoadTexture(renderer,loader);
-                if(!loadTexture){
-                    errors("SDL_image Error: Unable to load menu image.");
-                }
-                SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, loadTexture, NULL, NULL);
-                SDL_RenderPresent(renderer);
-                SDL_Delay(3000);
-                loading=false;
-                SDL_DestroyTexture(loadTexture);
-            }
+typedef struct {
+    const Scene *scene;  // has to be on top before the step runs
+    int action;
+    SDL_Keycode key;
+} SoakStep;
+
+// One cycle. Menu and option cursors are pushed against the ends first, so
+// the script does not depend on where the previous cycle left them.
+const SoakStep soakScript[] = {
+    { &introScene, SOAK_WAIT, 0 }, { &introScene, SOAK_KEY, SDLK_RETURN },
+    { &menuScene, SOAK_KEY, SDLK_UP }, { &menuScene, SOAK_KEY, SDLK_UP },
+    { &menuScene, SOAK_KEY, SDLK_DOWN }, { &menuScene, SOAK_KEY, SDLK_RETURN },      // Option
+    { &optionScene, SOAK_KEY, SDLK_UP }, { &optionScene, SOAK_KEY, SDLK_UP },
+    { &optionScene, SOAK_KEY, SDLK_UP },
+    { &optionScene, SOAK_KEY, SDLK_RETURN }, { &optionScene, SOAK_KEY, SDLK_RETURN }, // sound off and on
+    { &optionScene, SOAK_KEY, SDLK_DOWN },
+    { &optionScene, SOAK_KEY, SDLK_RIGHT }, { &optionScene, SOAK_KEY, SDLK_RIGHT },
+    { &optionScene, SOAK_KEY, SDLK_LEFT },                                           // switch tracks
+    { &optionScene, SOAK_KEY, SDLK_DOWN }, { &optionScene, SOAK_KEY, SDLK_RETURN },   // help page
+    { &helpScene, SOAK_WAIT, 0 }, { &helpScene, SOAK_KEY, SDLK_ESCAPE },
+    { &optionScene, SOAK_KEY, SDLK_DOWN }, { &optionScene, SOAK_KEY, SDLK_RETURN },   // credits page
+    { &creditScene, SOAK_WAIT, 0 }, { &creditScene, SOAK_KEY, SDLK_ESCAPE },
+    { &optionScene, SOAK_KEY, SDLK_ESCAPE },
+    { &menuScene, SOAK_KEY, SDLK_UP }, { &menuScene, SOAK_KEY, SDLK_RETURN },         // Play
+    { &loadingScene, SOAK_FAST_FORWARD, 0 },
+    { &matchScene, SOAK_FIGHT, 0 },
+    { &winnerScene, SOAK_FAST_FORWARD, 0 },
+    { &menuScene, SOAK_WAIT, 0 },
+};
+#define SOAK_STEPS ((int)(sizeof(soakScript) / sizeof(soakScript[0])))
 
-            // Render the arena (gameplay)
-            SDL_RenderClear(renderer);
-            SDL_Rect arenaRect = {0, 0, width, height};
-            SDL_RenderCopy(renderer, arenaTexture, NULL, &arenaRect);
-
-
-
- 
-
-
-            if(!pause){
-                const Uint8 *keystate = SDL_GetKeyboardState(NULL);
-                // Handle movement and collision for both players
-                handle_movement(&player2, keystate, SDL_SCANCODE_J, SDL_SCANCODE_L, &player1.rect);
-                handle_movement(&player1, keystate, SDL_SCANCODE_A, SDL_SCANCODE_D, &player2.rect);
-                
-                // Handle jump for both players
-                handle_jump(&player1);
-                handle_jump(&player2);
-
-                // Handle attacks and collision detection
-                if (player1.isPunching || player1.isKicking) {
-                    SDL_Rect attackRect1 = compute_attack_rect(&player1, &player2);
-                    if (SDL_HasIntersection(&attackRect1, &player2.rect)) {
-                        if (player1.isPunching) {
-                            Mix_PlayChannel(1, punch, 0);
-                            player2_health -= 1;
-                        } else if (player1.isKicking) {
-                            Mix_PlayChannel(1, kick, 0);
-                            player2_health -= 0.5;
-                        }
-
-                        // Clamp health to a minimum of 0
-                        if (player2_health < 0) {
-                            player2_health = 0;
-                        }
-                    }
-                }
-                if(player2_health==0){
-                    play=false;
-                    menu=true;
-                    SDL_RenderCopy(renderer,winner1,NULL,NULL);
-                    SDL_RenderPresent(renderer);
-                    SDL_Delay(5000);
-                }
-                if (player2.isPunching || player2.isKicking) {
-                    SDL_Rect attackRect2 = compute_attack_rect(&player2, &player1);
-                    if (SDL_HasIntersection(&attackRect2, &player1.rect)) {
-                        if (player2.isPunching) {
-                            player1_health -= 1;
-                        } else if (player2.isKicking) {
-                            player1_health -= 0.5;
-                        }
-
-                        // Clamp health to a minimum of 0
-                        if (player1_health < 0) {
-                            player1_health = 0;
-                        }
-                    }
-                } 
-                if (player1Projectile.active && SDL_HasIntersection(&player1Projectile.rect, &player2.rect)) {
-                    player2_health -= 5; // Only hits the opponent
-                    player1Projectile.active = false;
-                }
+typedef struct {
+    int textures, surfaces, chunks, music, fonts;
+    Sint64 heap;
+    Uint64 rss;
+} SoakCounts;
 
-                if (player2Projectile.active && SDL_HasIntersection(&player2Projectile.rect, &player1.rect)) {
-                    player1_health -= 5; // Only hits the opponent
-                    player2Projectile.active = false;
-                }
+typedef struct {
+    int cycles;          // 0: no soak run
+    int cycle;
+    int step;
+    int frames;          // frames in the current step
+    int stuck;           // frames spent waiting for the step's scene
+    Uint32 held;         // scripted fight buttons last pushed
+    Uint64 cycleStart;
+    double *cycleMs;
+    SoakCounts baseline;
+    char failure[160];
+} Soak;
+
+Soak soak;
+
+void soak_measure(SoakCounts *counts) {
+    counts->textures = texture_count();
+    counts->surfaces = SDL_AtomicGet(&resources.surfaces);
+    counts->chunks = resources.chunks;
+    counts->music = resources.music;
+    counts->fonts = resources.fonts;
+    counts->heap = memory_get(&memory.heapBytes);
+    counts->rss = process_rss();
+}
 
-                if(player1_health==0){
-                    play=false;
-                    menu=true;
-                    SDL_RenderCopy(renderer,winner2,NULL,NULL);
-                    SDL_RenderPresent(renderer);
-                    SDL_Delay(5000);
-                }
+void soak_fail(Game *game, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    SDL_vsnprintf(soak.failure, sizeof(soak.failure), format, args);
+    va_end(args);
+    game->run = false;
+}
 
+void soak_key(Game *game, SDL_Keycode key) {
+    SDL_Event event;
+    memset(&event, 0, sizeof(event));
+    event.type = SDL_KEYDOWN;
+    event.key.state = SDL_PRESSED;
+    event.key.keysym.sym = key;
+    dispatch_event(game, &event);
+}
 
-       }
+// Player 1 walks into player 2 and alternates punches and kicks; player 2
+// throws the odd fireball and jump so those paths run too
+void soak_fight(Game *game, int frame) {
+    const MatchState *view = snapshot_latest(&game->snapshots);
+    Uint32 buttons = view->player1.rect.x < view->player2.rect.x ? INPUT_P1_RIGHT : INPUT_P1_LEFT;
+    if (frame % 24 == 0) {
+        buttons |= INPUT_P1_PUNCH;
+    } else if (frame % 24 == 12) {
+        buttons |= INPUT_P1_KICK;
+    }
+    if (frame % 150 == 75) {
+        buttons |= INPUT_P2_SPECIAL;
+    } else if (frame % 200 == 100) {
+        buttons |= INPUT_P2_JUMP;
+    }
+    input_push(&game->input, buttons | (soak.held & ~buttons ? INPUT_KEY_RELEASED : 0));
+    soak.held = buttons;
+}
 
-            // Decrease attack timers
-        if (player1.attackTimer > 0) {
-            player1.attackTimer--;
-            if (player1.attackTimer == 0) {
-                player1.isPunching = false;
-                player1.isKicking = false;
-            }
+void soak_cycle_done(Game *game) {
+    double ms = (SDL_GetPerformanceCounter() - soak.cycleStart) * 1000.0 / SDL_GetPerformanceFrequency();
+    soak.cycleMs[soak.cycle++] = ms;
+    SoakCounts now;
+    soak_measure(&now);
+    if (soak.cycle == SOAK_WARMUP) {
+        soak.baseline = now;
+    } else if (soak.cycle > SOAK_WARMUP) {
+        const SoakCounts *base = &soak.baseline;
+        if (now.textures != base->textures || now.surfaces != base->surfaces || now.chunks != base->chunks ||
+            now.music != base->music || now.fonts != base->fonts) {
+            soak_fail(game, "cycle %d: textures %d -> %d, surfaces %d -> %d, sounds %d -> %d, music %d -> %d, fonts %d -> %d",
+                      soak.cycle, base->textures, now.textures, base->surfaces, now.surfaces, base->chunks, now.chunks,
+                      base->music, now.music, base->fonts, now.fonts);
+        } else if (memory.hooked && now.heap > base->heap + SOAK_HEAP_SLACK) {
+            soak_fail(game, "cycle %d: heap grew %.1f KB since warm-up", soak.cycle, (now.heap - base->heap) / 1024.0);
+        } else if (now.rss > base->rss + SOAK_RSS_SLACK) {
+            soak_fail(game, "cycle %d: RSS grew %.1f MB since warm-up", soak.cycle, (now.rss - base->rss) / 1048576.0);
+        }
+    }
+    if (soak.cycle % SOAK_REPORT_EVERY == 0 || soak.cycle == soak.cycles) {
+        int n = SDL_min(soak.cycle, SOAK_REPORT_EVERY);
+        double sum = 0;
+        for (int i = soak.cycle - n; i < soak.cycle; i++) {
+            sum += soak.cycleMs[i];
         }
+        printf("Soak cycle %d/%d: %.1f ms per cycle over the last %d, RSS %.1f MB, heap %.1f MB, %d textures\n",
+               soak.cycle, soak.cycles, sum / n, n, now.rss / 1048576.0, now.heap / 1048576.0, now.textures);
+        fflush(stdout);
+    }
+    if (soak.cycle == soak.cycles) {
+        game->run = false;
+    }
+    if (!game->run) {
+        return;
+    }
+    soak.cycleStart = SDL_GetPerformanceCounter();
+    scene_reset(game, &introScene);
+}
 
-        if (player2.attackTimer > 0) {
-            player2.attackTimer--;
-            if (player2.attackTimer == 0) {
-                player2.isPunching = false;
-                player2.isKicking = false;
-            }
+// Main thread, once per loop iteration: advance the script by one frame
+void soak_frame(Game *game) {
+    if (soak.cycles == 0 || !game->run) {
+        return;
+    }
+    const SoakStep *step = &soakScript[soak.step];
+    if (step->action == SOAK_FIGHT && scene_top(game) == &winnerScene) {
+        soak.step++;
+        soak.frames = 0;
+        soak.held = 0;
+        return;
+    }
+    if (scene_top(game) != step->scene) {
+        if (++soak.stuck > SOAK_STUCK_FRAMES) {
+            soak_fail(game, "cycle %d, step %d: waited for %s, still on %s", soak.cycle + 1, soak.step,
+                      step->scene->name, scene_top(game)->name);
+        }
+        return;
+    }
+    soak.stuck = 0;
+    bool done = true;
+    switch (step->action) {
+    case SOAK_KEY:
+        soak_key(game, step->key);
+        break;
+    case SOAK_WAIT:
+        done = ++soak.frames >= SOAK_WAIT_FRAMES;
+        break;
+    case SOAK_FAST_FORWARD:
+        // Backdate the scene so its own timer fires on the next update
+        done = ++soak.frames >= SOAK_WAIT_FRAMES;
+        if (done) {
+            game->enteredAt[game->sceneCount - 1] -= 60000;
+        }
+        break;
+    case SOAK_FIGHT:
+        soak_fight(game, soak.frames);
+        done = false;
+        if (++soak.frames > SOAK_MATCH_FRAMES) {
+            soak_fail(game, "cycle %d: the scripted match did not finish", soak.cycle + 1);
         }
+        break;
+    }
+    if (!done) {
+        return;
+    }
+    soak.frames = 0;
+    if (++soak.step == SOAK_STEPS) {
+        soak.step = 0;
+        soak_cycle_done(game);
+    }
+}
 
-        player1Projectile.rect.w = PROJECTILE_WIDTH; // Set width
-        player1Projectile.rect.h = PROJECTILE_HEIGHT; // Set height
+bool soak_start(int cycles) {
+    soak.cycles = cycles;
+    soak.cycleMs = SDL_malloc(sizeof(double) * cycles);
+    soak.cycleStart = SDL_GetPerformanceCounter();
+    return soak.cycleMs != NULL;
+}
 
+// Print the verdict; true when the run passed
+bool soak_finish(void) {
+    if (soak.cycles == 0) {
+        return true;
+    }
+    if (!soak.failure[0] && soak.cycle < soak.cycles) {
+        snprintf(soak.failure, sizeof(soak.failure), "stopped after %d of %d cycles", soak.cycle, soak.cycles);
+    }
+    if (soak.cycle > 0) {
+        // Slowdown over the run: the first and last tenth (at least one cycle) compared
+        int n = SDL_max(1, soak.cycle / 10), worst = 0;
+        double first = 0, last = 0, total = 0;
+        for (int i = 0; i < soak.cycle; i++) {
+            total += soak.cycleMs[i];
+            first += i < n ? soak.cycleMs[i] : 0;
+            last += i >= soak.cycle - n ? soak.cycleMs[i] : 0;
+            worst = soak.cycleMs[i] > soak.cycleMs[worst] ? i : worst;
+        }
+        printf("Soak: %d cycles, %.1f ms mean, first %d %.1f ms, last %d %.1f ms (%+.1f%%), worst %.1f ms (cycle %d)\n",
+               soak.cycle, total / soak.cycle, n, first / n, n, last / n, first > 0 ? 100.0 * (last - first) / first : 0.0,
+               soak.cycleMs[worst], worst + 1);
+    }
+    SDL_free(soak.cycleMs);
+    soak.cycleMs = NULL;
+    printf("Soak %s%s\n", soak.failure[0] ? "FAILED: " : "passed", soak.failure);
+    return !soak.failure[0];
+}
 
-        //Update sprite positions based on player rects
-        sprite1.x = player1.rect.x + player1.rect.w / 2;
-        sprite1.y = player1.rect.y + player1.rect.h / 2;
+// Frame pacing numbers drawn over whatever scene is on top
+void metrics_render(Game *game) {
+    FramePacer *pacer = &game->pacer;
+    SDL_Renderer *renderer = game->renderer;
+    TTF_Font *font = game->normalfont;
 
-        sprite2.x = player2.rect.x + player2.rect.w / 2;
-        sprite2.y = player2.rect.y + player2.rect.h / 2;
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+    SDL_Rect panel = {width - 260, 0, 260, game->simThread ? 178 : 90};
+    SDL_RenderFillRect(renderer, &panel);
 
-        // Render player rectangles
-        SDL_SetRenderDrawColor(renderer, 255, 0, 0, 0); // Red for Player 1
-        SDL_RenderFillRect(renderer, &player1.rect);
+    if (pacer->vsync) {
+        renderText(renderer, font, arena_printf(&frameArena, "VSYNC  sim %d Hz", TICK_RATE), width - 250, 0, 0, 0);
+    } else {
+        renderText(renderer, font, arena_printf(&frameArena, "LIMIT %d FPS  sim %d Hz", pacer->targetFps, TICK_RATE),
+                   width - 250, 0, 0, 0);
+    }
+    IntervalStats *frames = &pacer->frames;
+    renderText(renderer, font, arena_printf(&frameArena, "frame %.2f ms  sd %.2f", frames->meanMs, stats_stddev(frames)),
+               width - 250, 22, 0, 0);
+    renderText(renderer, font, arena_printf(&frameArena, "worst %.1f ms  missed %u", frames->worstMs, frames->missed),
+               width - 250, 44, 0, 0);
+    renderText(renderer, font, arena_printf(&frameArena, "FPS %.1f  res %dx%d",
+                                            frames->meanMs > 0 ? 1000.0 / frames->meanMs : 0.0,
+                                            resolution_w(&game->resolution), resolution_h(&game->resolution)),
+               width - 250, 66, 0, 0);
+
+    // Sim tick jitter comes from the sim thread's latest snapshot
+    if (game->simThread) {
+        const IntervalStats *ticks = &snapshot_latest(&game->snapshots)->tickStats;
+        renderText(renderer, font, arena_printf(&frameArena, "tick %.2f ms  sd %.2f", ticks->meanMs, stats_stddev(ticks)),
+                   width - 250, 88, 0, 0);
+        renderText(renderer, font, arena_printf(&frameArena, "tick worst %.1f  missed %u", ticks->worstMs, ticks->missed),
+                   width - 250, 110, 0, 0);
+        renderText(renderer, font, arena_printf(&frameArena, "draws %d  tex %d  hud %.3f ms", game->draws.submitted,
+                                                game->draws.textureSwitches, game->hudStats.meanMs),
+                   width - 250, 132, 0, 0);
+        renderText(renderer, font, arena_printf(&frameArena, "particles %d/%d  %.3f ms", particles.count, particles.cap,
+                                                particles.updateStats.meanMs),
+                   width - 250, 154, 0, 0);
+    }
+}
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 255, 0); // Blue for Player 2
-        SDL_RenderFillRect(renderer, &player2.rect);
+// Heap and texture memory by category, live and peak, in KB
+void memory_render(Game *game) {
+    SDL_Renderer *renderer = game->renderer;
+    TTF_Font *font = game->normalfont;
+    int rows = 0;
+    for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+        rows += memory_get(&memory.usage[i].peak) > 0 || memory.usage[i].texturePeak > 0;
+    }
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 160);
+    SDL_Rect panel = {0, 0, 420, 22 * (rows + 3)};
+    SDL_RenderFillRect(renderer, &panel);
 
-        if(player1.rect.x<player2.rect.x){
-        renderSprite(&sprite1, renderer, false); // Render sprite1
-        renderSprite(&sprite2, renderer, true); // Render sprite2
+    if (!memory.hooked) {
+        renderText(renderer, font, "heap accounting off", 10, 0, 0, 0);
+    } else {
+        renderText(renderer, font, arena_printf(&frameArena, "heap %.1f MB  peak %.1f  %u allocs/frame",
+                                                memory_get(&memory.heapBytes) / 1048576.0,
+                                                memory_get(&memory.heapPeak) / 1048576.0, memory.frameAllocations),
+                   10, 0, 0, 0);
+    }
+    renderText(renderer, font, arena_printf(&frameArena, "textures %.1f MB  peak %.1f  arena %.0f/%.0f KB",
+                                            memory.textureBytes / 1048576.0, memory.texturePeak / 1048576.0,
+                                            frameArena.peak / 1024.0, frameArena.size / 1024.0),
+               10, 22, 0, 0);
+    renderText(renderer, font, "KB        heap / peak     tex / peak", 10, 44, 0, 0);
+    int y = 66;
+    for (int i = 0; i < MEMORY_CATEGORIES; i++) {
+        MemoryUsage *usage = &memory.usage[i];
+        if (memory_get(&usage->peak) == 0 && usage->texturePeak == 0) {
+            continue;
         }
-        else{
-        renderSprite(&sprite1, renderer, true); // Render sprite1
-        renderSprite(&sprite2, renderer, false); // Render sprite2
-            
+        renderText(renderer, font, arena_printf(&frameArena, "%-8s %6.0f / %-6.0f %6.0f / %.0f", memoryNames[i],
+                                                memory_get(&usage->bytes) / 1024.0, memory_get(&usage->peak) / 1024.0,
+                                                usage->textureBytes / 1024.0, usage->texturePeak / 1024.0),
+                   10, y, 0, 0);
+        y += 22;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    memory_hook();
+    Game game = {0};
+    game.startupBegin = SDL_GetPerformanceCounter();
+    startup.last = game.startupBegin;
+    game.renderOnDemand = true;
+    bool vsync = true;
+    int targetFps = 0; // DEFAULT_FPS, or SOAK_FPS for a soak run
+    Uint32 rendererFlags = SDL_RENDERER_ACCELERATED;
+    int cpuThreads = 0;
+    float renderScale = 0; // dynamic
+    int audioBuffer = DEFAULT_AUDIO_BUFFER;
+    bool customMixer = false, latencyTest = false;
+    bool headless = false, startInMatch = false, sharedMemory = false;
+    const char *spectatePath = NULL, *telemetryPath = NULL, *recordDir = NULL, *verifyDir = NULL;
+    const char *replayDbDir = NULL, *seekTarget = NULL, *playPath = NULL;
+    int spectatePort = 0, soakCycles = 0, benchParticles = 0, textureBudget = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-idle") == 0) {
+            game.renderOnDemand = false;
+        } else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc) {
+            assetpackfile = argv[++i];
+        } else if (strcmp(argv[i], "--no-texture-cache") == 0) {
+            textureCache.enabled = false;
+        } else if (strcmp(argv[i], "--hud-direct") == 0) {
+            game.hudDirect = true;
+        } else if (strcmp(argv[i], "--hitboxes") == 0) {
+            game.debugDraw = true;
+        } else if (strcmp(argv[i], "--no-vsync") == 0) {
+            vsync = false;
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            targetFps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--renderer") == 0 && i + 1 < argc) {
+            // "software" is SDL's own rasterizer, "cpu" the SIMD one drawing the match
+            const char *name = argv[++i];
+            if (strcmp(name, "software") == 0 || strcmp(name, "cpu") == 0) {
+                rendererFlags = SDL_RENDERER_SOFTWARE;
+                cpuRenderer.enabled = strcmp(name, "cpu") == 0;
+            }
+        } else if (strcmp(argv[i], "--cpu-threads") == 0 && i + 1 < argc) {
+            cpuThreads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc) {
+            renderScale = atof(argv[++i]); // pins the internal resolution, e.g. 0.75
+        } else if (strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc) {
+            audioBuffer = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--audio-mixer") == 0 && i + 1 < argc) {
+            customMixer = strcmp(argv[++i], "custom") == 0;
+        } else if (strcmp(argv[i], "--audio-latency-test") == 0) {
+            latencyTest = true;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture.directory = argv[++i];
+        } else if (strcmp(argv[i], "--capture-raw") == 0 && i + 1 < argc) {
+            capture.rawPath = argv[++i];
+        } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            capture.goldenDir = argv[++i];
+        } else if (strcmp(argv[i], "--capture-frames") == 0 && i + 1 < argc) {
+            capture.frameLimit = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--start") == 0 && i + 1 < argc) {
+            startInMatch = strcmp(argv[++i], "match") == 0;
+        } else if (strcmp(argv[i], "--spectate") == 0 && i + 1 < argc) {
+            spectatePath = argv[++i];
+        } else if (strcmp(argv[i], "--spectate-port") == 0 && i + 1 < argc) {
+            spectatePort = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+            telemetryPath = argv[++i];
+        } else if (strcmp(argv[i], "--shm") == 0) {
+            sharedMemory = true;
+        } else if (strcmp(argv[i], "--soak") == 0 && i + 1 < argc) {
+            soakCycles = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordDir = argv[++i];
+        } else if (strcmp(argv[i], "--verify-replays") == 0 && i + 1 < argc) {
+            verifyDir = argv[++i];
+            headless = true;
+        } else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc) {
+            playPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay-db") == 0 && i + 1 < argc) {
+            replayDbDir = argv[++i];
+        } else if (strcmp(argv[i], "--replay-seek") == 0 && i + 1 < argc) {
+            seekTarget = argv[++i];
+            headless = true;
+        } else if (strcmp(argv[i], "--particle-bench") == 0 && i + 1 < argc) {
+            benchParticles = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+            textureBudget = atoi(argv[++i]); // MB of streamed textures, e.g. 8
         }
+    }
+    if (cpuRenderer.enabled) {
+        game.hudDirect = true; // The HUD texture is a render target the CPU renderer cannot read
+    }
+    if (soakCycles > 0) {
+        // Unattended and as fast as the machine goes, the match one tick per frame
+        headless = true;
+        game.lockstep = true;
+        game.renderOnDemand = false;
+        targetFps = targetFps > 0 ? targetFps : SOAK_FPS;
+    }
+    if (playPath) {
+        // The recorded buttons go in one tick per frame, straight into a match
+        game.lockstep = true;
+        game.renderOnDemand = false;
+        startInMatch = true;
+    }
+    if (targetFps <= 0) {
+        targetFps = DEFAULT_FPS;
+    }
+    if (headless) {
+        // CI: no display or sound card. The environment can still pick e.g. the offscreen driver.
+        SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+        SDL_setenv("SDL_AUDIODRIVER", "dummy", 0);
+        rendererFlags = SDL_RENDERER_SOFTWARE;
+        vsync = false;
+    }
+    if (capture_enabled()) {
+        // Reproducible frames: full internal resolution, every frame kept, one sim tick each
+        renderScale = renderScale > 0 ? renderScale : 1.0f;
+        capture.waitForEncoder = headless || capture.goldenDir;
+        game.lockstep = true;
+        game.renderOnDemand = false;
+    }
 
+    // Map the asset pack first so its pages are read in while SDL starts up
+    if (!assets_mount(assetpackfile)) {
+        SDL_Log("No asset pack at %s, loading loose files", assetpackfile);
+    }
+    texcache_init();
+    startup_mark("assets");
 
-        // Render Player 1's attack
-        if (player1.isPunching || player1.isKicking) {
-            SDL_Rect attackRect1 = compute_attack_rect(&player1, &player2);
-            SDL_SetRenderDrawColor(renderer, 255, 165, 0, 0); // Orange for attack
-            SDL_RenderFillRect(renderer, &attackRect1);
-        }
+    // Initialize SDL: only video (and its events) here. Audio comes up with
+    // the mixer and game controllers after the first frame; timers, haptics
+    // and sensors are never used.
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        errors("SDL_Init Error: Unable to initialize SDL.");
+    }
+    startup_mark("video");
 
-        // Render Player 2's attack
-        if (player2.isPunching || player2.isKicking) {
-            SDL_Rect attackRect2 = compute_attack_rect(&player2, &player1);
-            SDL_SetRenderDrawColor(renderer, 0, 255, 255, 0); // Cyan for attack
-            SDL_RenderFillRect(renderer, &attackRect2);
-        }
-        // Render projectiles
-        if (player1Projectile.active) {
-            bool flip = (player1Projectile.velocityX < 0); // Flip if moving left
-            renderProjectile(renderer, Haduoken, &player1Projectile, flip);
-        }
-        if (player2Projectile.active) {
-            bool flip = (player2Projectile.velocityX < 0); // Flip if moving left
-            renderProjectile(renderer, Haduoken, &player2Projectile, flip);
-        }
+    // Create Window
+    game.window = SDL_CreateWindow("Fight Arena", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    if (!game.window) {
+        errors("SDL_CreateWindow Error: Unable to create window.");
+    }
+    startup_mark("window");
+
+    // Create Renderer
+    game.renderer = SDL_CreateRenderer(game.window, -1, rendererFlags | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
+    if (!game.renderer) {
+        errors("SDL_CreateRenderer Error: Unable to create renderer.");
+    }
+    SDL_Renderer *renderer = game.renderer;
+    memory_tag(MEMORY_RENDER);
+    if (cpuRenderer.enabled && !cpu_init(renderer, cpuThreads)) {
+        cpuRenderer.enabled = false;
+    }
+    // The CPU renderer rasterizes at the logical size whatever the target, so it gains nothing from scaling
+    resolution_init(&game.resolution, renderer, cpuRenderer.enabled && renderScale <= 0 ? 1.0f : renderScale);
+    particles_open(renderer);
+    memory_tag(MEMORY_OTHER);
+
+    // Fall back to the limiter if the driver could not give us VSync
+    SDL_RendererInfo rendererInfo;
+    if (SDL_GetRendererInfo(renderer, &rendererInfo) != 0 || !(rendererInfo.flags & SDL_RENDERER_PRESENTVSYNC)) {
+        vsync = false;
+    }
+    pacer_init(&game.pacer, targetFps, vsync);
+    startup_mark("renderer");
 
+    // Initialize SDL_mixer (for audio)
+    memory_tag(MEMORY_AUDIO);
+    if (!audio_open(audioBuffer, customMixer)) {
+        errors("SDL_mixer Error: Unable to initialize audio.");
+    }
+    if (latencyTest) {
+        int result = audio_latency_test();
+        audio_close();
+        Mix_Quit();
+        SDL_Quit();
+        assets_unmount();
+        return result;
+    }
+    memory_tag(MEMORY_OTHER);
+    startup_mark("audio");
 
-           
+    // Initialize SDL_image (for textures): PNG for the screens, JPG for the credits video
+    int imageFormats = IMG_INIT_PNG | IMG_INIT_JPG;
+    if ((IMG_Init(imageFormats) & imageFormats) != imageFormats) {
+        errors("SDL_image Error: Unable to initialize PNG and JPG support.");
+    }
 
+    // Initialize SDL_ttf (for text)
+    if (TTF_Init() == -1) {
+        errors("SDL_ttf Error: Unable to initialize SDL_ttf.");
+    }
+    startup_mark("image/ttf");
+
+    // Menu and option state
+    game.run = true;
+    game.voice = true;
+    game.borderpos = height / 2 + 90;
+    game.borderposY = height / 2;
+    game.musiccount = 1;
+    game.prevmusic = 1;
+
+    // Streamed textures are registered as they are queued below
+    if (!residency_open(renderer, textureBudget)) {
+        errors("Texture Error: Unable to stream textures within a budget.");
+    }
 
+    // Decode the menu, page and arena images on the worker pool, in the order
+    // the screens need them (see IMAGES_MENU/IMAGES_PAGES); the main loop uploads them as they finish
+    DecodePool *decoder = &game.decoder;
+    decode_add(decoder, STREAM_MENU, menuimage, &game.menuTexture, "SDL_image Error: Unable to load menu image.");
+    decode_add(decoder, STREAM_BUTTON, Button, &game.ButtonTexture, "SDL_image Error: Unable to load button image.");
+    decode_add(decoder, STREAM_OPTION, optionimage, &game.optionTexture, "SDL_image Error: Unable to load option image.");
+    decode_add(decoder, STREAM_HELP, helpbg, &game.helpTexture, "SDL_image Error: Unable to load help image.");
+    decode_add(decoder, STREAM_CREDITS, creditmenu, &game.creditsmenu, "SDL_image Error: Unable to load menu image.");
+    decode_add(decoder, STREAM_ARENA, arenabackground, &game.arenaTexture, "SDL_image Error: Unable to load option image.");
+    decode_add(decoder, STREAM_HEALTH, health, &game.healthTexture, "SDL_image Error: Unable to load menu image.");
+    decode_add(decoder, STREAM_FIREBALL, "rsrc/animation/haduoken.bmp", &game.Haduoken, "SDL_image Error: Unable to load Haduoken image.");
+    decode_add(decoder, STREAM_WINNER1, p1wins, &game.winner1, "SDL_image Error: Unable to load menu image.");
+    decode_add(decoder, STREAM_WINNER2, p2wins, &game.winner2, "SDL_image Error: Unable to load menu image.");
+    decode_start(decoder);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);  // Enable transparency blend mode
 
-            // Update and render sprites
-            currentTime = SDL_GetTicks();
-            updateSprite(&sprite1, currentTime);
-            updateSprite(&sprite2, currentTime);
+    //oldengl font
+    game.menuFont = font_open(buttonfont, 64);
+    if (!game.menuFont) {
+        errors("TTF_OpenFont Error: Unable to open font.");
+    }
 
+    //TIMES font
+    game.normalfont = font_open(textfont, 20);
+    if (!game.normalfont) {
+        errors("TTF_OpenFont Error: Unable to open font.");
+    }
 
-            // Update projectiles
-            update_projectile(&player1Projectile, &player2);
-            update_projectile(&player2Projectile, &player1);
+    // Load the hitbox/hurtbox tables
+    if (!loadFrameData(framedatafile, &game.frameData)) {
+        errors("Could not load frame data.");
+    }
+    game.idleMove = findMove(&game.frameData, "idle");
+    game.punchMove = findMove(&game.frameData, "punch");
+    game.kickMove = findMove(&game.frameData, "kick");
+    if (game.idleMove < 0 || game.punchMove < 0 || game.kickMove < 0) {
+        errors("Frame data is missing the idle, punch or kick move.");
+    }
+    if (telemetryPath && !telemetry_open(telemetryPath, &game.frameData)) {
+        errors("Telemetry Error: Unable to open the telemetry log.");
+    }
+    if (recordDir && !replay_open(recordDir)) {
+        errors("Replay Error: Unable to record replays.");
+    }
+    if (seekTarget && !replayDbDir) {
+        errors("Replay Error: --replay-seek needs --replay-db.");
+    }
+    if (replayDbDir && !seekTarget && !replaydb_open(replayDbDir, &game.frameData)) {
+        errors("Replay Error: Unable to open the replay database.");
+    }
 
+    // Load animation clips and their sprite sheets
+    if (!loadAnimations(ryuanims, &game.ryuAnims) || !loadAnimations(kenanims, &game.kenAnims)) {
+        errors("Could not load animation files.");
+    }
+    game.ryu1 = characterTexture(game.ryuAnims.sheet, renderer);
+    game.ken1 = characterTexture(game.kenAnims.sheet, renderer);
+    if (!game.ryu1 || !game.ken1) {
+        errors("Could not load sprite sheets.");
+    }
+    residency_add(STREAM_RYU, game.ryuAnims.sheet, &game.ryu1);
+    residency_add(STREAM_KEN, game.kenAnims.sheet, &game.ken1);
+    residency_adopt(&game.ryu1);
+    residency_adopt(&game.ken1);
+    // Initialize sprites with their characters
+    Sprite sprite1 = { .spriteSheet = &game.ryu1, .anims = &game.ryuAnims, .currentAnimation = STANCE, .x = width / 2, .y = height / 2 };
+    Sprite sprite2 = { .spriteSheet = &game.ken1, .anims = &game.kenAnims, .currentAnimation = STANCE, .x = width / 2, .y = height / 2 };
+    resetSprite(&sprite1);
+    resetSprite(&sprite2);
+    game.sprite1 = sprite1;
+    game.sprite2 = sprite2;
 
-            
-            SDL_Rect health1={140,80,player1_health,20};
-            SDL_SetRenderDrawColor(renderer,255,0,0,255);
-            SDL_RenderFillRect(renderer,&health1);
-            SDL_RenderDrawRect(renderer,&health1);
-            
-            int health2_center = 800;
-            int health2_width = player2_health; // Health bar width based on current health
-            SDL_Rect health2 = {1070 - player2_health, 80, player2_health, 20};
-            SDL_SetRenderDrawColor(renderer,255,0,0,255);
-            SDL_RenderFillRect(renderer,&health2);
-            SDL_RenderDrawRect(renderer,&health2);
+    // **Audio Setup**
+    // Load background music (wav file)
+    memory_tag(MEMORY_AUDIO);
+    // Optional: the tracks are not part of a checkout, and CI runs need no music
+    game.bgMusic = music_load(music(&game.musiccount));
+    if (!game.bgMusic) {
+        SDL_Log("No music at %s, playing none", music(&game.musiccount));
+    }
+    // Load sound effects
+    game.sfxselect = chunk_load(selection);
+    game.sfxnavigate = chunk_load(navigation);
+    game.punch = chunk_load(punching);
+    game.kick = chunk_load(kicking);
+    audio_add_sound(game.sfxselect);
+    audio_add_sound(game.sfxnavigate);
+    audio_add_sound(game.punch);
+    audio_add_sound(game.kick);
+    memory_tag(MEMORY_OTHER);
 
-            SDL_Rect healthRect_p1={100,0,450,175};
-            SDL_RenderCopy(renderer,healthTexture,NULL,&healthRect_p1);
-            SDL_Rect healthRect_p2={650,0,450,175};
-            SDL_RenderCopy(renderer,healthTexture,NULL,&healthRect_p2);
+    // Play the background music in a loop (-1 means infinite loop)
+    if (game.voice && game.bgMusic) {
+        Mix_PlayMusic(game.bgMusic, -1);  // Start the music immediately and loop indefinitely
+    }
 
-            SDL_Surface *player1Text = TTF_RenderText_Solid(normalfont, "PLAYER 1", textWhite);
-            SDL_Texture *player1TextTexture = SDL_CreateTextureFromSurface(renderer, player1Text);
-            SDL_Rect player1TextRect = {137,0, player1Text->w+100, player1Text->h+50};
-            SDL_RenderCopy(renderer, player1TextTexture, NULL, &player1TextRect);
-            SDL_FreeSurface(player1Text);
-            SDL_DestroyTexture(player1TextTexture);
+    if (game.lockstep) {
+        game.tickStart = SDL_CreateSemaphore(0);
+        game.tickDone = SDL_CreateSemaphore(0);
+    }
+    if (playPath && !playback_open(playPath)) {
+        errors("Replay Error: Unable to read the replay to play.");
+    }
+    if (soakCycles > 0 && !soak_start(soakCycles)) {
+        errors("Soak Error: Unable to start the soak test.");
+    }
+    if (capture_enabled()) {
+        if (!capture_start()) {
+            errors("Capture Error: Unable to start frame capture.");
+        }
+    }
+    if ((spectatePath || spectatePort > 0) && !spectator_open(spectatePath, spectatePort)) {
+        errors("Spectator Error: Unable to open the spectator stream.");
+    }
+    if (sharedMemory && !shared_open()) {
+        errors("Shared Memory Error: Unable to export the match state.");
+    }
+    int diverged = 0;
+    bool benchFailed = false;
+    if (verifyDir) {
+        // Regression run: no scenes, just the replays through the sim
+        diverged = replay_verify_all(&game, verifyDir);
+        game.run = false;
+    } else if (seekTarget) {
+        diverged = replaydb_seek(&game, replayDbDir, seekTarget) ? 0 : 1;
+        game.run = false;
+    } else if (benchParticles > 0) {
+        benchFailed = !particles_bench(&game, benchParticles);
+        game.run = false;
+    } else if (startInMatch) {
+        // Straight into a fresh match, as the menu would through the loading screen
+        scene_push(&game, &menuScene);
+        scene_push(&game, &loadingScene);
+        scene_switch(&game, &matchScene);
+    } else {
+        scene_push(&game, &introScene);
+    }
+    startup_mark("loading");
 
-            SDL_Surface *player2Text = TTF_RenderText_Solid(normalfont, "PLAYER 2", textWhite);
-            SDL_Texture *player2TextTexture = SDL_CreateTextureFromSurface(renderer, player2Text);
-            SDL_Rect player2TextRect = {687,0, player2Text->w+100, player2Text->h+50};
-            SDL_RenderCopy(renderer, player2TextTexture, NULL, &player2TextRect);
-            SDL_FreeSurface(player2Text);
-            SDL_DestroyTexture(player2TextTexture);
+    // Main Game Loop: events, update and render all go to the top scene only
+    Uint64 lastTick = SDL_GetPerformanceCounter();
+    while (game.run) {
+        bool onDemand = game.renderOnDemand && scene_top(&game)->onDemand;
+        Uint64 frameStart = SDL_GetPerformanceCounter();
+        clock_t cpuStart = clock();
+        arena_reset(&frameArena);
 
+        SDL_Event event;
+        if (onDemand && !game.dirty) {
+            // Nothing changes on a static screen until input arrives, so sleep in the event queue
+            if (SDL_WaitEventTimeout(&event, IDLE_WAIT_TIMEOUT)) {
+                dispatch_event(&game, &event);
+            }
+        }
+        while (SDL_PollEvent(&event)) {
+            dispatch_event(&game, &event);
+        }
+        soak_frame(&game);
+        decode_pump(&game.decoder, renderer);
+        if (residency_frame(renderer)) {
+            game.dirty = true;
+            game.hudDirty = true; // the HUD texture is composed from the health frame
+        }
+        spectator_pump();
+        controllers_latency();
+
+        // Run the simulation in fixed ticks so game speed does not follow the render rate
+        Uint32 now = SDL_GetTicks();
+        Uint64 tickPeriod = game.pacer.frequency / TICK_RATE;
+        game.simAccumulator += frameStart - lastTick;
+        lastTick = frameStart;
+        if (game.simAccumulator > MAX_CATCHUP_TICKS * tickPeriod) {
+            game.simAccumulator = MAX_CATCHUP_TICKS * tickPeriod;
+        }
+        while (game.simAccumulator >= tickPeriod && scene_top(&game)->update) {
+            scene_top(&game)->update(&game, now);
+            game.simAccumulator -= tickPeriod;
+        }
+        if (!scene_top(&game)->update) {
+            game.simAccumulator = 0;
         }
 
-        SDL_RenderPresent(renderer); //render everything 
+        if (game.dirty || !(game.renderOnDemand && scene_top(&game)->onDemand)) {
+            Uint64 renderStart = SDL_GetPerformanceCounter();
+            memory_frame();
+            resolution_begin(&game.resolution, renderer);
+            SDL_RenderClear(renderer);
+            scene_top(&game)->render(&game);
+            if (!capture_frame(renderer)) {
+                game.run = false; // --capture-frames reached
+            }
+            resolution_end(&game.resolution, renderer);
+            if (game.showMetrics) {
+                metrics_render(&game);
+            }
+            if (game.showMemory) {
+                memory_render(&game);
+            }
+            SDL_RenderFlush(renderer);
+            double renderMs = (SDL_GetPerformanceCounter() - renderStart) * 1000.0 / SDL_GetPerformanceFrequency();
+            pacer_wait(&game.pacer);
+            SDL_RenderPresent(renderer); //render everything
+            pacer_frame(&game.pacer);
+            resolution_update(&game.resolution, renderMs, &game.pacer);
+            game.dirty = false;
+            if (!game.presented) {
+                game.presented = true;
+                startup_mark("first frame");
+                printf("First frame (%s): %.1f ms after launch\n", scene_top(&game)->name,
+                       (SDL_GetPerformanceCounter() - game.startupBegin) * 1000.0 / SDL_GetPerformanceFrequency());
+                startup_report();
+                if (!headless) {
+                    controllers_open();
+                }
+            }
+        } else {
+            pacer_idle(&game.pacer);
+        }
+        if (scene_top(&game)->onDemand) {
+            game.idleWallTicks += SDL_GetPerformanceCounter() - frameStart;
+            game.idleCpuTicks += clock() - cpuStart;
+        }
+    }
 
-        SDL_Delay(16); //60 FPS 
+    if (game.idleWallTicks > 0) {
+        double wall = (double)game.idleWallTicks / SDL_GetPerformanceFrequency();
+        double cpu = (double)game.idleCpuTicks / CLOCKS_PER_SEC;
+        printf("Menu idle: %.1f%% CPU over %.1f s (%s)\n", 100.0 * cpu / wall, wall,
+               game.renderOnDemand ? "render on demand" : "always redraw");
     }
+    IntervalStats *frames = &game.pacer.frames;
+    printf("Frames: %llu, interval %.2f ms (sd %.2f, worst %.1f), missed %u, %s\n",
+           (unsigned long long)frames->count, frames->meanMs, stats_stddev(frames),
+           frames->worstMs, frames->missed, game.pacer.vsync ? "vsync" : "limiter");
+    Resolution *res = &game.resolution;
+    printf("Render scale: %d%% at exit (%dx%d), %u change(s), render %.2f ms, %s\n", (int)(res->scale * 100 + 0.5f),
+           resolution_w(res), resolution_h(res), res->changes, res->loadMs,
+           !res->target ? "no render target" : res->dynamic ? "dynamic" : "fixed");
+
+    int mismatched = capture_stop();
+    spectator_close();
+    bool soakPassed = soak_finish();
 
     // Cleanup
-    Mix_FreeMusic(bgMusic);
-    Mix_FreeChunk(sfxnavigate);
-    Mix_FreeChunk(sfxselect);
-    SDL_DestroyTexture(loadTexture);
-    SDL_DestroyTexture(menuTexture);
-    SDL_DestroyTexture(optionTexture);
-    SDL_DestroyTexture(helpTexture);
-    SDL_DestroyTexture(ryu1);
-    SDL_DestroyTexture(ken1);
-    SDL_DestroyTexture(healthTexture);
+    while (game.sceneCount > 0) {
+        scene_pop(&game);
+    }
+    bool playbackMatched = playback_close();
+    SDL_DestroySemaphore(game.tickStart);
+    SDL_DestroySemaphore(game.tickDone);
+    telemetry_close();
+    shared_close();
+    replay_close();
+    replaydb_close();
+    controllers_close();
+    decode_wait(&game.decoder, renderer, IMAGES_ALL); // let the workers finish before freeing
+    residency_close();
+    audio_close();
+    music_free(game.bgMusic);
+    chunk_free(game.sfxnavigate);
+    chunk_free(game.sfxselect);
+    chunk_free(game.punch);
+    chunk_free(game.kick);
+    texture_destroy(game.menuTexture);
+    texture_destroy(game.ButtonTexture);
+    texture_destroy(game.optionTexture);
+    texture_destroy(game.helpTexture);
+    texture_destroy(game.creditsmenu);
+    texture_destroy(game.arenaTexture);
+    texture_destroy(game.Haduoken);
+    texture_destroy(game.winner1);
+    texture_destroy(game.winner2);
+    texture_destroy(game.ryu1);
+    texture_destroy(game.ken1);
+    texture_destroy(game.healthTexture);
+    SDL_free(game.frameData.boxes);
+    if (cpuRenderer.enabled) {
+        cpu_shutdown();
+    }
+    particles_close();
+    texture_destroy(game.resolution.target);
     SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    TTF_CloseFont(menuFont); 
+    SDL_DestroyWindow(game.window);
+    font_close(game.menuFont);
+    font_close(game.normalfont);
+    arena_free(&frameArena);
     TTF_Quit();
     Mix_Quit();
     IMG_Quit();
     SDL_Quit();
+    memory_report(); // whatever is still live here leaked
+    assets_unmount();
 
-    return 0;
+    return mismatched > 0 || !soakPassed || diverged != 0 || benchFailed || !playbackMatched ? 1 : 0; // golden-image, soak, replay and budget failures fail the CI run
 }
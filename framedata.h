@@ -0,0 +1,53 @@
+// Frame data table format, written by tools/framedata.c and read by the game.
+//
+// A move is a startup/active/recovery timeline counted in simulation ticks.
+// For every tick it lists the hitboxes and hurtboxes in force, as spans into
+// one shared box table. Boxes are relative to the fighter rect facing right
+// and are stored column by column (structure of arrays) so the game can test
+// FRAMEDATA_LANES hurtboxes per SIMD compare. Each column is padded with
+// empty boxes so a full-width load never runs past the end.
+//
+// File layout (host byte order):
+//   FrameDataHeader
+//   FrameDataMove[moveCount]
+//   int16 x1[boxCount], x2[boxCount], mx1[boxCount], mx2[boxCount], y1[boxCount], y2[boxCount]
+//
+// x1/x2 and y1/y2 are the box edges; mx1/mx2 are the same edges mirrored
+// for a fighter facing left, precomputed so the game never branches per box.
+#ifndef FRAMEDATA_H
+#define FRAMEDATA_H
+
+#include <stdint.h>
+
+#define FRAMEDATA_MAGIC "FAFD"
+#define FRAMEDATA_VERSION 1
+#define FRAMEDATA_MAX_MOVES 16
+#define FRAMEDATA_MAX_TICKS 64
+#define FRAMEDATA_LANES 8
+#define FRAMEDATA_COLUMNS 6
+#define FRAMEDATA_FIGHTER_WIDTH 30 // mirror axis, matches RECT_WIDTH
+
+typedef struct {
+    uint16_t first;  // index of the first box in the box table
+    uint16_t count;  // number of boxes
+} FrameDataSpan;
+
+typedef struct {
+    char name[12];
+    uint16_t damage;
+    uint16_t startup;   // ticks before the first active tick
+    uint16_t active;    // ticks the hitboxes can connect
+    uint16_t recovery;  // ticks after the last active tick
+    FrameDataSpan hit[FRAMEDATA_MAX_TICKS];
+    FrameDataSpan hurt[FRAMEDATA_MAX_TICKS];
+} FrameDataMove;
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t moveCount;
+    uint16_t boxCount;  // per column, a multiple of FRAMEDATA_LANES plus one padding group
+    uint16_t reserved;
+} FrameDataHeader;
+
+#endif
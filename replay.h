@@ -0,0 +1,37 @@
+// Match replay format, written by the game (--record) and re-simulated by
+// --verify-replays.
+//
+// A match is fully determined by the frame data and the buttons applied at
+// each simulation tick, so a replay stores only those buttons. Alongside
+// them go checksums of a rolling hash of the match state, taken every
+// checkInterval ticks while recording. Re-simulating a replay with the
+// current code and comparing checksums shows whether, and from about which
+// tick, movement, jumps or damage now play out differently. The corpus CI
+// checks lives in tests/replays.
+//
+// File layout (host byte order):
+//   ReplayHeader
+//   uint32_t buttons[ticks]                    INPUT_* bits applied at each tick
+//   uint64_t checksums[ticks / checkInterval]  rolling hash after tick (i + 1) * checkInterval
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+
+#define REPLAY_MAGIC "FARP"
+#define REPLAY_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t tickRate;
+    uint32_t checkInterval;  // ticks between checksums
+    uint32_t ticks;          // simulated ticks, up to and including the knock-out
+    uint32_t winner;         // 0 when the match was left before a knock-out
+    int32_t health[2];       // at the end
+    uint32_t reserved;
+    uint64_t finalHash;      // rolling hash after the last tick
+    uint64_t recordedAt;     // seconds since the Unix epoch
+} ReplayHeader;
+
+#endif
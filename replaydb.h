@@ -0,0 +1,87 @@
+// Replay database, appended to by the game (--replay-db) and queried by
+// tools/replaydb.c without re-simulating anything.
+//
+// Replays go into large segment files that the game maps and appends to;
+// a record is the replay file format of replay.h followed by keyframes,
+// full gameplay states every REPLAYDB_KEYFRAME_INTERVAL ticks, so a tick
+// can be reached by restoring the keyframe before it and simulating fewer
+// than that many ticks. The `used` counter in the segment header is the
+// commit point: bytes past it belong to a record that was never finished.
+//
+// Per-match metadata goes to a separate index, one fixed-size entry per
+// replay, so queries over winners, health and damage scan a small file
+// instead of the replays. The entry number is the replay's id. Entries are
+// only written once their record is committed; a torn last entry (shorter
+// than ReplayDbEntry) is not counted and gets overwritten by the next one.
+//
+// Files in the database directory (host byte order):
+//   segment_NNNN.rdb  ReplayDbSegment, then records 8-byte aligned:
+//                     ReplayHeader, buttons padded to 8 bytes,
+//                     checksums (see replay.h), ReplayDbKeyframe[keyframes]
+//   index.rdx         ReplayDbIndex, then ReplayDbEntry per replay
+#ifndef REPLAYDB_H
+#define REPLAYDB_H
+
+#include <stdint.h>
+
+#define REPLAYDB_SEGMENT_MAGIC "FARS"
+#define REPLAYDB_INDEX_MAGIC "FARI"
+#define REPLAYDB_VERSION 1
+#define REPLAYDB_SEGMENT_SIZE (64ull << 20)  // sparse until written
+#define REPLAYDB_KEYFRAME_INTERVAL 300       // ticks, 5 s of play
+#define REPLAYDB_MOVES 16                    // frame data move slots, matches FRAMEDATA_MAX_MOVES
+#define REPLAYDB_PROJECTILE REPLAYDB_MOVES   // damage slot of fireballs
+#define REPLAYDB_MAX_HEALTH 375              // both fighters start with this
+
+enum { REPLAYDB_RYU, REPLAYDB_KEN };
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t size;                // of the segment file
+    uint64_t used;                // committed bytes, this header included
+} ReplayDbSegment;
+
+// Everything a tick depends on, for one fighter
+typedef struct {
+    int32_t x, y, w, h;
+    int32_t velocityY;
+    int32_t onGround;
+    int32_t move, attackTimer, hitLanded;
+    int32_t projectileX, projectileY, projectileVelocityX, projectileActive;
+    int32_t animation, playingAnimation, frame, frameTime; // sprite clip state
+    int32_t spriteX, spriteY;
+    int32_t health;
+} ReplayDbFighter;
+
+typedef struct {
+    uint32_t tick;                // state after this many ticks
+    uint32_t winner;
+    uint64_t hash;                // the replay's rolling hash at this tick
+    ReplayDbFighter fighters[2];
+} ReplayDbKeyframe;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t moveCount;
+    uint32_t reserved;
+    char moveNames[REPLAYDB_MOVES][12]; // frame data move names, by damage slot
+} ReplayDbIndex;
+
+typedef struct {
+    uint32_t segment;             // segment_NNNN.rdb holding the record
+    uint32_t keyframes;
+    uint64_t offset;              // of the record's ReplayHeader in the segment
+    uint64_t length;              // of the whole record
+    uint64_t recordedAt;          // seconds since the Unix epoch
+    uint32_t ticks;
+    uint32_t winner;              // 0: left before a knock-out
+    int32_t health[2];            // at the end
+    uint8_t characters[2];        // REPLAYDB_RYU, REPLAYDB_KEN
+    uint16_t reserved;
+    uint32_t hits[2];             // by player
+    int32_t damage[2][REPLAYDB_MOVES + 1]; // dealt by player, by move; fireballs last
+} ReplayDbEntry;
+
+#endif
@@ -0,0 +1,111 @@
+// Shared-memory match state, published by the game (--shm) for overlays,
+// bots and monitoring. See tools/shmreader.c and tools/shmbench.c.
+//
+// The game maps a POSIX shared-memory object named SHAREDSTATE_NAME and,
+// after every simulation tick, copies the match into it under a seqlock:
+// `sequence` is odd while a copy is in progress, so a reader retries until
+// it sees the same even value before and after its own copy. Readers never
+// block the game and the game never waits for a reader.
+//
+// The input ring runs the other way: one external process drives player 2
+// by writing SharedInput slots and advancing inputHead; the sim thread
+// consumes them at its next tick and advances inputTail. Everything is
+// plain memory in host byte order, accessed with the __atomic builtins.
+#ifndef SHAREDSTATE_H
+#define SHAREDSTATE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define SHAREDSTATE_NAME "/fight-arena"
+#define SHAREDSTATE_MAGIC "FASM"
+#define SHAREDSTATE_VERSION 1
+#define SHAREDSTATE_INPUTS 64 // a power of two
+
+// Player 2 buttons in SharedInput.buttons
+#define SHARED_JUMP    0x01
+#define SHARED_LEFT    0x02
+#define SHARED_RIGHT   0x04
+#define SHARED_PUNCH   0x08
+#define SHARED_KICK    0x10
+#define SHARED_SPECIAL 0x20
+
+typedef struct {
+    int32_t x, y, w, h;          // fighter rect
+    int32_t health;
+    int32_t animation;           // WALKING..SPECIAL being played
+    int32_t frame;               // frame within that clip
+    int32_t projectileActive;
+    int32_t projectileX, projectileY;
+} SharedFighter;
+
+typedef struct {
+    uint32_t tick;
+    uint32_t inMatch;            // 0 outside a match: the other fields are stale
+    uint32_t winner;             // 0 while fighting, then 1 or 2
+    uint32_t inputsApplied;      // SharedInput slots consumed so far
+    uint64_t publishNs;          // CLOCK_MONOTONIC when this copy was written
+    uint64_t lastInputSentNs;    // sentNs of the newest input applied in this tick
+    SharedFighter fighters[2];
+} SharedMatch;
+
+typedef struct {
+    uint32_t buttons;            // SHARED_*, the complete held state
+    uint32_t reserved;
+    uint64_t sentNs;             // CLOCK_MONOTONIC when written, echoed back for latency checks
+} SharedInput;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;               // sizeof(SharedState)
+    uint32_t pid;                // the game's
+    uint32_t sequence;           // seqlock over `match`
+    uint32_t reserved;
+    SharedMatch match;
+
+    // External process -> game, player 2 only. Own cache lines, away from the state.
+    uint32_t inputHead __attribute__((aligned(64)));  // advanced by the writer
+    uint32_t inputTail __attribute__((aligned(64)));  // advanced by the game
+    SharedInput inputs[SHAREDSTATE_INPUTS];
+} SharedState;
+
+// Game side: copy `match` in under the seqlock
+static inline void sharedstate_write(SharedState *shared, const SharedMatch *match) {
+    uint32_t sequence = __atomic_load_n(&shared->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&shared->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&shared->match, match, sizeof(*match));
+    __atomic_store_n(&shared->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+// Reader side: a consistent copy of `match`. Returns the retries it took.
+static inline int sharedstate_read(const SharedState *shared, SharedMatch *match) {
+    for (int retries = 0;; retries++) {
+        uint32_t before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            continue; // the game is mid-copy
+        }
+        memcpy(match, (const void *)&shared->match, sizeof(*match));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shared->sequence, __ATOMIC_RELAXED) == before) {
+            return retries;
+        }
+    }
+}
+
+// Writer side of the input ring; 0 when the game has not caught up with the ring
+static inline int sharedstate_send(SharedState *shared, uint32_t buttons, uint64_t sentNs) {
+    uint32_t head = __atomic_load_n(&shared->inputHead, __ATOMIC_RELAXED);
+    if (head - __atomic_load_n(&shared->inputTail, __ATOMIC_ACQUIRE) == SHAREDSTATE_INPUTS) {
+        return 0;
+    }
+    SharedInput *slot = &shared->inputs[head % SHAREDSTATE_INPUTS];
+    slot->buttons = buttons;
+    slot->reserved = 0;
+    slot->sentNs = sentNs;
+    __atomic_store_n(&shared->inputHead, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+#endif
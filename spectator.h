@@ -0,0 +1,155 @@
+// Spectator stream format, written by the game and read by tools/viewer.c.
+//
+// The sim describes the match as SPECTATOR_FIELDS small integers per tick
+// and sends a packet for every tick in which one of them changed. Every
+// SPECTATOR_KEYFRAME_TICKS a keyframe carries all fields; the packets in
+// between carry only the fields that differ from that keyframe. Any packet
+// therefore decodes with nothing but the latest keyframe, so a sender can
+// skip deltas for a slow reader and a reader that falls behind can jump
+// straight to the newest packet.
+//
+// Stream layout (integers as LEB128 varints, signed ones zigzag-encoded):
+//   SpectatorHeader
+//   packet*: uint8 length          bytes after this one
+//            uint8 kind            SPECTATOR_KEYFRAME or SPECTATOR_DELTA
+//            varint tick
+//            keyframe: signed varint field[SPECTATOR_FIELDS]
+//            delta:    varint changed  bit i set when field i differs from the keyframe
+//                      signed varint (field - keyframe field) for each set bit
+#ifndef SPECTATOR_H
+#define SPECTATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SPECTATOR_MAGIC "FSPC"
+#define SPECTATOR_VERSION 1
+#define SPECTATOR_KEYFRAME_TICKS 60
+#define SPECTATOR_MAX_PACKET 256
+
+// Field order: per fighter, then per projectile, then the match result
+enum {
+    SPECTATOR_X, SPECTATOR_Y, SPECTATOR_WIDTH, SPECTATOR_HEIGHT, // Player.rect
+    SPECTATOR_SPRITE_X, SPECTATOR_SPRITE_Y,                      // Sprite position
+    SPECTATOR_ANIMATION,                                         // WALKING..SPECIAL being played
+    SPECTATOR_FRAME,                                             // frame within that clip
+    SPECTATOR_HEALTH,
+    SPECTATOR_FIGHTER_FIELDS
+};
+enum {
+    SPECTATOR_ACTIVE, SPECTATOR_PROJECTILE_X, SPECTATOR_PROJECTILE_Y,
+    SPECTATOR_PROJECTILE_FIELDS
+};
+#define SPECTATOR_FIGHTER(p) ((p) * SPECTATOR_FIGHTER_FIELDS)
+#define SPECTATOR_PROJECTILE(p) (2 * SPECTATOR_FIGHTER_FIELDS + (p) * SPECTATOR_PROJECTILE_FIELDS)
+#define SPECTATOR_WINNER (2 * SPECTATOR_FIGHTER_FIELDS + 2 * SPECTATOR_PROJECTILE_FIELDS)
+#define SPECTATOR_FIELDS (SPECTATOR_WINNER + 1)
+
+enum { SPECTATOR_KEYFRAME = 1, SPECTATOR_DELTA = 2 };
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t tickRate;
+    uint16_t fieldCount;     // SPECTATOR_FIELDS, so a reader can reject a different layout
+    uint16_t arenaW, arenaH;
+    uint16_t projectileW, projectileH;
+} SpectatorHeader;
+
+static inline uint8_t *spectator_put(uint8_t *out, uint32_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static inline uint8_t *spectator_put_signed(uint8_t *out, int32_t value) {
+    return spectator_put(out, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+// NULL when the varint runs past end
+static inline const uint8_t *spectator_get(const uint8_t *in, const uint8_t *end, uint32_t *value) {
+    *value = 0;
+    for (int shift = 0; in < end && shift < 35; shift += 7) {
+        uint8_t byte = *in++;
+        *value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return in;
+        }
+    }
+    return NULL;
+}
+
+static inline const uint8_t *spectator_get_signed(const uint8_t *in, const uint8_t *end, int32_t *value) {
+    uint32_t raw;
+    in = spectator_get(in, end, &raw);
+    *value = (int32_t)(raw >> 1) ^ -(int32_t)(raw & 1);
+    return in;
+}
+
+// Encode one packet into out (SPECTATOR_MAX_PACKET bytes); returns its size
+// including the length byte. keyframe is ignored for SPECTATOR_KEYFRAME.
+static inline int spectator_encode(uint8_t *out, int kind, uint32_t tick, const int32_t *fields,
+                                   const int32_t *keyframe) {
+    uint8_t *p = out + 1;
+    *p++ = (uint8_t)kind;
+    p = spectator_put(p, tick);
+    if (kind == SPECTATOR_KEYFRAME) {
+        for (int i = 0; i < SPECTATOR_FIELDS; i++) {
+            p = spectator_put_signed(p, fields[i]);
+        }
+    } else {
+        uint32_t changed = 0;
+        for (int i = 0; i < SPECTATOR_FIELDS; i++) {
+            changed |= (uint32_t)(fields[i] != keyframe[i]) << i;
+        }
+        p = spectator_put(p, changed);
+        for (int i = 0; i < SPECTATOR_FIELDS; i++) {
+            if (changed & (1u << i)) {
+                p = spectator_put_signed(p, fields[i] - keyframe[i]);
+            }
+        }
+    }
+    out[0] = (uint8_t)(p - out - 1);
+    return (int)(p - out);
+}
+
+// Decode the packet body after the length byte. A keyframe also replaces
+// *keyframe. Returns the packet kind, or 0 when the packet is malformed.
+static inline int spectator_decode(const uint8_t *in, int length, int32_t *keyframe, int32_t *fields, uint32_t *tick) {
+    const uint8_t *end = in + length;
+    if (length < 2) {
+        return 0;
+    }
+    int kind = *in++;
+    in = spectator_get(in, end, tick);
+    if (!in || (kind != SPECTATOR_KEYFRAME && kind != SPECTATOR_DELTA)) {
+        return 0;
+    }
+    if (kind == SPECTATOR_KEYFRAME) {
+        for (int i = 0; i < SPECTATOR_FIELDS && in; i++) {
+            in = spectator_get_signed(in, end, &fields[i]);
+        }
+        if (!in) {
+            return 0;
+        }
+        for (int i = 0; i < SPECTATOR_FIELDS; i++) {
+            keyframe[i] = fields[i];
+        }
+        return kind;
+    }
+    uint32_t changed;
+    in = spectator_get(in, end, &changed);
+    for (int i = 0; i < SPECTATOR_FIELDS && in; i++) {
+        int32_t delta = 0;
+        if (changed & (1u << i)) {
+            in = spectator_get_signed(in, end, &delta);
+        }
+        fields[i] = keyframe[i] + delta;
+    }
+    return in ? kind : 0;
+}
+
+#endif
@@ -0,0 +1,54 @@
+// Match telemetry log format, written by the game (--telemetry) and read by
+// tools/telemetry.c.
+//
+// The sim thread records fixed-size events; a background thread appends
+// them in batches, so a log is a header followed by batches of events.
+// A batch cut short by a crash is simply ignored by readers.
+//
+// File layout (host byte order):
+//   TelemetryHeader
+//   batch*: TelemetryBatch, TelemetryEvent[count]
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+#define TELEMETRY_MAGIC "FATL"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_MAX_MOVES 16    // matches FRAMEDATA_MAX_MOVES
+#define TELEMETRY_PROJECTILE 0xFF // `move` of projectile events
+
+enum {
+    TELEMETRY_MATCH_START = 1, // a match began; tick is 0
+    TELEMETRY_MOVE,            // player started move
+    TELEMETRY_HIT,             // player's move (or projectile) hit the other fighter for damage
+    TELEMETRY_SPECIAL,         // player fired a projectile
+    TELEMETRY_ROUND            // player won at tick with damage health left
+};
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t tickRate;
+    uint32_t moveCount;
+    char moveNames[TELEMETRY_MAX_MOVES][12]; // frame data move names, by move index
+} TelemetryHeader;
+
+typedef struct {
+    uint32_t count;
+    uint32_t dropped;    // events lost since the previous batch because the ring was full
+} TelemetryBatch;
+
+typedef struct {
+    uint32_t tick;       // simulation tick within the match
+    uint16_t match;      // match number within the log, from 1
+    uint8_t type;        // TELEMETRY_*
+    uint8_t player;      // 1 or 2: who attacked, fired or won
+    uint8_t move;        // frame data move index, or TELEMETRY_PROJECTILE
+    uint8_t reserved;
+    int16_t damage;
+    int16_t attackerX, attackerY; // acting player's rect position
+    int16_t defenderX, defenderY; // the other player's
+} TelemetryEvent;
+
+#endif
@@ -0,0 +1,254 @@
+// Packs the game's assets into one file the game maps at startup.
+//
+//   gcc tools/assetpack.c -o assetpack
+//   ./assetpack rsrc/assets.txt fight.pak
+//
+// Manifest format, one directive per line ('#' starts a comment):
+//   file <path>
+//   optional <path>                   packed if present, e.g. music a checkout lacks
+//   range <pattern> <first> <last>    printf pattern with one %d, e.g. video frames
+// Paths are stored exactly as written, which is how the game asks for them.
+// Every file listed with `file` or `range` must exist, and every sheet an
+// .anim descriptor names must be packed too; all problems are reported
+// before anything is written.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../assetpack.h"
+
+#define MAX_ASSETS 1024
+#define MAX_PATH_LENGTH 256
+
+typedef struct {
+    char path[MAX_PATH_LENGTH];
+    int line;            // manifest line, for error messages
+    bool optional;       // left out of the pack when missing
+    uint64_t size;
+    uint64_t offset;
+} Asset;
+
+Asset assets[MAX_ASSETS];
+int assetCount = 0;
+int problems = 0;
+
+void fail(const char *path, int line, const char *message) {
+    printf("%s:%d: %s\n", path, line, message);
+    exit(1);
+}
+
+int find_asset(const char *path) {
+    for (int i = 0; i < assetCount; i++) {
+        if (strcmp(assets[i].path, path) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void add_asset(const char *manifest, int line, const char *path, bool optional) {
+    if (assetCount == MAX_ASSETS) {
+        fail(manifest, line, "too many assets");
+    }
+    if (strlen(path) >= MAX_PATH_LENGTH) {
+        fail(manifest, line, "path too long");
+    }
+    if (find_asset(path) >= 0) {
+        printf("%s:%d: %s listed twice\n", manifest, line, path);
+        problems++;
+        return;
+    }
+    Asset *asset = &assets[assetCount++];
+    strcpy(asset->path, path);
+    asset->line = line;
+    asset->optional = optional;
+}
+
+void parse(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("Unable to open %s\n", path);
+        exit(1);
+    }
+
+    char text[512];
+    int line = 0;
+    while (fgets(text, sizeof(text), file)) {
+        line++;
+        char keyword[16], name[MAX_PATH_LENGTH];
+        if (sscanf(text, "%15s", keyword) != 1 || keyword[0] == '#') {
+            continue;
+        }
+
+        if (strcmp(keyword, "file") == 0 || strcmp(keyword, "optional") == 0) {
+            if (sscanf(text, "%*s %255s", name) != 1) {
+                fail(path, line, "expected: file <path> or optional <path>");
+            }
+            add_asset(path, line, name, keyword[0] == 'o');
+        } else if (strcmp(keyword, "range") == 0) {
+            char pattern[MAX_PATH_LENGTH];
+            int first, last;
+            if (sscanf(text, "%*s %255s %d %d", pattern, &first, &last) != 3 || first > last ||
+                !strstr(pattern, "%d")) {
+                fail(path, line, "expected: range <pattern with %d> <first> <last>");
+            }
+            for (int i = first; i <= last; i++) {
+                snprintf(name, sizeof(name), pattern, i);
+                add_asset(path, line, name, false);
+            }
+        } else {
+            fail(path, line, "unknown directive");
+        }
+    }
+    fclose(file);
+    if (assetCount == 0) {
+        fail(path, line, "no assets");
+    }
+}
+
+// Size every asset, reporting each one that is missing; missing optional ones are dropped
+void check_files(const char *manifest) {
+    int kept = 0;
+    for (int i = 0; i < assetCount; i++) {
+        FILE *file = fopen(assets[i].path, "rb");
+        if (!file) {
+            if (assets[i].optional) {
+                printf("%s:%d: skipping optional %s, not found\n", manifest, assets[i].line, assets[i].path);
+                continue;
+            }
+            printf("%s:%d: missing asset %s\n", manifest, assets[i].line, assets[i].path);
+            problems++;
+        } else {
+            fseek(file, 0, SEEK_END);
+            assets[i].size = ftell(file);
+            fclose(file);
+        }
+        assets[kept++] = assets[i];
+    }
+    assetCount = kept;
+}
+
+// Animation descriptors name their sprite sheet; it has to be in the pack as well
+void check_sheets(const char *manifest) {
+    for (int i = 0; i < assetCount; i++) {
+        size_t length = strlen(assets[i].path);
+        if (length < 5 || strcmp(assets[i].path + length - 5, ".anim") != 0) {
+            continue;
+        }
+        FILE *file = fopen(assets[i].path, "r");
+        if (!file) {
+            continue; // Already reported as missing
+        }
+        char text[512], keyword[16], sheet[MAX_PATH_LENGTH];
+        while (fgets(text, sizeof(text), file)) {
+            if (sscanf(text, "%15s %255s", keyword, sheet) == 2 && strcmp(keyword, "sheet") == 0 &&
+                find_asset(sheet) < 0) {
+                printf("%s:%d: %s uses sheet %s, which is not packed\n", manifest, assets[i].line, assets[i].path, sheet);
+                problems++;
+            }
+        }
+        fclose(file);
+    }
+}
+
+uint64_t align(uint64_t offset) {
+    return (offset + ASSETPACK_ALIGN - 1) / ASSETPACK_ALIGN * ASSETPACK_ALIGN;
+}
+
+void write_padding(FILE *out, uint64_t to) {
+    while ((uint64_t)ftell(out) < to) {
+        fputc(0, out);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        printf("usage: %s <assets.txt> <pack>\n", argv[0]);
+        return 1;
+    }
+    parse(argv[1]);
+    check_files(argv[1]);
+    check_sheets(argv[1]);
+    if (problems > 0) {
+        printf("%d problem(s), no pack written\n", problems);
+        return 1;
+    }
+
+    // Index: at least twice as many slots as entries keeps probe runs short
+    uint32_t tableSize = 1;
+    while (tableSize < 2u * assetCount) {
+        tableSize *= 2;
+    }
+    AssetPackEntry *table = calloc(tableSize, sizeof(AssetPackEntry));
+    char *names = malloc(1 + (size_t)assetCount * MAX_PATH_LENGTH);
+    if (!table || !names) {
+        printf("Out of memory\n");
+        return 1;
+    }
+    uint32_t namesSize = 1;
+    names[0] = '\0';
+
+    uint64_t offset = align(sizeof(AssetPackHeader) + sizeof(AssetPackEntry) * tableSize);
+    for (int i = 0; i < assetCount; i++) {
+        size_t length = strlen(assets[i].path) + 1;
+        memcpy(names + namesSize, assets[i].path, length);
+        namesSize += length;
+    }
+    offset = align(offset + namesSize);
+
+    uint32_t nameOffset = 1;
+    for (int i = 0; i < assetCount; i++) {
+        assets[i].offset = offset;
+        offset = align(offset + assets[i].size);
+
+        uint32_t hash = assetpack_hash(assets[i].path);
+        uint32_t slot = hash & (tableSize - 1);
+        while (table[slot].name != 0) {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        table[slot].hash = hash;
+        table[slot].name = nameOffset;
+        table[slot].offset = assets[i].offset;
+        table[slot].size = assets[i].size;
+        nameOffset += strlen(assets[i].path) + 1;
+    }
+
+    FILE *out = fopen(argv[2], "wb");
+    if (!out) {
+        printf("Unable to write %s\n", argv[2]);
+        return 1;
+    }
+    AssetPackHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ASSETPACK_MAGIC, sizeof(header.magic));
+    header.version = ASSETPACK_VERSION;
+    header.entryCount = assetCount;
+    header.tableSize = tableSize;
+    header.namesSize = namesSize;
+    header.fileSize = offset;
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(table, sizeof(AssetPackEntry), tableSize, out);
+    fwrite(names, 1, namesSize, out);
+
+    char buffer[65536];
+    for (int i = 0; i < assetCount; i++) {
+        write_padding(out, assets[i].offset);
+        FILE *file = fopen(assets[i].path, "rb");
+        if (!file) {
+            printf("%s disappeared while packing\n", assets[i].path);
+            return 1;
+        }
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+            fwrite(buffer, 1, n, out);
+        }
+        fclose(file);
+    }
+    write_padding(out, offset);
+    fclose(out);
+
+    printf("%d assets, %llu bytes\n", assetCount, (unsigned long long)offset);
+    free(table);
+    free(names);
+    return 0;
+}
@@ -0,0 +1,201 @@
+// Compiles a frame data source file into the table the game loads.
+//
+//   gcc tools/framedata.c -o framedata
+//   ./framedata rsrc/framedata/moves.txt rsrc/framedata/moves.bin
+//
+// Source format, one directive per line ('#' starts a comment):
+//   move <name> <damage> <startup> <active> <recovery>
+//   hitbox <fromTick> <toTick> <x> <y> <w> <h>
+//   hurtbox <fromTick> <toTick> <x> <y> <w> <h>
+// Ticks are counted from the start of the move and are inclusive. Boxes are
+// relative to the fighter rect facing right. Hitboxes must lie inside the
+// active window; every tick must have at least one hurtbox.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../framedata.h"
+
+#define MAX_SOURCE_BOXES 64
+#define MAX_TABLE_BOXES 4096
+
+typedef struct {
+    int from, to;
+    int x, y, w, h;
+} SourceBox;
+
+typedef struct {
+    FrameDataMove header;
+    SourceBox hit[MAX_SOURCE_BOXES];
+    SourceBox hurt[MAX_SOURCE_BOXES];
+    int hitCount, hurtCount;
+} SourceMove;
+
+SourceMove moves[FRAMEDATA_MAX_MOVES];
+int moveCount = 0;
+
+// Box table columns: x1, x2, mx1, mx2, y1, y2
+int16_t columns[FRAMEDATA_COLUMNS][MAX_TABLE_BOXES];
+int boxCount = 0;
+
+void fail(const char *path, int line, const char *message) {
+    printf("%s:%d: %s\n", path, line, message);
+    exit(1);
+}
+
+int total_ticks(const FrameDataMove *move) {
+    return move->startup + move->active + move->recovery;
+}
+
+// Append the boxes active on a tick and return their span. Reuses the
+// previous tick's span when the list is unchanged, which keeps the table small.
+FrameDataSpan emit_tick(const SourceBox *boxes, int count, int tick, const FrameDataSpan *previous) {
+    SourceBox active[MAX_SOURCE_BOXES];
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (tick >= boxes[i].from && tick <= boxes[i].to) {
+            active[n++] = boxes[i];
+        }
+    }
+
+    FrameDataSpan span = { (uint16_t)boxCount, (uint16_t)n };
+    if (previous && previous->count == n) {
+        bool same = true;
+        for (int i = 0; i < n && same; i++) {
+            int b = previous->first + i;
+            same = columns[0][b] == active[i].x && columns[4][b] == active[i].y &&
+                   columns[1][b] == active[i].x + active[i].w && columns[5][b] == active[i].y + active[i].h;
+        }
+        if (same) {
+            return *previous;
+        }
+    }
+    if (boxCount + n > MAX_TABLE_BOXES - 2 * FRAMEDATA_LANES) {
+        printf("Too many boxes in the frame data table\n");
+        exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+        int b = boxCount++;
+        columns[0][b] = active[i].x;
+        columns[1][b] = active[i].x + active[i].w;
+        columns[2][b] = FRAMEDATA_FIGHTER_WIDTH - (active[i].x + active[i].w);
+        columns[3][b] = FRAMEDATA_FIGHTER_WIDTH - active[i].x;
+        columns[4][b] = active[i].y;
+        columns[5][b] = active[i].y + active[i].h;
+    }
+    return span;
+}
+
+void parse(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        printf("Unable to open %s\n", path);
+        exit(1);
+    }
+
+    char text[256];
+    int line = 0;
+    SourceMove *move = NULL;
+    while (fgets(text, sizeof(text), file)) {
+        line++;
+        char keyword[16];
+        if (sscanf(text, "%15s", keyword) != 1 || keyword[0] == '#') {
+            continue;
+        }
+
+        if (strcmp(keyword, "move") == 0) {
+            if (moveCount == FRAMEDATA_MAX_MOVES) {
+                fail(path, line, "too many moves");
+            }
+            move = &moves[moveCount++];
+            memset(move, 0, sizeof(*move));
+            int damage, startup, active, recovery;
+            if (sscanf(text, "%*s %11s %d %d %d %d", move->header.name, &damage, &startup, &active, &recovery) != 5 ||
+                damage < 0 || startup < 0 || active < 0 || recovery < 0) {
+                fail(path, line, "expected: move <name> <damage> <startup> <active> <recovery>");
+            }
+            move->header.damage = damage;
+            move->header.startup = startup;
+            move->header.active = active;
+            move->header.recovery = recovery;
+            int total = total_ticks(&move->header);
+            if (total == 0 || total > FRAMEDATA_MAX_TICKS) {
+                fail(path, line, "move must last between 1 and 64 ticks");
+            }
+        } else if (strcmp(keyword, "hitbox") == 0 || strcmp(keyword, "hurtbox") == 0) {
+            if (!move) {
+                fail(path, line, "box before the first move");
+            }
+            bool isHit = keyword[1] == 'i';
+            int *count = isHit ? &move->hitCount : &move->hurtCount;
+            if (*count == MAX_SOURCE_BOXES) {
+                fail(path, line, "too many boxes in one move");
+            }
+            SourceBox *box = isHit ? &move->hit[*count] : &move->hurt[*count];
+            if (sscanf(text, "%*s %d %d %d %d %d %d", &box->from, &box->to, &box->x, &box->y, &box->w, &box->h) != 6 ||
+                box->w <= 0 || box->h <= 0 || box->from > box->to) {
+                fail(path, line, "expected: <box> <fromTick> <toTick> <x> <y> <w> <h>");
+            }
+            if (box->from < 0 || box->to >= total_ticks(&move->header)) {
+                fail(path, line, "box ticks outside the move");
+            }
+            if (isHit && (box->from < move->header.startup ||
+                          box->to >= move->header.startup + move->header.active)) {
+                fail(path, line, "hitbox outside the active window");
+            }
+            (*count)++;
+        } else {
+            fail(path, line, "unknown directive");
+        }
+    }
+    fclose(file);
+    if (moveCount == 0) {
+        fail(path, line, "no moves");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        printf("usage: %s <moves.txt> <moves.bin>\n", argv[0]);
+        return 1;
+    }
+    parse(argv[1]);
+
+    for (int m = 0; m < moveCount; m++) {
+        FrameDataMove *header = &moves[m].header;
+        for (int tick = 0; tick < total_ticks(header); tick++) {
+            header->hit[tick] = emit_tick(moves[m].hit, moves[m].hitCount, tick, tick > 0 ? &header->hit[tick - 1] : NULL);
+            header->hurt[tick] = emit_tick(moves[m].hurt, moves[m].hurtCount, tick, tick > 0 ? &header->hurt[tick - 1] : NULL);
+            if (header->hurt[tick].count == 0) {
+                printf("%s: move %s has no hurtbox on tick %d\n", argv[1], header->name, tick);
+                return 1;
+            }
+        }
+    }
+
+    // Pad to whole SIMD groups plus one spare group of empty boxes
+    int padded = (boxCount + FRAMEDATA_LANES - 1) / FRAMEDATA_LANES * FRAMEDATA_LANES + FRAMEDATA_LANES;
+
+    FILE *out = fopen(argv[2], "wb");
+    if (!out) {
+        printf("Unable to write %s\n", argv[2]);
+        return 1;
+    }
+    FrameDataHeader fileHeader;
+    memset(&fileHeader, 0, sizeof(fileHeader));
+    memcpy(fileHeader.magic, FRAMEDATA_MAGIC, sizeof(fileHeader.magic));
+    fileHeader.version = FRAMEDATA_VERSION;
+    fileHeader.moveCount = moveCount;
+    fileHeader.boxCount = padded;
+    fwrite(&fileHeader, sizeof(fileHeader), 1, out);
+    for (int m = 0; m < moveCount; m++) {
+        fwrite(&moves[m].header, sizeof(FrameDataMove), 1, out);
+    }
+    for (int c = 0; c < FRAMEDATA_COLUMNS; c++) {
+        fwrite(columns[c], sizeof(int16_t), padded, out);
+    }
+    fclose(out);
+
+    printf("%d moves, %d boxes (%d padded)\n", moveCount, boxCount, padded);
+    return 0;
+}
@@ -0,0 +1,141 @@
+// Records the replay corpus CI checks with --verify-replays (see replay.h).
+//
+//   gcc -O2 tools/replaycorpus.c -o replaycorpus $(sdl2-config --cflags --libs) -lSDL2_image -lSDL2_mixer -lSDL2_ttf -lm
+//   ./replaycorpus tests/replays      (from the repository root, into an empty directory)
+//
+// Builds the game's own sim around a scripted input source and steps it the
+// way the sim thread does in lockstep, so the files are what ./fight --record
+// would write for the same buttons:
+//   replay_00000  the soak script's fight (same as ./fight --soak 1 --record DIR)
+//   replay_00001  the same fight with player 2 attacking and player 1 jumping
+//                 and throwing fireballs
+//   replay_00002  both keep their distance and trade fireballs; left before a
+//                 knock-out
+// Each file is then re-simulated with replay_verify_all before it counts.
+#define main fight_main
+#include "../fight.c"
+#undef main
+
+// One lockstep tick, as sim_thread runs it
+Uint32 corpusHeld;
+
+void corpus_tick(Game *game) {
+    MatchState *state = &game->sim;
+    Uint32 buttons = 0, queued;
+    while (input_pop(&game->input, &queued)) {
+        corpusHeld = queued & ~INPUT_KEY_RELEASED;
+        buttons |= queued;
+    }
+    buttons |= corpusHeld;
+    if (state->winner == 0) {
+        match_step(game, state, buttons);
+        replay_record(state, buttons);
+    }
+    *snapshot_back(&game->snapshots) = *state;
+    snapshot_publish(&game->snapshots);
+}
+
+// Scripts push one frame's buttons, with a release when any went up, like soak_fight
+Uint32 scriptHeld;
+
+void script_push(Game *game, Uint32 buttons) {
+    input_push(&game->input, buttons | (scriptHeld & ~buttons ? INPUT_KEY_RELEASED : 0));
+    scriptHeld = buttons;
+}
+
+// Player 2 walks into player 1 and alternates kicks and punches; player 1
+// jumps, throws fireballs and punches back now and then
+void mirror_fight(Game *game, int frame) {
+    const MatchState *view = snapshot_latest(&game->snapshots);
+    Uint32 buttons = view->player2.rect.x > view->player1.rect.x ? INPUT_P2_LEFT : INPUT_P2_RIGHT;
+    if (frame % 30 == 0) {
+        buttons |= INPUT_P2_KICK;
+    } else if (frame % 30 == 15) {
+        buttons |= INPUT_P2_PUNCH;
+    }
+    if (frame % 120 == 60) {
+        buttons |= INPUT_P1_SPECIAL;
+    } else if (frame % 90 == 45) {
+        buttons |= INPUT_P1_JUMP;
+    }
+    if (frame % 70 == 35) {
+        buttons |= INPUT_P1_PUNCH;
+    }
+    script_push(game, buttons);
+}
+
+// Both back off, then trade fireballs while player 1 hops
+void zone_fight(Game *game, int frame) {
+    Uint32 buttons = 0;
+    if (frame < 40) {
+        buttons |= INPUT_P1_LEFT | INPUT_P2_RIGHT;
+    }
+    if (frame % 100 == 50) {
+        buttons |= INPUT_P1_SPECIAL;
+    }
+    if (frame % 100 == 0) {
+        buttons |= INPUT_P2_SPECIAL;
+    }
+    if (frame % 80 == 20) {
+        buttons |= INPUT_P1_JUMP;
+    }
+    if (frame % 160 == 90) {
+        buttons |= INPUT_P1_RIGHT;
+    }
+    script_push(game, buttons);
+}
+
+// One match from the loading screen on; the first match frame ticks before
+// the script runs, with no keys down, as it does in the game
+void corpus_record(Game *game, void (*script)(Game *, int), int frames) {
+    match_reset(game, &game->sim);
+    snapshot_init(&game->snapshots, &game->sim);
+    replay_restart(&game->sim);
+    input_init(&game->input);
+    input_push(&game->input, 0);
+    corpusHeld = scriptHeld = soak.held = 0;
+    corpus_tick(game);
+    for (int frame = 0; game->sim.winner == 0 && frame < frames; frame++) {
+        script(game, frame);
+        corpus_tick(game);
+    }
+    printf("%u ticks, winner %d at %d/%d health\n", game->sim.tick, game->sim.winner, game->sim.player1_health,
+           game->sim.player2_health);
+    replay_save(&game->sim);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: replaycorpus DIR\n");
+        return 2;
+    }
+    static Game game;
+    game.silent = true;
+    if (!loadFrameData(framedatafile, &game.frameData)) {
+        fprintf(stderr, "Could not load frame data; run from the repository root\n");
+        return 1;
+    }
+    game.idleMove = findMove(&game.frameData, "idle");
+    game.punchMove = findMove(&game.frameData, "punch");
+    game.kickMove = findMove(&game.frameData, "kick");
+    if (!loadAnimations(ryuanims, &game.ryuAnims) || !loadAnimations(kenanims, &game.kenAnims)) {
+        fprintf(stderr, "Could not load animation files\n");
+        return 1;
+    }
+    // The sprite templates main builds; the sheets are never drawn here
+    Sprite sprite1 = { .spriteSheet = &game.ryu1, .anims = &game.ryuAnims, .currentAnimation = STANCE, .x = width / 2, .y = height / 2 };
+    Sprite sprite2 = { .spriteSheet = &game.ken1, .anims = &game.kenAnims, .currentAnimation = STANCE, .x = width / 2, .y = height / 2 };
+    resetSprite(&sprite1);
+    resetSprite(&sprite2);
+    game.sprite1 = sprite1;
+    game.sprite2 = sprite2;
+
+    if (!replay_open(argv[1])) {
+        return 1;
+    }
+    corpus_record(&game, soak_fight, SOAK_MATCH_FRAMES);
+    corpus_record(&game, mirror_fight, SOAK_MATCH_FRAMES);
+    corpus_record(&game, zone_fight, TICK_RATE * 12);
+    replay_close();
+    return replay_verify_all(&game, argv[1]) == 0 ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+// Queries the game's replay database (see replaydb.h) without re-simulating.
+//
+//   gcc -O2 tools/replaydb.c -o replaydb
+//   ./fight --replay-db replays
+//   ./replaydb replays [filters] [--list N]
+//   ./replaydb replays --keyframe ID TICK
+//
+// Filters select matches by their index entries alone:
+//   --winner P     player P (1 or 2) won by knock-out
+//   --below PCT    ... and the winner had less than PCT% health left
+//   --longer S     lasted more than S seconds
+//   --shorter S    lasted less than S seconds
+// and print how many matched, the first N of them and their damage by move.
+// "Player 1 won below 10% health" is `--winner 1 --below 10`.
+//
+// --keyframe prints the stored state at or before TICK, the one the game
+// would seek from (./fight --replay-db DIR --replay-seek ID:TICK gives the
+// exact tick).
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../replay.h"
+#include "../replaydb.h"
+
+#define TICK_RATE 60 // the game's
+
+void fail(const char *message) {
+    printf("%s\n", message);
+    exit(1);
+}
+
+// Map a whole file read-only; NULL if it is missing
+const void *map_file(const char *path, size_t *size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat info;
+    const void *base = NULL;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        *size = info.st_size;
+        base = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+        base = base == MAP_FAILED ? NULL : base;
+    }
+    close(fd);
+    return base;
+}
+
+void print_keyframe(const char *directory, const ReplayDbEntry *entry, uint32_t id, uint32_t tick) {
+    char path[280];
+    snprintf(path, sizeof(path), "%s/segment_%04u.rdb", directory, entry->segment);
+    size_t size = 0;
+    const uint8_t *segment = map_file(path, &size);
+    if (!segment || size < sizeof(ReplayDbSegment)) {
+        fail("Segment missing");
+    }
+    const ReplayDbSegment *header = (const ReplayDbSegment *)segment;
+    if (entry->offset + entry->length > header->used || header->used > size) {
+        fail("Replay was never committed to its segment");
+    }
+    const uint8_t *record = segment + entry->offset;
+    ReplayHeader replay;
+    memcpy(&replay, record, sizeof(replay));
+    size_t buttons = ((size_t)replay.ticks * sizeof(uint32_t) + 7) & ~(size_t)7;
+    size_t checksums = (size_t)(replay.ticks / replay.checkInterval) * sizeof(uint64_t);
+    const ReplayDbKeyframe *keyframes = (const ReplayDbKeyframe *)(record + sizeof(replay) + buttons + checksums);
+
+    tick = tick < replay.ticks ? tick : replay.ticks;
+    uint32_t k = tick / REPLAYDB_KEYFRAME_INTERVAL;
+    k = k < entry->keyframes ? k : entry->keyframes - 1;
+    const ReplayDbKeyframe *keyframe = &keyframes[k];
+    printf("Replay %u: keyframe %u of %u at tick %u (of %u), %u ticks before %u\n", id, k + 1, entry->keyframes,
+           keyframe->tick, replay.ticks, tick > keyframe->tick ? tick - keyframe->tick : 0, tick);
+    for (int p = 0; p < 2; p++) {
+        const ReplayDbFighter *f = &keyframe->fighters[p];
+        printf("  P%d at %d,%d health %d, move %d (%d ticks left), animation %d frame %d", p + 1, f->x, f->y, f->health,
+               f->move, f->attackTimer, f->playingAnimation, f->frame);
+        if (f->projectileActive) {
+            printf(", fireball at %d", f->projectileX);
+        }
+        printf("\n");
+    }
+    munmap((void *)segment, size);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("usage: %s <dir> [--winner P] [--below PCT] [--longer S] [--shorter S] [--list N]\n"
+               "       %s <dir> --keyframe ID TICK\n", argv[0], argv[0]);
+        return 1;
+    }
+    const char *directory = argv[1];
+    int winner = 0, list = 10;
+    double below = 101, longer = -1, shorter = 1e9;
+    long keyframeId = -1, keyframeTick = 0;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--winner") == 0 && i + 1 < argc) {
+            winner = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--below") == 0 && i + 1 < argc) {
+            below = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--longer") == 0 && i + 1 < argc) {
+            longer = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--shorter") == 0 && i + 1 < argc) {
+            shorter = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--list") == 0 && i + 1 < argc) {
+            list = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--keyframe") == 0 && i + 2 < argc) {
+            keyframeId = atol(argv[++i]);
+            keyframeTick = atol(argv[++i]);
+        } else {
+            fail("Unknown option");
+        }
+    }
+
+    char path[280];
+    snprintf(path, sizeof(path), "%s/index.rdx", directory);
+    size_t size = 0;
+    const uint8_t *base = map_file(path, &size);
+    if (!base || size < sizeof(ReplayDbIndex)) {
+        fail("No replay database there; record one with ./fight --replay-db");
+    }
+    const ReplayDbIndex *index = (const ReplayDbIndex *)base;
+    if (memcmp(index->magic, REPLAYDB_INDEX_MAGIC, 4) != 0 || index->version != REPLAYDB_VERSION) {
+        fail("Replay database from a different game version");
+    }
+    const ReplayDbEntry *entries = (const ReplayDbEntry *)(index + 1);
+    size_t count = (size - sizeof(ReplayDbIndex)) / sizeof(ReplayDbEntry);
+
+    if (keyframeId >= 0) {
+        if ((size_t)keyframeId >= count || keyframeTick < 0) {
+            fail("No such replay");
+        }
+        print_keyframe(directory, &entries[keyframeId], (uint32_t)keyframeId, (uint32_t)keyframeTick);
+        return 0;
+    }
+
+    // One pass over the index; nothing else is read
+    clock_t start = clock();
+    size_t matched = 0;
+    double seconds = 0;
+    long damage[2][REPLAYDB_MOVES + 1] = {{0}};
+    for (size_t i = 0; i < count; i++) {
+        const ReplayDbEntry *e = &entries[i];
+        double length = (double)e->ticks / TICK_RATE;
+        if ((winner && e->winner != (uint32_t)winner) || length <= longer || length >= shorter) {
+            continue;
+        }
+        if (below <= 100 && (e->winner == 0 || e->health[e->winner - 1] * 100.0 >= below * REPLAYDB_MAX_HEALTH)) {
+            continue;
+        }
+        if ((int)matched < list) {
+            time_t when = (time_t)e->recordedAt;
+            char date[32];
+            strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&when));
+            printf("%8zu  %s  %6.1f s  winner %u  health %3d/%3d\n", i, date, length, e->winner, e->health[0],
+                   e->health[1]);
+        }
+        matched++;
+        seconds += length;
+        for (int p = 0; p < 2; p++) {
+            for (int m = 0; m <= REPLAYDB_MOVES; m++) {
+                damage[p][m] += e->damage[p][m];
+            }
+        }
+    }
+    double ms = (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+    printf("%zu of %zu matches, %.1f s of play on average; index scanned in %.2f ms\n", matched, count,
+           matched ? seconds / matched : 0.0, ms);
+    if (matched == 0) {
+        return 0;
+    }
+    printf("\n%-12s %10s %10s\n", "damage", "player 1", "player 2");
+    for (int m = 0; m <= REPLAYDB_MOVES; m++) {
+        char name[13] = "fireball";
+        if (m < REPLAYDB_MOVES) {
+            memcpy(name, index->moveNames[m], 12);
+            name[12] = '\0';
+        }
+        if (damage[0][m] || damage[1][m]) {
+            printf("%-12s %10ld %10ld\n", name, damage[0][m], damage[1][m]);
+        }
+    }
+    munmap((void *)base, size);
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Latency benchmark for the game's shared-memory state and input ring
+// (see sharedstate.h).
+//
+//   gcc -O2 tools/shmbench.c -o shmbench      (add -lrt on older glibc)
+//   ./fight --shm --start match &
+//   ./shmbench [inputs] [buttons]
+//
+// Measures, against a running match:
+//   read     cost of one consistent seqlock copy, and how often it retried
+//   publish  tick written by the game -> seen by a spinning reader
+//   input    player 2 input written -> applied by the sim -> visible here;
+//            dominated by waiting for the next tick; each input goes out
+//            right after the previous one was seen, so close to one period
+// Inputs default to no buttons, so the benchmark does not move player 2.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../sharedstate.h"
+
+#define READS 1000000
+#define PUBLISHES 300
+#define TIMEOUT_NS 1000000000ull
+
+void fail(const char *message) {
+    printf("%s\n", message);
+    exit(1);
+}
+
+uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+int compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void report(const char *name, uint64_t *samples, int count) {
+    if (count == 0) {
+        printf("%-8s no samples\n", name);
+        return;
+    }
+    qsort(samples, count, sizeof(uint64_t), compare);
+    double sum = 0;
+    for (int i = 0; i < count; i++) {
+        sum += samples[i];
+    }
+    printf("%-8s %6d samples  mean %9.1f us  p50 %9.1f us  p99 %9.1f us  max %9.1f us\n", name, count,
+           sum / count / 1000.0, samples[count / 2] / 1000.0, samples[count * 99 / 100] / 1000.0,
+           samples[count - 1] / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+    int inputs = argc > 1 ? atoi(argv[1]) : 300;
+    uint32_t buttons = argc > 2 ? (uint32_t)strtoul(argv[2], NULL, 0) : 0;
+    if (inputs <= 0) {
+        inputs = 300;
+    }
+    int fd = shm_open(SHAREDSTATE_NAME, O_RDWR, 0);
+    if (fd < 0) {
+        fail("No shared state; start the game with --shm --start match");
+    }
+    SharedState *shared = mmap(NULL, sizeof(SharedState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        fail("Unable to map the shared state");
+    }
+    if (memcmp(shared->magic, SHAREDSTATE_MAGIC, 4) != 0 || shared->version != SHAREDSTATE_VERSION ||
+        shared->size != sizeof(SharedState)) {
+        fail("Shared state from a different game version");
+    }
+
+    SharedMatch match;
+    uint64_t deadline = now_ns() + 10 * TIMEOUT_NS;
+    do {
+        sharedstate_read(shared, &match);
+        if (now_ns() > deadline) {
+            fail("No match running");
+        }
+    } while (!match.inMatch);
+
+    // Read cost
+    uint64_t retries = 0, start = now_ns();
+    for (int i = 0; i < READS; i++) {
+        retries += sharedstate_read(shared, &match);
+    }
+    double readNs = (double)(now_ns() - start) / READS;
+    printf("read     %d copies of %zu bytes  %.1f ns each  %llu retries\n", READS, sizeof(SharedMatch), readNs,
+           (unsigned long long)retries);
+
+    // Publish -> observed, spinning on the tick counter
+    uint64_t *samples = malloc(sizeof(uint64_t) * (inputs > PUBLISHES ? inputs : PUBLISHES));
+    int count = 0;
+    uint32_t lastTick = match.tick;
+    deadline = now_ns() + 30 * TIMEOUT_NS;
+    while (count < PUBLISHES && now_ns() < deadline) {
+        sharedstate_read(shared, &match);
+        if (match.tick != lastTick) {
+            samples[count++] = now_ns() - match.publishNs;
+            lastTick = match.tick;
+        }
+    }
+    report("publish", samples, count);
+
+    // Input -> applied and visible. One input in flight at a time.
+    count = 0;
+    int lost = 0;
+    for (int i = 0; i < inputs; i++) {
+        uint64_t sent = now_ns();
+        if (!sharedstate_send(shared, buttons, sent)) {
+            fail("Input ring full; is the match paused?");
+        }
+        do {
+            sharedstate_read(shared, &match);
+        } while (match.lastInputSentNs != sent && now_ns() - sent < TIMEOUT_NS);
+        if (match.lastInputSentNs == sent) {
+            samples[count++] = now_ns() - sent;
+        } else {
+            lost++;
+        }
+    }
+    report("input", samples, count);
+    if (lost) {
+        printf("%d input(s) not applied within %llu ms\n", lost, (unsigned long long)(TIMEOUT_NS / 1000000));
+    }
+    sharedstate_send(shared, 0, now_ns()); // leave player 2 with nothing held
+    free(samples);
+    munmap(shared, sizeof(SharedState));
+    return 0;
+}
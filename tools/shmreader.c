@@ -0,0 +1,84 @@
+// Minimal reader of the game's shared-memory state (see sharedstate.h).
+//
+//   gcc tools/shmreader.c -o shmreader        (add -lrt on older glibc)
+//   ./fight --shm &
+//   ./shmreader [hz]
+//
+// Prints health, positions, animations and projectiles a few times a second
+// until the game exits. The mapping is read-only: a reader cannot disturb
+// the game, it only retries a copy that raced with a tick.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "../sharedstate.h"
+
+static const char *animations[] = { "walk", "jump", "punch", "kick", "stance", "special" };
+
+void fail(const char *message) {
+    printf("%s\n", message);
+    exit(1);
+}
+
+const char *animation_name(int animation) {
+    return animation >= 0 && animation < 6 ? animations[animation] : "?";
+}
+
+int main(int argc, char *argv[]) {
+    int hz = argc > 1 ? atoi(argv[1]) : 4;
+    if (hz <= 0) {
+        hz = 4;
+    }
+    int fd = shm_open(SHAREDSTATE_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        fail("No shared state; start the game with --shm");
+    }
+    const SharedState *shared = mmap(NULL, sizeof(SharedState), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        fail("Unable to map the shared state");
+    }
+    while (memcmp(shared->magic, SHAREDSTATE_MAGIC, 4) != 0) {
+        usleep(1000); // the game is still setting it up
+    }
+    if (shared->version != SHAREDSTATE_VERSION || shared->size != sizeof(SharedState)) {
+        fail("Shared state from a different game version");
+    }
+    printf("Reading pid %u\n", shared->pid);
+
+    uint32_t lastTick = UINT32_MAX;
+    while (kill((pid_t)shared->pid, 0) == 0 || errno == EPERM) {
+        SharedMatch match;
+        sharedstate_read(shared, &match);
+        if (!match.inMatch) {
+            if (lastTick != UINT32_MAX) {
+                printf("(no match)\n");
+            }
+            lastTick = UINT32_MAX;
+        } else if (match.tick != lastTick) {
+            lastTick = match.tick;
+            printf("tick %6u", match.tick);
+            for (int p = 0; p < 2; p++) {
+                const SharedFighter *f = &match.fighters[p];
+                printf("  P%d hp %3d at %4d,%3d %-7s", p + 1, f->health, f->x, f->y, animation_name(f->animation));
+                if (f->projectileActive) {
+                    printf(" fireball %4d", f->projectileX);
+                }
+            }
+            if (match.winner) {
+                printf("  player %u wins", match.winner);
+            }
+            printf("\n");
+        }
+        fflush(stdout); // usually piped into an overlay or a log
+        usleep(1000000 / hz);
+    }
+    printf("Game exited\n");
+    munmap((void *)shared, sizeof(SharedState));
+    return 0;
+}
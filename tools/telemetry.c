@@ -0,0 +1,162 @@
+// Aggregates match telemetry logs into per-move damage and usage statistics.
+//
+//   gcc tools/telemetry.c -o telemetry
+//   ./fight --telemetry session.tlm
+//   ./telemetry session.tlm [more.tlm ...]
+//
+// Every log carries its own move names; moves are matched across logs by
+// name, so logs from different frame data versions can be combined.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "../telemetry.h"
+
+#define MAX_ROWS (TELEMETRY_MAX_MOVES + 1)
+
+typedef struct {
+    char name[13];
+    unsigned long started[2];  // per player
+    unsigned long hits[2];
+    long damage[2];
+    long spacing;              // summed attacker-defender distance at hit time
+} MoveStats;
+
+MoveStats rows[MAX_ROWS];
+int rowCount = 0;
+
+unsigned long matches = 0, wins[2] = {0, 0}, roundTicks = 0, events = 0, dropped = 0;
+int tickRate = 60;
+
+MoveStats *find_row(const char *name) {
+    for (int i = 0; i < rowCount; i++) {
+        if (strcmp(rows[i].name, name) == 0) {
+            return &rows[i];
+        }
+    }
+    if (rowCount == MAX_ROWS) {
+        return NULL;
+    }
+    MoveStats *row = &rows[rowCount++];
+    memset(row, 0, sizeof(*row));
+    strncpy(row->name, name, sizeof(row->name) - 1);
+    return row;
+}
+
+void add_event(const TelemetryEvent *event, MoveStats **byMove) {
+    events++;
+    int p = event->player == 2 ? 1 : 0;
+    MoveStats *row = event->move == TELEMETRY_PROJECTILE ? byMove[TELEMETRY_MAX_MOVES]
+                     : event->move < TELEMETRY_MAX_MOVES ? byMove[event->move] : NULL;
+    switch (event->type) {
+    case TELEMETRY_MATCH_START:
+        matches++;
+        break;
+    case TELEMETRY_MOVE:
+    case TELEMETRY_SPECIAL:
+        if (row) {
+            row->started[p]++;
+        }
+        break;
+    case TELEMETRY_HIT:
+        if (row) {
+            row->hits[p]++;
+            row->damage[p] += event->damage;
+            row->spacing += abs(event->attackerX - event->defenderX);
+        }
+        break;
+    case TELEMETRY_ROUND:
+        wins[p]++;
+        roundTicks += event->tick;
+        break;
+    }
+}
+
+bool read_log(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        printf("Unable to open %s\n", path);
+        return false;
+    }
+    TelemetryHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TELEMETRY_MAGIC, 4) != 0 ||
+        header.version != TELEMETRY_VERSION || header.moveCount > TELEMETRY_MAX_MOVES) {
+        printf("%s: not a telemetry log\n", path);
+        fclose(file);
+        return false;
+    }
+    tickRate = header.tickRate ? header.tickRate : tickRate;
+
+    // This log's move indices -> rows shared by all logs
+    MoveStats *byMove[TELEMETRY_MAX_MOVES + 1] = {0};
+    for (uint32_t i = 0; i < header.moveCount; i++) {
+        char name[13] = {0};
+        memcpy(name, header.moveNames[i], 12);
+        byMove[i] = find_row(name);
+    }
+    byMove[TELEMETRY_MAX_MOVES] = find_row("projectile");
+
+    TelemetryBatch batch;
+    TelemetryEvent chunk[256];
+    while (fread(&batch, sizeof(batch), 1, file) == 1) {
+        dropped += batch.dropped;
+        uint32_t left = batch.count;
+        while (left > 0) {
+            size_t want = left < 256 ? left : 256;
+            size_t got = fread(chunk, sizeof(TelemetryEvent), want, file);
+            for (size_t i = 0; i < got; i++) {
+                add_event(&chunk[i], byMove);
+            }
+            if (got < want) {
+                printf("%s: last batch cut short\n", path);
+                fclose(file);
+                return true;
+            }
+            left -= (uint32_t)got;
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("usage: %s <log.tlm> [...]\n", argv[0]);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        if (!read_log(argv[i])) {
+            return 1;
+        }
+    }
+
+    printf("%lu events, %lu matches, %lu dropped\n", events, matches, dropped);
+    unsigned long rounds = wins[0] + wins[1];
+    if (rounds > 0) {
+        printf("Rounds: %lu, player 1 won %lu, player 2 won %lu, mean length %.1f s\n\n", rounds, wins[0], wins[1],
+               (double)roundTicks / rounds / tickRate);
+    }
+
+    long totalDamage = 0;
+    for (int i = 0; i < rowCount; i++) {
+        totalDamage += rows[i].damage[0] + rows[i].damage[1];
+    }
+    printf("%-12s %8s %8s %7s %8s %8s %7s %8s\n", "move", "used", "hits", "hit %", "damage", "dmg/hit", "share", "spacing");
+    for (int i = 0; i < rowCount; i++) {
+        const MoveStats *row = &rows[i];
+        unsigned long used = row->started[0] + row->started[1];
+        unsigned long hits = row->hits[0] + row->hits[1];
+        long damage = row->damage[0] + row->damage[1];
+        if (used == 0 && hits == 0) {
+            continue; // idle and other moves nobody starts
+        }
+        printf("%-12s %8lu %8lu %6.1f%% %8ld %8.1f %6.1f%% %8.1f\n", row->name, used, hits,
+               used ? 100.0 * hits / used : 0.0, damage, hits ? (double)damage / hits : 0.0,
+               totalDamage ? 100.0 * damage / totalDamage : 0.0, hits ? (double)row->spacing / hits : 0.0);
+        for (int p = 0; p < 2; p++) {
+            printf("  player %d   %8lu %8lu %6.1f%% %8ld\n", p + 1, row->started[p], row->hits[p],
+                   row->started[p] ? 100.0 * row->hits[p] / row->started[p] : 0.0, row->damage[p]);
+        }
+    }
+    return 0;
+}
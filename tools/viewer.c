@@ -0,0 +1,289 @@
+// Watches a match through the spectator stream (see spectator.h).
+//
+//   gcc tools/viewer.c -o viewer $(sdl2-config --cflags --libs)
+//   ./viewer match.spec              replay a stream the game wrote with --spectate
+//   ./viewer 127.0.0.1 7777          follow a live match started with --spectate-port 7777
+//
+// Fighters, health and projectiles are drawn as flat shapes, so the viewer
+// needs none of the game's assets. It never holds more than VIEW_BUFFER
+// decoded ticks: a live viewer shows the newest tick VIEW_DELAY ticks late to
+// absorb jitter and drops anything older, and playback only reads a packet
+// once its tick is due.
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <winsock2.h>
+typedef SOCKET Socket;
+#define NO_SOCKET INVALID_SOCKET
+#define close_socket closesocket
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+typedef int Socket;
+#define NO_SOCKET (-1)
+#define close_socket close
+#endif
+#include "../spectator.h"
+
+#define VIEW_BUFFER 8
+#define VIEW_DELAY 2
+#define INPUT_BUFFER 8192
+
+typedef struct {
+    uint32_t tick;
+    int32_t fields[SPECTATOR_FIELDS];
+} View;
+
+typedef struct {
+    FILE *file;
+    Socket socket;
+    uint8_t bytes[INPUT_BUFFER];
+    int count;
+    bool closed;
+    uint64_t received;
+} Source;
+
+// Ticks decoded so far, oldest first
+View views[VIEW_BUFFER];
+int viewCount = 0;
+
+void fail(const char *message) {
+    printf("%s\n", message);
+    exit(1);
+}
+
+// Top up the input buffer without blocking on a socket
+void source_fill(Source *source) {
+    int space = INPUT_BUFFER - source->count;
+    if (space == 0 || source->closed) {
+        return;
+    }
+    int n;
+    if (source->file) {
+        n = (int)fread(source->bytes + source->count, 1, space, source->file);
+        source->closed = n == 0;
+    } else {
+        n = recv(source->socket, (char *)source->bytes + source->count, space, 0);
+        if (n == 0) {
+            source->closed = true;
+        }
+#ifdef _WIN32
+        else if (n < 0 && WSAGetLastError() != WSAEWOULDBLOCK) {
+#else
+        else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+#endif
+            source->closed = true;
+        }
+    }
+    if (n > 0) {
+        source->count += n;
+        source->received += n;
+    }
+}
+
+void source_consume(Source *source, int n) {
+    memmove(source->bytes, source->bytes + n, source->count - n);
+    source->count -= n;
+}
+
+Socket connect_to(const char *host, int port) {
+#ifdef _WIN32
+    WSADATA wsa;
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    address.sin_addr.s_addr = inet_addr(host);
+    Socket s = socket(AF_INET, SOCK_STREAM, 0);
+    if (s == NO_SOCKET || connect(s, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        fail("Unable to connect to the game");
+    }
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket(s, FIONBIO, &mode);
+#else
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    return s;
+}
+
+void push_view(uint32_t tick, const int32_t *fields) {
+    if (viewCount == VIEW_BUFFER) {
+        memmove(views, views + 1, sizeof(View) * (VIEW_BUFFER - 1)); // bounded: drop the oldest
+        viewCount--;
+    }
+    views[viewCount].tick = tick;
+    memcpy(views[viewCount].fields, fields, sizeof(views[viewCount].fields));
+    viewCount++;
+}
+
+// Decode complete packets, stopping at the first one later than dueTick
+void read_packets(Source *source, int32_t *keyframe, bool *haveKeyframe, uint32_t dueTick) {
+    while (source->count > 0 && source->count >= source->bytes[0] + 1) {
+        int length = source->bytes[0];
+        int32_t key[SPECTATOR_FIELDS], fields[SPECTATOR_FIELDS];
+        uint32_t tick;
+        memcpy(key, keyframe, sizeof(key));
+        int kind = spectator_decode(source->bytes + 1, length, key, fields, &tick);
+        if (kind == 0) {
+            fail("Corrupt spectator stream");
+        }
+        if (*haveKeyframe && tick > dueTick) {
+            return; // not yet
+        }
+        source_consume(source, length + 1);
+        if (kind == SPECTATOR_KEYFRAME) {
+            memcpy(keyframe, key, sizeof(key));
+            *haveKeyframe = true;
+        }
+        if (*haveKeyframe) {
+            push_view(tick, fields);
+        }
+    }
+}
+
+void fill_rect(SDL_Renderer *renderer, int x, int y, int w, int h, Uint8 r, Uint8 g, Uint8 b) {
+    SDL_Rect rect = {x, y, w, h};
+    SDL_SetRenderDrawColor(renderer, r, g, b, 255);
+    SDL_RenderFillRect(renderer, &rect);
+}
+
+void draw_view(SDL_Renderer *renderer, const SpectatorHeader *header, const View *view) {
+    // Shade per animation: walking, jumping, punching, kicking, stance, special
+    static const Uint8 shades[6] = { 200, 255, 160, 160, 120, 255 };
+    SDL_SetRenderDrawColor(renderer, 24, 24, 32, 255);
+    SDL_RenderClear(renderer);
+    for (int p = 0; p < 2; p++) {
+        const int32_t *f = view->fields + SPECTATOR_FIGHTER(p);
+        int animation = f[SPECTATOR_ANIMATION];
+        Uint8 shade = animation >= 0 && animation < 6 ? shades[animation] : 255;
+        fill_rect(renderer, f[SPECTATOR_X], f[SPECTATOR_Y], f[SPECTATOR_WIDTH], f[SPECTATOR_HEIGHT],
+                  p == 0 ? shade : 40, 40, p == 0 ? 40 : shade);
+        // Health bars where the game's HUD puts them, one pixel per point
+        int health = f[SPECTATOR_HEALTH];
+        fill_rect(renderer, p == 0 ? 140 : 1070 - health, 80, health, 20, 200, 30, 30);
+
+        const int32_t *q = view->fields + SPECTATOR_PROJECTILE(p);
+        if (q[SPECTATOR_ACTIVE]) {
+            fill_rect(renderer, q[SPECTATOR_PROJECTILE_X], q[SPECTATOR_PROJECTILE_Y],
+                      header->projectileW, header->projectileH, 240, 220, 60);
+        }
+    }
+    SDL_RenderPresent(renderer);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2 && argc != 3) {
+        printf("usage: %s <stream file> | %s <host> <port>\n", argv[0], argv[0]);
+        return 1;
+    }
+    Source source;
+    memset(&source, 0, sizeof(source));
+    source.socket = NO_SOCKET;
+    bool live = argc == 3;
+    if (live) {
+        source.socket = connect_to(argv[1], atoi(argv[2]));
+    } else if (!(source.file = fopen(argv[1], "rb"))) {
+        fail("Unable to open the stream");
+    }
+
+    // The header comes first on both
+    SpectatorHeader header;
+    while (source.count < (int)sizeof(header) && !source.closed) {
+        source_fill(&source);
+        SDL_Delay(live ? 10 : 0);
+    }
+    memcpy(&header, source.bytes, sizeof(header));
+    if (source.count < (int)sizeof(header) || memcmp(header.magic, SPECTATOR_MAGIC, 4) != 0 ||
+        header.version != SPECTATOR_VERSION || header.fieldCount != SPECTATOR_FIELDS || header.tickRate == 0) {
+        fail("Not a spectator stream this viewer understands");
+    }
+    source_consume(&source, sizeof(header));
+
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        fail("SDL_Init failed");
+    }
+    SDL_Window *window = SDL_CreateWindow("Fight Arena - spectator", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                          header.arenaW, header.arenaH, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    SDL_Renderer *renderer = window ? SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC) : NULL;
+    if (!renderer) {
+        fail("Unable to create a window");
+    }
+    SDL_RenderSetLogicalSize(renderer, header.arenaW, header.arenaH);
+
+    int32_t keyframe[SPECTATOR_FIELDS];
+    bool haveKeyframe = false;
+    Uint32 start = SDL_GetTicks(), firstTick = 0;
+    bool started = false;
+    bool run = true;
+    while (run) {
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE)) {
+                run = false;
+            }
+        }
+        source_fill(&source);
+
+        // Playback follows the stream's own clock from its first tick; live takes everything that arrived
+        uint32_t due = UINT32_MAX;
+        if (!live) {
+            due = started ? firstTick + (uint32_t)((Uint64)(SDL_GetTicks() - start) * header.tickRate / 1000) : 0;
+        }
+        read_packets(&source, keyframe, &haveKeyframe, due);
+        if (!started && viewCount > 0) {
+            started = true;
+            firstTick = views[0].tick;
+            start = SDL_GetTicks();
+        }
+        if (viewCount == 0) {
+            SDL_Delay(10);
+            if (source.closed) {
+                break;
+            }
+            continue;
+        }
+
+        // Newest tick at least VIEW_DELAY behind the latest one received (live), else the newest
+        const View *view = &views[viewCount - 1];
+        for (int i = viewCount - 1; live && i >= 0; i--) {
+            view = &views[i];
+            if (views[i].tick + VIEW_DELAY <= views[viewCount - 1].tick) {
+                break;
+            }
+        }
+        draw_view(renderer, &header, view);
+
+        char title[128];
+        int winner = view->fields[SPECTATOR_WINNER];
+        double seconds = (SDL_GetTicks() - start) / 1000.0;
+        snprintf(title, sizeof(title), "Fight Arena - spectator - tick %u%s - %.0f bytes/s", view->tick,
+                 winner == 1 ? " - player 1 wins" : winner == 2 ? " - player 2 wins" : "",
+                 seconds > 0 ? source.received / seconds : 0.0);
+        SDL_SetWindowTitle(window, title);
+        if (source.closed && source.count == 0 && !live && view == &views[viewCount - 1]) {
+            SDL_Delay(2000); // show the final state briefly
+            break;
+        }
+    }
+
+    if (source.file) {
+        fclose(source.file);
+    }
+    if (source.socket != NO_SOCKET) {
+        close_socket(source.socket);
+    }
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}